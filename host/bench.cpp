@@ -0,0 +1,97 @@
+//
+// Gesture engine benchmark. Runs every synthetic script through
+// TrackpadRawInput and prints the time per frame, with the frames made
+// up front so the generator does not count.
+//
+// cyapa_bench [duration ms per script]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gesture.h"
+#include "synth.h"
+
+#define BENCH_RUNS 5
+
+static const char *presetnames[] = { "", "pointing", "taps", "scroll", "swipe", "churn" };
+
+static unsigned long reports;
+
+static void bench_mouse(void *context, uint8_t buttons, uint8_t x, uint8_t y,
+	uint8_t wheel, uint8_t hwheel) {
+	(void)context; (void)buttons; (void)x; (void)y; (void)wheel; (void)hwheel;
+	reports++;
+}
+
+static void bench_keyboard(void *context, uint8_t shiftKeys, uint8_t *keyCodes) {
+	(void)context; (void)shiftKeys; (void)keyCodes;
+	reports++;
+}
+
+static void bench_scroll(void *context, uint8_t flag, uint16_t x1, uint16_t y1,
+	uint16_t x2, uint16_t y2) {
+	(void)context; (void)flag; (void)x1; (void)y1; (void)x2; (void)y2;
+	reports++;
+}
+
+static double nowns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static struct csgesture_softc sc;
+
+int main(int argc, char **argv) {
+	uint32_t duration = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 60000;
+	struct csgesture_sink sink = { NULL, bench_mouse, bench_keyboard, bench_scroll };
+
+	for (int preset = SYNTH_POINTING; preset <= SYNTH_CHURN; preset++) {
+		struct synth_script script;
+		struct synth_state state;
+
+		if (!synth_preset(&script, preset, duration))
+			return 1;
+
+		//
+		// Enough room for the whole script at its frame rate
+		//
+		uint32_t maxframes = (uint32_t)((unsigned long long)duration * script.rate / 1000) + 1;
+		struct cyapa_regs *frames = (struct cyapa_regs *)malloc(maxframes * sizeof(*frames));
+		uint32_t *times = (uint32_t *)malloc(maxframes * sizeof(*times));
+		uint32_t count = 0;
+
+		if (!frames || !times)
+			return 1;
+
+		synth_init(&state, &script);
+		while (count < maxframes && synth_next(&state, &frames[count], &times[count]))
+			count++;
+
+		double best = 0;
+		for (int run = 0; run < BENCH_RUNS; run++) {
+			memset(&sc, 0, sizeof(sc));
+			SetDefaultSettings(&sc.settings);
+			reports = 0;
+
+			double start = nowns();
+			for (uint32_t i = 0; i < count; i++)
+				TrackpadRawInput(&sink, &sc, &frames[i], times[i]);
+			double elapsed = nowns() - start;
+
+			if (run == 0 || elapsed < best)
+				best = elapsed;
+		}
+
+		printf("%-8s %7u frames %6.2f reports/frame %8.1f ns/frame\n", presetnames[preset],
+			count, count ? (double)reports / count : 0.0, count ? best / count : 0.0);
+
+		free(frames);
+		free(times);
+	}
+
+	return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef _HOST_CHECK_H_
+#define _HOST_CHECK_H_
+
+#include <stdio.h>
+
+//
+// Minimal test support for the host tests: CHECK reports a failed
+// condition with its location and marks the run failed, the test's main
+// returns CHECK_RESULT() as its exit code.
+//
+
+static int check_failures;
+
+#define CHECK(condition)											\
+	do {															\
+		if (!(condition)) {											\
+			fprintf(stderr, "%s:%d: check failed: %s\n",			\
+				__FILE__, __LINE__, #condition);					\
+			check_failures++;										\
+		}															\
+	} while (0)
+
+#define CHECK_RESULT() (check_failures ? 1 : 0)
+
+#endif
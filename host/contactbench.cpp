@@ -0,0 +1,164 @@
+//
+// Microbenchmark of the per-frame contact work. Runs the engine's contact
+// kernel, which walks the slot masks (or goes four records at a time with
+// SSE2), against the same work done the way the engine used to: testing
+// all 15 slots for -1. The two have to agree on every frame.
+//
+// gesture.cpp is built into this file so its static functions can be
+// reached, this target does not link the engine library.
+//
+// cyapa_contactbench [iterations]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gesture.cpp"
+
+#define BENCH_RUNS 5
+
+static void scankernel(csgesture_softc *sc, struct contactframe *frame) {
+	frame->moving = 0;
+
+	for (int i = 0; i < MAX_FINGERS; i++) {
+		if (sc->contacts[i].x != -1 && sc->contacts[i].lastx != -1) {
+			frame->absdelta[i][0] = (int16_t)abs(sc->contacts[i].x - sc->contacts[i].lastx);
+			frame->absdelta[i][1] = (int16_t)abs(sc->contacts[i].y - sc->contacts[i].lasty);
+		}
+
+		if (sc->contacts[i].lastx != -1 && sc->contacts[i].tick != 0) {
+			int avgx = sc->contacts[i].flextotalx / sc->contacts[i].tick;
+			int avgy = sc->contacts[i].flextotaly / sc->contacts[i].tick;
+			if (avgx * avgx + avgy * avgy > 2)
+				frame->moving |= CONTACT_BIT(i);
+		}
+	}
+}
+
+//
+// Slots the pad's ids land in, spread out the way they are in practice
+//
+static const int slots[CYAPA_MAX_MT] = { 3, 7, 11, 14, 1 };
+
+//
+// Only the loop and the new positions, taken off the other two timings
+//
+static void nokernel(csgesture_softc *sc, struct contactframe *frame) {
+	(void)sc;
+	frame->moving = 0;
+	frame->absdelta[slots[0]][0] = 0;
+}
+
+static struct csgesture_softc sc;
+
+static void setup(int ncontacts) {
+	memset(&sc, 0, sizeof(sc));
+
+	for (int i = 0; i < MAX_FINGERS; i++) {
+		sc.contacts[i].x = sc.contacts[i].lastx = -1;
+		sc.contacts[i].y = sc.contacts[i].lasty = -1;
+	}
+
+	for (int n = 0; n < ncontacts; n++) {
+		int i = slots[n];
+
+		sc.contacts[i].lastx = (int16_t)(100 + 100 * n);
+		sc.contacts[i].lasty = (int16_t)(100 + 50 * n);
+		sc.contacts[i].tick = 5;
+		sc.activemask |= CONTACT_BIT(i);
+	}
+	sc.lastactivemask = sc.activemask;
+}
+
+//
+// New positions and motion windows for iteration n
+//
+static void step(int ncontacts, unsigned n) {
+	for (int c = 0; c < ncontacts; c++) {
+		int i = slots[c];
+
+		sc.contacts[i].x = (int16_t)(sc.contacts[i].lastx + (int)(n % 7) - 3);
+		sc.contacts[i].y = (int16_t)(sc.contacts[i].lasty + (int)(n % 5) - 2);
+		sc.contacts[i].flextotalx = (int32_t)((n + c) % 13) - 6;
+		sc.contacts[i].flextotaly = (int32_t)((n * 3 + c) % 11) - 5;
+	}
+}
+
+static bool same(int ncontacts, struct contactframe *a, struct contactframe *b) {
+	if (a->moving != b->moving)
+		return false;
+	for (int c = 0; c < ncontacts; c++) {
+		int i = slots[c];
+
+		if (a->absdelta[i][0] != b->absdelta[i][0] || a->absdelta[i][1] != b->absdelta[i][1])
+			return false;
+	}
+	return true;
+}
+
+static double nowns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static volatile unsigned blackhole;
+
+static double timekernel(void (*kernel)(csgesture_softc *, struct contactframe *),
+	int ncontacts, unsigned iterations) {
+	struct contactframe frame;
+	double best = 0;
+
+	for (int run = 0; run < BENCH_RUNS; run++) {
+		unsigned acc = 0;
+
+		setup(ncontacts);
+		double start = nowns();
+		for (unsigned n = 0; n < iterations; n++) {
+			step(ncontacts, n);
+			kernel(&sc, &frame);
+			acc += frame.moving + (unsigned)frame.absdelta[slots[0]][0];
+		}
+		double elapsed = nowns() - start;
+
+		blackhole = acc;
+		if (run == 0 || elapsed < best)
+			best = elapsed;
+	}
+	return best / iterations;
+}
+
+int main(int argc, char **argv) {
+	unsigned iterations = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 0) : 10000000;
+
+	printf("contact kernel: %s\n", CSGESTURE_SIMD ? "sse2" : "scalar");
+
+	for (int ncontacts = 1; ncontacts <= CYAPA_MAX_MT; ncontacts++) {
+		struct contactframe scanned, kernel;
+
+		setup(ncontacts);
+		for (unsigned n = 0; n < 1000; n++) {
+			step(ncontacts, n);
+			memset(&scanned, 0, sizeof(scanned));
+			memset(&kernel, 0, sizeof(kernel));
+			scankernel(&sc, &scanned);
+			contactkernel(&sc, &kernel);
+			if (!same(ncontacts, &scanned, &kernel)) {
+				fprintf(stderr, "%d contacts: kernel and slot scan differ at iteration %u\n",
+					ncontacts, n);
+				return 1;
+			}
+		}
+
+		double overhead = timekernel(nokernel, ncontacts, iterations);
+		double scan = timekernel(scankernel, ncontacts, iterations) - overhead;
+		double masked = timekernel(contactkernel, ncontacts, iterations) - overhead;
+
+		printf("%d contacts  slot scan %6.2f ns  kernel %6.2f ns  %5.2fx\n",
+			ncontacts, scan, masked, masked > 0 ? scan / masked : 0.0);
+	}
+
+	return 0;
+}
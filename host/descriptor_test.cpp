@@ -0,0 +1,145 @@
+//
+// The report descriptor against the report structures: every report the
+// driver sends or takes has to be exactly as long as the descriptor says,
+// and the touchpad extent patch has to reach every contact
+//
+
+#define DEFINEDESCRIPTOR
+
+#include "check.h"
+#include "internal.h"
+#include "hiddevice.h"
+
+enum { MAIN_INPUT, MAIN_OUTPUT, MAIN_FEATURE, MAIN_TYPES };
+
+struct descriptor_info {
+	int bits[MAIN_TYPES][256];
+	int depth;
+	bool balanced;
+
+	//
+	// Generic Desktop X and Y fields of the touchpad report, with the
+	// logical and physical maximum they were declared with
+	//
+	int xfields, yfields;
+	long xmax[TOUCHPAD_CONTACTS], ymax[TOUCHPAD_CONTACTS];
+};
+
+static void parse(const UCHAR *descriptor, size_t length, struct descriptor_info *info) {
+	long page = 0, size = 0, count = 0, id = 0, logicalmax = 0, physicalmax = 0;
+	long usage = -1;
+
+	memset(info, 0, sizeof(*info));
+	info->balanced = true;
+
+	for (size_t offset = 0; offset < length;) {
+		UCHAR prefix = descriptor[offset];
+		int datasize = (prefix & 3) == 3 ? 4 : prefix & 3;
+		long value = 0;
+
+		for (int i = 0; i < datasize; i++)
+			value |= (long)descriptor[offset + 1 + i] << (8 * i);
+
+		switch (prefix & 0xfc) {
+		case 0x04: page = value; break;
+		case 0x08: if (usage < 0) usage = value; break;
+		case 0x24: logicalmax = value; break;
+		case 0x44: physicalmax = value; break;
+		case 0x74: size = value; break;
+		case 0x84: id = value; break;
+		case 0x94: count = value; break;
+		case 0xa0:
+			info->depth++;
+			usage = -1;
+			break;
+		case 0xc0:
+			if (--info->depth < 0)
+				info->balanced = false;
+			break;
+		case 0x80:
+		case 0x90:
+		case 0xb0: {
+			int type = (prefix & 0xfc) == 0x80 ? MAIN_INPUT :
+				(prefix & 0xfc) == 0x90 ? MAIN_OUTPUT : MAIN_FEATURE;
+
+			info->bits[type][id & 0xff] += (int)(size * count);
+
+			if (id == REPORTID_TOUCHPAD && type == MAIN_INPUT && page == 0x01) {
+				if (usage == 0x30 && info->xfields < TOUCHPAD_CONTACTS)
+					info->xmax[info->xfields++] = logicalmax == physicalmax ? logicalmax : -1;
+				if (usage == 0x31 && info->yfields < TOUCHPAD_CONTACTS)
+					info->ymax[info->yfields++] = logicalmax == physicalmax ? logicalmax : -1;
+			}
+			usage = -1;
+			break;
+		}
+		}
+
+		offset += 1 + datasize;
+	}
+
+	if (info->depth)
+		info->balanced = false;
+}
+
+//
+// Report length in bits as the descriptor declares it, the report ID
+// byte not included
+//
+static int reportbits(size_t size) {
+	return (int)(size - 1) * 8;
+}
+
+static struct descriptor_info info;
+
+static void test_report_sizes(void) {
+	parse(DefaultReportDescriptor, sizeof(DefaultReportDescriptor), &info);
+
+	CHECK(info.balanced);
+	CHECK(info.bits[MAIN_INPUT][REPORTID_RELATIVE_MOUSE] == reportbits(sizeof(CyapaRelativeMouseReport)));
+	CHECK(info.bits[MAIN_FEATURE][REPORTID_RELATIVE_MOUSE] == reportbits(sizeof(CyapaWheelFeatureReport)));
+	CHECK(info.bits[MAIN_INPUT][REPORTID_KEYBOARD] == reportbits(sizeof(CyapaKeyboardReport)));
+	CHECK(info.bits[MAIN_INPUT][REPORTID_SCROLL] == reportbits(sizeof(CyapaScrollReport)));
+	CHECK(info.bits[MAIN_OUTPUT][REPORTID_SCROLLCTRL] == reportbits(sizeof(CyapaScrollControlReport)));
+	CHECK(info.bits[MAIN_OUTPUT][REPORTID_SETTINGS] == reportbits(sizeof(CyapaSettingsReport)));
+	CHECK(info.bits[MAIN_INPUT][REPORTID_SETTINGS] == reportbits(sizeof(CyapaInfoReport)));
+	CHECK(info.bits[MAIN_INPUT][REPORTID_CAPTURE] == reportbits(sizeof(CyapaCaptureReport)));
+	CHECK(info.bits[MAIN_INPUT][REPORTID_TOUCHPAD] == reportbits(sizeof(CyapaTouchpadReport)));
+	CHECK(info.bits[MAIN_FEATURE][REPORTID_TOUCHPAD] == reportbits(sizeof(CyapaTouchpadCapsReport)));
+	CHECK(info.bits[MAIN_FEATURE][REPORTID_FEATURE] == reportbits(sizeof(CyapaFeatureReport)));
+
+	//
+	// Every report has to fit the pending report slots
+	//
+	CHECK(sizeof(CyapaInfoReport) <= CYAPA_REPORT_MAX_SIZE);
+	CHECK(sizeof(CyapaCaptureReport) <= CYAPA_REPORT_MAX_SIZE);
+	CHECK(sizeof(CyapaTouchpadReport) <= CYAPA_REPORT_MAX_SIZE);
+
+	CHECK(DefaultHidDescriptor.DescriptorList[0].wReportLength == sizeof(DefaultReportDescriptor));
+}
+
+static void test_extent_patch(void) {
+	UCHAR descriptor[sizeof(DefaultReportDescriptor)];
+
+	memcpy(descriptor, DefaultReportDescriptor, sizeof(descriptor));
+	touchpad_patch_descriptor(descriptor, sizeof(descriptor), 1050, 680);
+	parse(descriptor, sizeof(descriptor), &info);
+
+	CHECK(info.xfields == TOUCHPAD_CONTACTS && info.yfields == TOUCHPAD_CONTACTS);
+	for (int i = 0; i < TOUCHPAD_CONTACTS; i++) {
+		CHECK(info.xmax[i] == 1050);
+		CHECK(info.ymax[i] == 680);
+	}
+
+	//
+	// Nothing outside the touchpad collection moves
+	//
+	CHECK(info.bits[MAIN_INPUT][REPORTID_TOUCHPAD] == reportbits(sizeof(CyapaTouchpadReport)));
+	CHECK(!memcmp(descriptor, DefaultReportDescriptor, 64));
+}
+
+int main(void) {
+	test_report_sizes();
+	test_extent_patch();
+	return CHECK_RESULT();
+}
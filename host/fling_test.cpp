@@ -0,0 +1,230 @@
+//
+// Kinetic scrolling in wheel mode: two fingers scroll and lift fast, the
+// wheel keeps turning and slows down, a new touch stops it, and no wheel
+// count leaves -127..127 however fast the pad moves
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "gesture.h"
+
+//
+// hidcommon.h only needs these two from the Windows headers
+//
+typedef uint8_t BYTE;
+typedef uint16_t USHORT;
+
+#include "hidcommon.h"
+
+#define FRAME_MS 10
+
+struct wheelcounts {
+	int total;
+	int reports;
+	int largest;
+	bool outofrange;
+};
+
+static struct wheelcounts counts;
+
+static void fling_mouse(void *context, uint8_t buttons, uint8_t x, uint8_t y,
+	uint8_t wheel, uint8_t hwheel) {
+	int value = (int8_t)wheel;
+
+	(void)context;
+	(void)buttons;
+	(void)x;
+	(void)y;
+
+	if ((int8_t)hwheel < -127 || value < -127)
+		counts.outofrange = true;
+	if (!value)
+		return;
+
+	counts.total += value;
+	counts.reports++;
+	if (abs(value) > counts.largest)
+		counts.largest = abs(value);
+}
+
+static void fling_keyboard(void *context, uint8_t shiftKeys, uint8_t *keyCodes) {
+	(void)context;
+	(void)shiftKeys;
+	(void)keyCodes;
+}
+
+static void fling_scroll(void *context, uint8_t flag, uint16_t x1, uint16_t y1,
+	uint16_t x2, uint16_t y2) {
+	(void)context;
+	(void)flag;
+	(void)x1;
+	(void)y1;
+	(void)x2;
+	(void)y2;
+}
+
+static struct csgesture_sink sink = { NULL, fling_mouse, fling_keyboard, fling_scroll };
+
+static struct csgesture_softc sc;
+static uint32_t frametime;
+
+static void setframe(struct cyapa_regs *regs, int nfingers, int y) {
+	memset(regs, 0, sizeof(*regs));
+	regs->stat = CYAPA_STAT_RUNNING;
+	regs->fngr = (uint8_t)(nfingers << 4);
+	for (int i = 0; i < nfingers; i++) {
+		int x = 300 + i * 200;
+
+		regs->touch[i].xy_high = (uint8_t)(((x >> 4) & 0xF0) | ((y >> 8) & 0x0F));
+		regs->touch[i].x_low = (uint8_t)x;
+		regs->touch[i].y_low = (uint8_t)y;
+		regs->touch[i].pressure = 40;
+		regs->touch[i].id = (uint8_t)(i + 1);
+	}
+}
+
+static void frame(int nfingers, int y) {
+	struct cyapa_regs regs;
+
+	setframe(&regs, nfingers, y);
+	TrackpadRawInput(&sink, &sc, &regs, frametime);
+	frametime += FRAME_MS;
+}
+
+//
+// Fresh engine in wheel mode with the given friction, then two fingers
+// scrolling speed pad units a frame
+//
+static void scroll(int friction, uint8_t wheelmultipliers, int speed) {
+	memset(&sc, 0, sizeof(sc));
+	SetDefaultSettings(&sc.settings);
+	CHECK(ApplySetting(&sc.settings, 21, ScrollModeWheel));
+	CHECK(ApplySetting(&sc.settings, 22, friction));
+	sc.wheelmultipliers = wheelmultipliers;
+	frametime = 1000;
+
+	int y = 100;
+	for (int i = 0; i < 40; i++) {
+		frame(2, y);
+		if (i > 5)
+			y += speed;
+	}
+
+	memset(&counts, 0, sizeof(counts));
+}
+
+static void test_fling(void) {
+	scroll(950, 0, 12);
+
+	//
+	// Fingers up at speed: the wheel keeps going on empty frames, a
+	// little less each time, until the fling runs out
+	//
+	int frames = 0;
+	int first = 0, second = 0;
+	while (sc.flinging || frames == 0) {
+		frame(0, 0);
+		frames++;
+		if (frames == 10)
+			first = counts.total;
+		else if (frames == 20)
+			second = counts.total - first;
+		if (frames > 500)
+			break;
+	}
+
+	CHECK(frames > 20 && frames <= 500);
+	CHECK(first != 0 && abs(first) > abs(second));
+	CHECK(!counts.outofrange);
+	CHECK(GestureIdle(&sc));
+
+	int total = counts.total;
+	for (int i = 0; i < 20; i++)
+		frame(0, 0);
+	CHECK(counts.total == total);
+}
+
+static void test_touch_stops(void) {
+	scroll(950, 0, 12);
+
+	for (int i = 0; i < 5; i++)
+		frame(0, 0);
+	CHECK(sc.flinging);
+	CHECK(counts.total != 0);
+
+	//
+	// One finger lands: the fling ends on that frame and nothing follows
+	//
+	int total = counts.total;
+	frame(1, 500);
+	CHECK(!sc.flinging);
+	CHECK(counts.total == total);
+
+	for (int i = 0; i < 20; i++)
+		frame(0, 0);
+	CHECK(counts.total == total);
+	CHECK(!sc.flinging);
+}
+
+static void test_no_friction(void) {
+	scroll(0, 0, 12);
+
+	for (int i = 0; i < 20; i++)
+		frame(0, 0);
+	CHECK(!sc.flinging);
+	CHECK(counts.reports == 0);
+}
+
+static void test_helper_mode(void) {
+	scroll(950, 0, 12);
+	CHECK(ApplySetting(&sc.settings, 21, ScrollModeHelper));
+
+	for (int i = 0; i < 20; i++)
+		frame(0, 0);
+	CHECK(!sc.flinging);
+	CHECK(counts.reports == 0);
+}
+
+//
+// With high resolution wheels on, a frame that comes late in a fling, or
+// a big jump between scroll frames, asks for more counts than a report
+// holds: the report saturates at 127 and the rest goes out with the
+// following ones instead of wrapping
+//
+static void test_saturation(void) {
+	uint8_t highres = MOUSE_WHEEL_MULTIPLIER_VERTICAL | MOUSE_WHEEL_MULTIPLIER_HORIZONTAL;
+
+	scroll(990, highres, 20);
+	frame(0, 0);
+	CHECK(sc.flinging);
+
+	frametime += 1000;
+	frame(0, 0);
+	CHECK(counts.largest == 127);
+	CHECK(sc.wheelremainder != 0);
+
+	int total = counts.total;
+	frame(0, 0);
+	CHECK(abs(counts.total - total) > 1);
+	CHECK(!counts.outofrange);
+
+	scroll(950, highres, 20);
+	frame(2, 3500);
+	CHECK(counts.largest == 127);
+
+	total = counts.total;
+	frame(2, 3500);
+	CHECK(abs(counts.total - total) > 0);
+	CHECK(!counts.outofrange);
+}
+
+int main(void) {
+	test_fling();
+	test_touch_stops();
+	test_no_friction();
+	test_helper_mode();
+	test_saturation();
+	return CHECK_RESULT();
+}
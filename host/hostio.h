@@ -0,0 +1,80 @@
+#ifndef _HOST_HOSTIO_H_
+#define _HOST_HOSTIO_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "capture.h"
+
+//
+// File helpers shared by the host tools
+//
+
+//
+// Whole file, NUL terminated, or NULL if it can't be read
+//
+static inline char *readfile(const char *path, size_t *length) {
+	FILE *file = fopen(path, "rb");
+	char *data = NULL;
+	size_t size = 0;
+
+	if (!file)
+		return NULL;
+
+	*length = 0;
+	for (;;) {
+		if (*length == size) {
+			size = size * 2 + 4096;
+			data = (char *)realloc(data, size + 1);
+			if (!data)
+				exit(1);
+		}
+
+		size_t got = fread(data + *length, 1, size - *length, file);
+		if (!got)
+			break;
+		*length += got;
+	}
+
+	fclose(file);
+	data[*length] = 0;
+	return data;
+}
+
+struct capture_frameset {
+	struct cyapa_regs *frames;
+	uint32_t *times;
+	int count;
+};
+
+//
+// Frames of a capture file with their timestamps, false with a message
+// if the file can't be read or isn't a capture
+//
+static inline bool readframes(const char *path, struct capture_frameset *set) {
+	size_t length;
+	char *data = readfile(path, &length);
+
+	if (!data) {
+		fprintf(stderr, "%s: cannot read\n", path);
+		return false;
+	}
+
+	set->count = capture_frames((const uint8_t *)data, (uint32_t)length, NULL, NULL, 0);
+	if (set->count < 0) {
+		fprintf(stderr, "%s: truncated or unsupported capture\n", path);
+		free(data);
+		return false;
+	}
+
+	set->frames = (struct cyapa_regs *)malloc((set->count + 1) * sizeof(*set->frames));
+	set->times = (uint32_t *)malloc((set->count + 1) * sizeof(*set->times));
+	if (!set->frames || !set->times)
+		exit(1);
+
+	capture_frames((const uint8_t *)data, (uint32_t)length, set->frames, set->times, set->count);
+	free(data);
+	return true;
+}
+
+#endif
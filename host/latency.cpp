@@ -0,0 +1,173 @@
+//
+// Frame to report latency of the two ways the driver can run the gesture
+// engine, over the frames of touch captures:
+//
+//   interrupt  every frame goes through TrackpadRawInput as soon as it is
+//              read, so the latency is the time the engine takes
+//   timer      the interrupt only keeps the latest frame and the periodic
+//              timer runs it through the engine, so a frame also waits for
+//              the next tick, and frames that arrive between two ticks are
+//              only seen as the last of them
+//
+// Only reports made by a new frame count, the ones made by timeouts on a
+// quiet pad have no frame to be late for. Timer latencies are taken over
+// every tick phase against the capture timestamps, which are in ms.
+//
+// cyapa_latency <capture>...
+//
+
+#include <algorithm>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "gesture.h"
+#include "hostio.h"
+
+//
+// CYAPA_TIMER_PERIOD_MS in sys/internal.h
+//
+#define TIMER_PERIOD_MS 10
+
+static unsigned long reports;
+
+static void latency_mouse(void *context, uint8_t buttons, uint8_t x, uint8_t y,
+	uint8_t wheel, uint8_t hwheel) {
+	(void)context; (void)buttons; (void)x; (void)y; (void)wheel; (void)hwheel;
+	reports++;
+}
+
+static void latency_keyboard(void *context, uint8_t shiftKeys, uint8_t *keyCodes) {
+	(void)context; (void)shiftKeys; (void)keyCodes;
+	reports++;
+}
+
+static void latency_scroll(void *context, uint8_t flag, uint16_t x1, uint16_t y1,
+	uint16_t x2, uint16_t y2) {
+	(void)context; (void)flag; (void)x1; (void)y1; (void)x2; (void)y2;
+	reports++;
+}
+
+static struct csgesture_sink sink = { NULL, latency_mouse, latency_keyboard, latency_scroll };
+static struct csgesture_softc sc;
+
+static double nowns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static void resetengine(void) {
+	memset(&sc, 0, sizeof(sc));
+	SetDefaultSettings(&sc.settings);
+}
+
+//
+// Runs one frame, returning the ns it took if it made a report, -1 if not
+//
+static double runframe(struct cyapa_regs *frame, uint32_t timems) {
+	unsigned long before = reports;
+	double start = nowns();
+
+	TrackpadRawInput(&sink, &sc, frame, timems);
+
+	double elapsed = nowns() - start;
+	return reports != before ? elapsed : -1;
+}
+
+static void interruptlatency(struct capture_frameset *set, std::vector<double> *latencies) {
+	resetengine();
+
+	for (int i = 0; i < set->count; i++) {
+		double elapsed = runframe(&set->frames[i], set->times[i]);
+
+		if (elapsed >= 0)
+			latencies->push_back(elapsed);
+	}
+}
+
+static void timerlatency(struct capture_frameset *set, std::vector<double> *latencies, int *skipped) {
+	*skipped = 0;
+	if (!set->count)
+		return;
+
+	for (uint32_t phase = 0; phase < TIMER_PERIOD_MS; phase++) {
+		uint32_t tick = set->times[0] - set->times[0] % TIMER_PERIOD_MS + phase;
+		int next = 0;
+
+		resetengine();
+
+		for (; next < set->count; tick += TIMER_PERIOD_MS) {
+			int first = next;
+			int latest = -1;
+
+			while (next < set->count && set->times[next] <= tick)
+				latest = next++;
+
+			if (latest < 0)
+				continue;
+
+			//
+			// Frames overwritten by a later one before the tick never
+			// reach the engine
+			//
+			*skipped += latest - first;
+
+			double elapsed = runframe(&set->frames[latest], tick);
+			if (elapsed >= 0)
+				latencies->push_back((tick - set->times[latest]) * 1e6 + elapsed);
+		}
+	}
+}
+
+static double percentile(std::vector<double> &latencies, int p) {
+	if (latencies.empty())
+		return 0;
+	size_t index = (latencies.size() - 1) * p / 100;
+	return latencies[index];
+}
+
+//
+// runs is how many times the frames went through the engine, the report
+// count is per run
+//
+static void print(const char *name, const char *mode, std::vector<double> &latencies,
+	int runs, double skipped) {
+	std::sort(latencies.begin(), latencies.end());
+
+	printf("%-12s %-9s %7zu reports  p50 %8.2f us  p90 %8.2f us  p99 %8.2f us  max %8.2f us"
+		"  %5.1f%% frames unseen\n",
+		name, mode, latencies.size() / runs, percentile(latencies, 50) / 1000,
+		percentile(latencies, 90) / 1000, percentile(latencies, 99) / 1000,
+		latencies.empty() ? 0.0 : latencies.back() / 1000, skipped * 100);
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: cyapa_latency <capture>...\n");
+		return 2;
+	}
+
+	for (int arg = 1; arg < argc; arg++) {
+		struct capture_frameset set;
+		std::vector<double> latencies;
+		int skipped;
+		const char *name = strrchr(argv[arg], '/') ? strrchr(argv[arg], '/') + 1 : argv[arg];
+
+		if (!readframes(argv[arg], &set))
+			return 2;
+
+		interruptlatency(&set, &latencies);
+		print(name, "interrupt", latencies, 1, 0);
+
+		latencies.clear();
+		timerlatency(&set, &latencies, &skipped);
+		print(name, "timer", latencies, TIMER_PERIOD_MS,
+			set.count ? (double)skipped / ((double)set.count * TIMER_PERIOD_MS) : 0);
+
+		free(set.frames);
+		free(set.times);
+	}
+
+	return 0;
+}
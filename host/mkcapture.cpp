@@ -0,0 +1,61 @@
+//
+// Writes the frames of a synthetic script out as a touch capture, in the
+// same format the driver hands out through REPORTID_CAPTURE, so it can be
+// replayed with cyapa_replay.
+//
+// cyapa_mkcapture <preset> <duration ms> <capture>
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "capture.h"
+#include "synth.h"
+
+static struct capture_ring ring;
+
+static bool flush(FILE *file) {
+	uint8_t buffer[256];
+	uint32_t length;
+
+	while ((length = capture_read(&ring, buffer, sizeof(buffer))) != 0) {
+		if (fwrite(buffer, 1, length, file) != length)
+			return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	struct synth_script script;
+	struct synth_state state;
+	struct cyapa_regs regs;
+	uint32_t timems;
+
+	if (argc != 4) {
+		fprintf(stderr, "usage: cyapa_mkcapture <preset> <duration ms> <capture>\n");
+		return 2;
+	}
+
+	if (!synth_preset(&script, atoi(argv[1]), (uint32_t)strtoul(argv[2], NULL, 0))) {
+		fprintf(stderr, "%s: no such preset\n", argv[1]);
+		return 2;
+	}
+
+	FILE *file = fopen(argv[3], "wb");
+	if (!file) {
+		fprintf(stderr, "%s: cannot write\n", argv[3]);
+		return 2;
+	}
+
+	synth_init(&state, &script);
+	capture_start(&ring, 0);
+	while (synth_next(&state, &regs, &timems)) {
+		capture_frame(&ring, timems, &regs);
+		if (!flush(file))
+			return 1;
+	}
+
+	if (!flush(file) || fclose(file))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,352 @@
+//
+// Framework calls made by sys/spb.cpp, backed by the mock bus
+//
+
+#include <mutex>
+
+#include "mockspb.h"
+
+struct mockspb_bus mockspb;
+
+//
+// Every handle points at one of these, WdfObjectDelete deletes it
+//
+struct mock_object {
+	virtual ~mock_object() {}
+};
+
+struct mock_memory : mock_object {
+	UCHAR *data;
+	size_t size;
+
+	~mock_memory() { delete[] data; }
+};
+
+struct mock_waitlock : mock_object {
+	std::mutex lock;
+};
+
+struct mock_target : mock_object {
+};
+
+struct mock_request : mock_object {
+	EVT_WDF_REQUEST_COMPLETION_ROUTINE *routine;
+	WDFCONTEXT context;
+	WDFIOTARGET target;
+	WDFMEMORY memory;
+	WDFMEMORY_OFFSET offset;
+	NTSTATUS status;
+	ULONG_PTR information;
+};
+
+//
+// The controller runs one transfer at a time
+//
+static std::mutex buslock;
+static mock_request *heldrequest;
+
+template <typename T, typename H> static T *object(H handle) {
+	return static_cast<T *>(reinterpret_cast<mock_object *>(handle));
+}
+
+template <typename H> static H handle(mock_object *object) {
+	return reinterpret_cast<H>(object);
+}
+
+void mockspb_reset(bool sequences) {
+	memset(&mockspb, 0, sizeof(mockspb));
+	mockspb.sequences = sequences;
+	heldrequest = NULL;
+}
+
+static void buscount(size_t length) {
+	InterlockedIncrement(&mockspb.transfers);
+	InterlockedExchangeAdd64(&mockspb.bytes, length);
+}
+
+//
+// Bus side of a single write: the first byte sets the address pointer,
+// the rest go to the registers from there
+//
+static void buswrite(const UCHAR *data, size_t length) {
+	if (length) {
+		mockspb.pointer = data[0];
+		for (size_t i = 1; i < length; i++)
+			mockspb.registers[mockspb.pointer++] = data[i];
+	}
+}
+
+static void busread(UCHAR *data, size_t length) {
+	for (size_t i = 0; i < length; i++)
+		data[i] = mockspb.registers[mockspb.pointer++];
+}
+
+static NTSTATUS bussequence(const SPB_TRANSFER_LIST *list, ULONG_PTR *information) {
+	size_t length = 0;
+
+	if (!mockspb.sequences)
+		return STATUS_NOT_SUPPORTED;
+
+	std::lock_guard<std::mutex> guard(buslock);
+
+	for (ULONG i = 0; i < list->TransferCount; i++) {
+		const SPB_TRANSFER_LIST_ENTRY *entry = &list->Transfers[i];
+		UCHAR *buffer = (UCHAR *)entry->Buffer.Simple.Buffer;
+
+		if (entry->Direction == SpbTransferDirectionToDevice)
+			buswrite(buffer, entry->Buffer.Simple.BufferCb);
+		else
+			busread(buffer, entry->Buffer.Simple.BufferCb);
+		length += entry->Buffer.Simple.BufferCb;
+	}
+
+	buscount(length);
+	*information = length;
+	return STATUS_SUCCESS;
+}
+
+static UCHAR *descriptorbuffer(PWDF_MEMORY_DESCRIPTOR Descriptor, size_t *Length) {
+	if (Descriptor->Type == WdfMemoryDescriptorTypeBuffer) {
+		*Length = Descriptor->u.BufferType.Length;
+		return (UCHAR *)Descriptor->u.BufferType.Buffer;
+	}
+
+	mock_memory *memory = object<mock_memory>(Descriptor->u.HandleType.Memory);
+	*Length = memory->size;
+	return memory->data;
+}
+
+void WdfObjectDelete(PVOID Object) {
+	delete reinterpret_cast<mock_object *>(Object);
+}
+
+NTSTATUS WdfWaitLockCreate(PWDF_OBJECT_ATTRIBUTES Attributes, WDFWAITLOCK *Lock) {
+	(void)Attributes;
+	*Lock = handle<WDFWAITLOCK>(new mock_waitlock);
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfWaitLockAcquire(WDFWAITLOCK Lock, LONGLONG *Timeout) {
+	(void)Timeout;
+	object<mock_waitlock>(Lock)->lock.lock();
+	return STATUS_SUCCESS;
+}
+
+void WdfWaitLockRelease(WDFWAITLOCK Lock) {
+	object<mock_waitlock>(Lock)->lock.unlock();
+}
+
+NTSTATUS WdfMemoryCreate(PWDF_OBJECT_ATTRIBUTES Attributes, POOL_TYPE PoolType, ULONG PoolTag,
+	size_t BufferSize, WDFMEMORY *Memory, PVOID *Buffer) {
+	mock_memory *memory = new mock_memory;
+
+	(void)Attributes;
+	(void)PoolType;
+	(void)PoolTag;
+
+	memory->data = new UCHAR[BufferSize]();
+	memory->size = BufferSize;
+
+	*Memory = handle<WDFMEMORY>(memory);
+	if (Buffer)
+		*Buffer = memory->data;
+	return STATUS_SUCCESS;
+}
+
+PVOID WdfMemoryGetBuffer(WDFMEMORY Memory, size_t *BufferSize) {
+	mock_memory *memory = object<mock_memory>(Memory);
+
+	if (BufferSize)
+		*BufferSize = memory->size;
+	return memory->data;
+}
+
+NTSTATUS WdfIoTargetCreate(WDFDEVICE Device, PWDF_OBJECT_ATTRIBUTES Attributes, WDFIOTARGET *Target) {
+	(void)Device;
+	(void)Attributes;
+	*Target = handle<WDFIOTARGET>(new mock_target);
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfIoTargetOpen(WDFIOTARGET Target, WDF_IO_TARGET_OPEN_PARAMS *Params) {
+	(void)Target;
+	(void)Params;
+	return STATUS_SUCCESS;
+}
+
+void WdfIoTargetStop(WDFIOTARGET Target, WDF_IO_TARGET_SENT_IO_ACTION Action) {
+	if (heldrequest && heldrequest->target == Target && Action == WdfIoTargetCancelSentIo)
+		WdfRequestCancelSentRequest(handle<WDFREQUEST>(heldrequest));
+}
+
+NTSTATUS WdfIoTargetSendWriteSynchronously(WDFIOTARGET Target, WDFREQUEST Request,
+	PWDF_MEMORY_DESCRIPTOR InputBuffer, LONGLONG *DeviceOffset, PVOID Options,
+	ULONG_PTR *BytesWritten) {
+	size_t length;
+	UCHAR *buffer = descriptorbuffer(InputBuffer, &length);
+
+	(void)Target;
+	(void)Request;
+	(void)DeviceOffset;
+	(void)Options;
+
+	std::lock_guard<std::mutex> guard(buslock);
+	buswrite(buffer, length);
+	buscount(length);
+	if (BytesWritten)
+		*BytesWritten = length;
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfIoTargetSendReadSynchronously(WDFIOTARGET Target, WDFREQUEST Request,
+	PWDF_MEMORY_DESCRIPTOR OutputBuffer, LONGLONG *DeviceOffset, PVOID Options,
+	ULONG_PTR *BytesRead) {
+	size_t length;
+	UCHAR *buffer = descriptorbuffer(OutputBuffer, &length);
+
+	(void)Target;
+	(void)Request;
+	(void)DeviceOffset;
+	(void)Options;
+
+	std::lock_guard<std::mutex> guard(buslock);
+	busread(buffer, length);
+	buscount(length);
+	if (BytesRead)
+		*BytesRead = length;
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfIoTargetSendIoctlSynchronously(WDFIOTARGET Target, WDFREQUEST Request, ULONG IoctlCode,
+	PWDF_MEMORY_DESCRIPTOR InputBuffer, PWDF_MEMORY_DESCRIPTOR OutputBuffer, PVOID Options,
+	ULONG_PTR *BytesReturned) {
+	size_t length;
+	UCHAR *buffer = descriptorbuffer(InputBuffer, &length);
+	ULONG_PTR information = 0;
+
+	(void)Target;
+	(void)Request;
+	(void)OutputBuffer;
+	(void)Options;
+
+	if (IoctlCode != IOCTL_SPB_EXECUTE_SEQUENCE)
+		return STATUS_INVALID_DEVICE_REQUEST;
+
+	NTSTATUS status = bussequence((const SPB_TRANSFER_LIST *)buffer, &information);
+	if (BytesReturned)
+		*BytesReturned = information;
+	return status;
+}
+
+NTSTATUS WdfRequestCreate(PWDF_OBJECT_ATTRIBUTES Attributes, WDFIOTARGET Target, WDFREQUEST *Request) {
+	mock_request *request = new mock_request();
+
+	(void)Attributes;
+	request->target = Target;
+	*Request = handle<WDFREQUEST>(request);
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestReuse(WDFREQUEST Request, WDF_REQUEST_REUSE_PARAMS *Params) {
+	mock_request *request = object<mock_request>(Request);
+
+	if (request == heldrequest)
+		return STATUS_INVALID_DEVICE_REQUEST;
+
+	request->routine = NULL;
+	request->memory = NULL;
+	request->status = Params->Status;
+	request->information = 0;
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfIoTargetFormatRequestForIoctl(WDFIOTARGET Target, WDFREQUEST Request, ULONG IoctlCode,
+	WDFMEMORY InputBuffer, PWDFMEMORY_OFFSET InputBufferOffset,
+	WDFMEMORY OutputBuffer, PWDFMEMORY_OFFSET OutputBufferOffset) {
+	mock_request *request = object<mock_request>(Request);
+
+	(void)OutputBuffer;
+	(void)OutputBufferOffset;
+
+	if (IoctlCode != IOCTL_SPB_EXECUTE_SEQUENCE)
+		return STATUS_INVALID_DEVICE_REQUEST;
+
+	request->target = Target;
+	request->memory = InputBuffer;
+	request->offset = *InputBufferOffset;
+	return STATUS_SUCCESS;
+}
+
+void WdfRequestSetCompletionRoutine(WDFREQUEST Request,
+	EVT_WDF_REQUEST_COMPLETION_ROUTINE *Routine, WDFCONTEXT Context) {
+	mock_request *request = object<mock_request>(Request);
+
+	request->routine = Routine;
+	request->context = Context;
+}
+
+static void complete(mock_request *request, NTSTATUS status, ULONG_PTR information) {
+	WDF_REQUEST_COMPLETION_PARAMS params;
+
+	memset(&params, 0, sizeof(params));
+	params.Size = sizeof(params);
+	params.IoStatus.Status = request->status = status;
+	params.IoStatus.Information = request->information = information;
+
+	if (request->routine)
+		request->routine(handle<WDFREQUEST>(request), request->target, &params, request->context);
+}
+
+static void run(mock_request *request) {
+	mock_memory *memory = object<mock_memory>(request->memory);
+	ULONG_PTR information = 0;
+
+	NTSTATUS status = bussequence(
+		(const SPB_TRANSFER_LIST *)(memory->data + request->offset.BufferOffset), &information);
+	complete(request, status, information);
+}
+
+BOOLEAN WdfRequestSend(WDFREQUEST Request, WDFIOTARGET Target, PVOID Options) {
+	mock_request *request = object<mock_request>(Request);
+
+	(void)Options;
+
+	if (!request->memory || Target != request->target) {
+		request->status = STATUS_INVALID_DEVICE_REQUEST;
+		return FALSE;
+	}
+
+	if (mockspb.holdreads) {
+		heldrequest = request;
+		return TRUE;
+	}
+
+	run(request);
+	return TRUE;
+}
+
+NTSTATUS WdfRequestGetStatus(WDFREQUEST Request) {
+	return object<mock_request>(Request)->status;
+}
+
+BOOLEAN WdfRequestCancelSentRequest(WDFREQUEST Request) {
+	mock_request *request = object<mock_request>(Request);
+
+	if (request != heldrequest)
+		return FALSE;
+
+	heldrequest = NULL;
+	complete(request, STATUS_CANCELLED, 0);
+	return TRUE;
+}
+
+bool mockspb_complete(void) {
+	mock_request *request = heldrequest;
+
+	if (!request)
+		return false;
+
+	heldrequest = NULL;
+	run(request);
+	return true;
+}
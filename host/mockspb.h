@@ -0,0 +1,37 @@
+//
+// Mock Spb I/O target for host builds of sys/spb.cpp. Transfers go to a
+// 256 byte register file behind an address pointer, the way the trackpad
+// looks on the bus, and the bus keeps its own count of what it saw.
+//
+
+#pragma once
+
+#include <wdf.h>
+
+struct mockspb_bus {
+	UCHAR registers[256];
+	UCHAR pointer;
+
+	//
+	// Whether the controller takes IOCTL_SPB_EXECUTE_SEQUENCE, and whether
+	// asynchronous reads stay pending until mockspb_complete
+	//
+	bool sequences;
+	bool holdreads;
+
+	//
+	// Requests that reached the bus and the bytes they moved
+	//
+	volatile LONG transfers;
+	volatile LONG64 bytes;
+};
+
+extern struct mockspb_bus mockspb;
+
+void mockspb_reset(bool sequences);
+
+//
+// Runs the asynchronous read being held and completes it, false if
+// there is none
+//
+bool mockspb_complete(void);
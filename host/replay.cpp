@@ -0,0 +1,175 @@
+//
+// Replays a touch capture through the gesture engine and checks the
+// reports it makes against an expected report stream, one report per
+// line. Exits with 1 at the first line that differs.
+//
+// cyapa_replay <capture> <expected>
+// cyapa_replay --update <capture> <expected>	rewrites expected instead
+// cyapa_replay --wheel ...	scrolls with wheel counts and flings
+//
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+#include "hostio.h"
+
+struct replay_output {
+	struct csgesture_softc *sc;
+	char *text;
+	size_t length;
+	size_t size;
+};
+
+static void replay_printf(struct replay_output *output, const char *format, ...)
+	__attribute__((format(printf, 2, 3)));
+
+static void replay_printf(struct replay_output *output, const char *format, ...) {
+	va_list args;
+
+	for (;;) {
+		size_t room = output->size - output->length;
+
+		va_start(args, format);
+		int needed = vsnprintf(output->text + output->length, room, format, args);
+		va_end(args);
+
+		if (needed < 0)
+			exit(1);
+		if ((size_t)needed < room) {
+			output->length += needed;
+			return;
+		}
+
+		output->size = output->size * 2 + needed + 1;
+		output->text = (char *)realloc(output->text, output->size);
+		if (!output->text)
+			exit(1);
+	}
+}
+
+static void replay_mouse(void *context, uint8_t buttons, uint8_t x, uint8_t y,
+	uint8_t wheel, uint8_t hwheel) {
+	struct replay_output *output = (struct replay_output *)context;
+
+	replay_printf(output, "%u mouse buttons=%02x x=%d y=%d wheel=%d hwheel=%d\n",
+		output->sc->frametime, buttons, (int8_t)x, (int8_t)y, (int8_t)wheel, (int8_t)hwheel);
+}
+
+static void replay_keyboard(void *context, uint8_t shiftKeys, uint8_t *keyCodes) {
+	struct replay_output *output = (struct replay_output *)context;
+
+	replay_printf(output, "%u keyboard shift=%02x keys=%02x %02x %02x %02x %02x %02x\n",
+		output->sc->frametime, shiftKeys, keyCodes[0], keyCodes[1], keyCodes[2],
+		keyCodes[3], keyCodes[4], keyCodes[5]);
+}
+
+static void replay_scroll(void *context, uint8_t flag, uint16_t x1, uint16_t y1,
+	uint16_t x2, uint16_t y2) {
+	struct replay_output *output = (struct replay_output *)context;
+
+	replay_printf(output, "%u scroll flag=%u %u,%u %u,%u\n",
+		output->sc->frametime, flag, x1, y1, x2, y2);
+}
+
+//
+// Reports the first line where the two streams part ways, 0 if none
+//
+static int firstdifference(const char *expected, const char *actual) {
+	int line = 1;
+
+	for (;; expected++, actual++) {
+		if (*expected != *actual)
+			return line;
+		if (!*expected)
+			return 0;
+		if (*expected == '\n')
+			line++;
+	}
+}
+
+static void printline(const char *label, const char *text, int line) {
+	for (int i = 1; i < line && *text; text++) {
+		if (*text == '\n')
+			i++;
+	}
+
+	const char *end = strchr(text, '\n');
+	int length = end ? (int)(end - text) : (int)strlen(text);
+
+	fprintf(stderr, "  %s: %.*s\n", label, length, length ? text : "<end of stream>");
+}
+
+static struct csgesture_softc sc;
+
+int main(int argc, char **argv) {
+	bool update = false;
+	bool wheel = false;
+
+	for (; argc > 1 && !strncmp(argv[1], "--", 2); argc--, argv++) {
+		if (!strcmp(argv[1], "--update"))
+			update = true;
+		else if (!strcmp(argv[1], "--wheel"))
+			wheel = true;
+		else
+			break;
+	}
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: cyapa_replay [--update] [--wheel] <capture> <expected>\n");
+		return 2;
+	}
+
+	size_t capturelength;
+	char *capture = readfile(argv[1], &capturelength);
+	if (!capture) {
+		fprintf(stderr, "%s: cannot read\n", argv[1]);
+		return 2;
+	}
+
+	struct replay_output output = { &sc, NULL, 0, 0 };
+	struct csgesture_sink sink = { &output, replay_mouse, replay_keyboard, replay_scroll };
+
+	memset(&sc, 0, sizeof(sc));
+	SetDefaultSettings(&sc.settings);
+	if (wheel)
+		ApplySetting(&sc.settings, 21, ScrollModeWheel);
+
+	replay_printf(&output, "%s", "");
+	int frames = capture_replay((const uint8_t *)capture, (uint32_t)capturelength, &sc, &sink, NULL);
+	if (frames < 0) {
+		fprintf(stderr, "%s: truncated or unsupported capture\n", argv[1]);
+		return 2;
+	}
+
+	if (update) {
+		FILE *file = fopen(argv[2], "wb");
+
+		if (!file || fwrite(output.text, 1, output.length, file) != output.length || fclose(file)) {
+			fprintf(stderr, "%s: cannot write\n", argv[2]);
+			return 2;
+		}
+		printf("%s: %d frames\n", argv[2], frames);
+		return 0;
+	}
+
+	size_t expectedlength;
+	char *expected = readfile(argv[2], &expectedlength);
+	if (!expected) {
+		fprintf(stderr, "%s: cannot read\n", argv[2]);
+		return 2;
+	}
+
+	int line = firstdifference(expected, output.text);
+	if (line) {
+		fprintf(stderr, "%s: reports differ from %s at line %d\n", argv[1], argv[2], line);
+		printline("expected", expected, line);
+		printline("replayed", output.text, line);
+		return 1;
+	}
+
+	printf("%s: %d frames match\n", argv[1], frames);
+	return 0;
+}
@@ -0,0 +1,146 @@
+//
+// Settings registers: the defaults, the field each settings report
+// register sets, and the engine structure layout the report path and
+// the motion history depend on
+//
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "gesture.h"
+
+struct registerfield {
+	int settingRegister;
+	int settingValue;
+	size_t offset;
+	size_t size;
+};
+
+#define FIELD(reg, value, field)											\
+	{ reg, value, offsetof(struct csgesture_settings, field),			\
+		sizeof(((struct csgesture_settings *)0)->field) }
+
+//
+// Each value differs from the default so a register that lands on the
+// wrong field shows up as a change outside the expected one
+//
+static const struct registerfield registerfields[] = {
+	FIELD(0, 25, pointerMultiplier),
+	FIELD(1, 1, swapLeftRightFingers),
+	FIELD(2, 0, clickWithNoFingers),
+	FIELD(3, 0, multiFingerClick),
+	FIELD(4, 1, rightClickBottomRight),
+	FIELD(5, 0, tapToClickEnabled),
+	FIELD(6, 0, multiFingerTap),
+	FIELD(7, 0, tapDragEnabled),
+	FIELD(8, ThreeFingerTapActionWheelClick, threeFingerTapAction),
+	FIELD(9, 0, fourFingerTapEnabled),
+	FIELD(10, 0, scrollEnabled),
+	FIELD(11, SwipeUpGestureNone, threeFingerSwipeUpGesture),
+	FIELD(12, SwipeDownGestureNone, threeFingerSwipeDownGesture),
+	FIELD(13, SwipeGestureNone, threeFingerSwipeLeftRightGesture),
+	FIELD(14, SwipeUpGestureNone, fourFingerSwipeUpGesture),
+	FIELD(15, SwipeDownGestureNone, fourFingerSwipeDownGesture),
+	FIELD(16, SwipeGestureNone, fourFingerSwipeLeftRightGesture),
+	FIELD(21, ScrollModeWheel, scrollMode),
+	FIELD(22, 0, scrollFriction),
+};
+
+//
+// Registers the driver handles itself (17-20, 23, 255) or does not know
+//
+static const int otherregisters[] = { 17, 18, 19, 20, 23, 254, 255, -1 };
+
+static void checkdefaults(void) {
+	struct csgesture_settings settings;
+
+	memset(&settings, 0xA5, sizeof(settings));
+	SetDefaultSettings(&settings);
+
+	CHECK(settings.pointerMultiplier == 10);
+	CHECK(!settings.swapLeftRightFingers);
+	CHECK(settings.clickWithNoFingers);
+	CHECK(settings.multiFingerClick);
+	CHECK(!settings.rightClickBottomRight);
+	CHECK(settings.tapToClickEnabled);
+	CHECK(settings.multiFingerTap);
+	CHECK(settings.tapDragEnabled);
+	CHECK(settings.threeFingerTapAction == ThreeFingerTapActionCortana);
+	CHECK(settings.fourFingerTapEnabled);
+	CHECK(settings.scrollEnabled);
+	CHECK(settings.scrollMode == ScrollModeHelper);
+	CHECK(settings.scrollFriction == 950);
+	CHECK(settings.threeFingerSwipeUpGesture == SwipeUpGestureTaskView);
+	CHECK(settings.threeFingerSwipeDownGesture == SwipeDownGestureShowDesktop);
+	CHECK(settings.threeFingerSwipeLeftRightGesture == SwipeGestureAltTabSwitcher);
+	CHECK(settings.fourFingerSwipeUpGesture == SwipeUpGestureTaskView);
+	CHECK(settings.fourFingerSwipeDownGesture == SwipeDownGestureShowDesktop);
+	CHECK(settings.fourFingerSwipeLeftRightGesture == SwipeGestureSwitchWorkspace);
+}
+
+static void checkregisters(void) {
+	for (size_t i = 0; i < sizeof(registerfields) / sizeof(registerfields[0]); i++) {
+		const struct registerfield *entry = &registerfields[i];
+		struct csgesture_settings before, after;
+
+		memset(&before, 0, sizeof(before));
+		SetDefaultSettings(&before);
+		memcpy(&after, &before, sizeof(after));
+
+		CHECK(ApplySetting(&after, entry->settingRegister, entry->settingValue));
+
+		const unsigned char *a = (const unsigned char *)&after;
+		const unsigned char *b = (const unsigned char *)&before;
+
+		//nothing outside the register's field moves
+		CHECK(memcmp(a, b, entry->offset) == 0);
+		CHECK(memcmp(a + entry->offset + entry->size, b + entry->offset + entry->size,
+			sizeof(after) - entry->offset - entry->size) == 0);
+
+		if (entry->size == sizeof(bool)) {
+			bool value;
+			memcpy(&value, a + entry->offset, sizeof(value));
+			CHECK(value == (entry->settingValue != 0));
+		}
+		else {
+			int value;
+			CHECK(entry->size == sizeof(int));
+			memcpy(&value, a + entry->offset, sizeof(value));
+			CHECK(value == entry->settingValue);
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(otherregisters) / sizeof(otherregisters[0]); i++) {
+		struct csgesture_settings before, after;
+
+		memset(&before, 0, sizeof(before));
+		SetDefaultSettings(&before);
+		memcpy(&after, &before, sizeof(after));
+
+		CHECK(!ApplySetting(&after, otherregisters[i], 1));
+		CHECK(memcmp(&after, &before, sizeof(after)) == 0);
+	}
+}
+
+//
+// The softc leads with the contact slots and a contact fills half a cache
+// line, so a frame's contact scan touches as few lines as possible
+//
+static void checklayout(void) {
+	CHECK(sizeof(struct csgesture_contact) == 32);
+	CHECK(offsetof(struct csgesture_softc, contacts) == 0);
+	CHECK(sizeof(struct csgesture_history) ==
+		2 * CSGESTURE_HISTORY_FRAMES * sizeof(uint16_t));
+	CHECK(sizeof(((struct csgesture_softc *)0)->history) ==
+		15 * sizeof(struct csgesture_history));
+}
+
+int main(void) {
+	checkdefaults();
+	checkregisters();
+	checklayout();
+
+	return CHECK_RESULT();
+}
@@ -0,0 +1,209 @@
+//
+// sys/spb.cpp against the mock Spb I/O target: what gets read and
+// written, the fallback for controllers without sequences, asynchronous
+// reads, and the transfer counters with the synchronous and asynchronous
+// paths running at once
+//
+
+#include <atomic>
+#include <thread>
+
+#include "check.h"
+#include "mockspb.h"
+#include "spb.h"
+
+struct readresult {
+	int completions;
+	NTSTATUS status;
+	ULONG length;
+	UCHAR data[DEFAULT_SPB_BUFFER_SIZE];
+};
+
+static void readcompletion(PVOID Context, NTSTATUS Status, PVOID Data, ULONG Length) {
+	struct readresult *result = (struct readresult *)Context;
+
+	result->completions++;
+	result->status = Status;
+	result->length = Length;
+	memcpy(result->data, Data, Length);
+}
+
+static void setup(SPB_CONTEXT *spb, bool sequences) {
+	mockspb_reset(sequences);
+	for (int i = 0; i < 256; i++)
+		mockspb.registers[i] = (UCHAR)(i ^ 0x5a);
+
+	memset(spb, 0, sizeof(*spb));
+	CHECK(NT_SUCCESS(SpbTargetInitialize(NULL, spb)));
+	CHECK(spb->AsyncRequest != NULL);
+}
+
+static void teardown(SPB_CONTEXT *spb) {
+	SpbTargetDeinitialize(NULL, spb);
+	WdfObjectDelete(spb->SpbIoTarget);
+}
+
+static bool matches(const UCHAR *data, int address, int length) {
+	for (int i = 0; i < length; i++) {
+		if (data[i] != mockspb.registers[(address + i) & 0xff])
+			return false;
+	}
+	return true;
+}
+
+static void test_sequence_read(void) {
+	SPB_CONTEXT spb;
+	UCHAR data[16];
+
+	setup(&spb, true);
+
+	CHECK(NT_SUCCESS(SpbReadDataSynchronously(&spb, 0x10, data, sizeof(data))));
+	CHECK(matches(data, 0x10, sizeof(data)));
+	CHECK(!spb.SequenceUnsupported);
+	CHECK(spb.Transfers == 1 && spb.BytesTransferred == 1 + sizeof(data));
+	CHECK(mockspb.transfers == spb.Transfers && mockspb.bytes == spb.BytesTransferred);
+
+	teardown(&spb);
+}
+
+static void test_write(void) {
+	SPB_CONTEXT spb;
+	UCHAR data[3] = { 0x11, 0x22, 0x33 };
+	UCHAR large[100];
+
+	setup(&spb, true);
+
+	CHECK(NT_SUCCESS(SpbWriteDataSynchronously(&spb, 0x20, data, sizeof(data))));
+	CHECK(matches(data, 0x20, sizeof(data)));
+	CHECK(spb.Transfers == 1 && spb.BytesTransferred == 1 + sizeof(data));
+
+	//
+	// Too big for the preallocated buffer, goes through its own memory
+	//
+	for (int i = 0; i < (int)sizeof(large); i++)
+		large[i] = (UCHAR)i;
+	CHECK(NT_SUCCESS(SpbWriteDataSynchronously(&spb, 0x80, large, sizeof(large))));
+	CHECK(matches(large, 0x80, sizeof(large)));
+	CHECK(spb.Transfers == 2 && spb.BytesTransferred == 2 + sizeof(data) + sizeof(large));
+	CHECK(mockspb.transfers == spb.Transfers && mockspb.bytes == spb.BytesTransferred);
+
+	teardown(&spb);
+}
+
+static void test_fallback(void) {
+	SPB_CONTEXT spb;
+	UCHAR data[8];
+	UCHAR large[100];
+	struct readresult result;
+
+	setup(&spb, false);
+
+	//
+	// The rejected sequence is counted, it went out to the controller
+	//
+	CHECK(NT_SUCCESS(SpbReadDataSynchronously(&spb, 0x40, data, sizeof(data))));
+	CHECK(matches(data, 0x40, sizeof(data)));
+	CHECK(spb.SequenceUnsupported);
+	CHECK(spb.Transfers == 3 && spb.BytesTransferred == 2 * (1 + sizeof(data)));
+	CHECK(mockspb.transfers == 2 && mockspb.bytes == 1 + sizeof(data));
+
+	CHECK(NT_SUCCESS(SpbReadDataSynchronously(&spb, 0x48, data, sizeof(data))));
+	CHECK(matches(data, 0x48, sizeof(data)));
+	CHECK(spb.Transfers == 5 && mockspb.transfers == 4);
+
+	CHECK(NT_SUCCESS(SpbReadDataSynchronously(&spb, 0x00, large, sizeof(large))));
+	CHECK(matches(large, 0x00, sizeof(large)));
+	CHECK(spb.Transfers == 7 && mockspb.transfers == 6);
+
+	CHECK(SpbReadDataAsynchronously(&spb, 0x00, sizeof(data), readcompletion, &result) ==
+		STATUS_NOT_SUPPORTED);
+
+	teardown(&spb);
+}
+
+static void test_async(void) {
+	SPB_CONTEXT spb;
+	struct readresult result;
+
+	setup(&spb, true);
+	mockspb.holdreads = true;
+	memset(&result, 0, sizeof(result));
+
+	CHECK(SpbReadDataAsynchronously(&spb, 0x30, 16, readcompletion, &result) == STATUS_PENDING);
+	CHECK(SpbReadDataAsynchronously(&spb, 0x30, 16, readcompletion, &result) == STATUS_DEVICE_BUSY);
+	CHECK(result.completions == 0);
+
+	CHECK(mockspb_complete());
+	CHECK(result.completions == 1 && NT_SUCCESS(result.status) && result.length == 16);
+	CHECK(matches(result.data, 0x30, 16));
+	CHECK(spb.AsyncBusy == 0);
+
+	//
+	// Cancelled reads still complete, with nothing read
+	//
+	CHECK(SpbReadDataAsynchronously(&spb, 0x30, 16, readcompletion, &result) == STATUS_PENDING);
+	SpbCancelAsynchronousRead(&spb);
+	CHECK(result.completions == 2 && result.status == STATUS_CANCELLED && result.length == 0);
+	CHECK(spb.AsyncBusy == 0);
+	CHECK(!mockspb_complete());
+
+	SpbCancelAsynchronousRead(&spb);
+	CHECK(result.completions == 2);
+
+	//
+	// Stopping the target cancels whatever is still in flight
+	//
+	CHECK(SpbReadDataAsynchronously(&spb, 0x30, 16, readcompletion, &result) == STATUS_PENDING);
+	teardown(&spb);
+	CHECK(result.completions == 3 && result.status == STATUS_CANCELLED);
+}
+
+#define CONCURRENT_READS 1000000
+
+static std::atomic<bool> go;
+
+static void asyncreads(SPB_CONTEXT *spb, int *started) {
+	struct readresult result;
+
+	while (!go)
+		;
+	for (int i = 0; i < CONCURRENT_READS; i++) {
+		if (SpbReadDataAsynchronously(spb, 0x00, 8, readcompletion, &result) == STATUS_PENDING)
+			(*started)++;
+	}
+}
+
+static void test_concurrent_counters(void) {
+	SPB_CONTEXT spb;
+	UCHAR data[8];
+	int started = 0;
+
+	setup(&spb, true);
+
+	go = false;
+	std::thread reader(asyncreads, &spb, &started);
+	go = true;
+	for (int i = 0; i < CONCURRENT_READS; i++) {
+		if (i & 1)
+			SpbReadDataSynchronously(&spb, 0x00, data, sizeof(data));
+		else
+			SpbWriteDataSynchronously(&spb, 0x00, data, 1);
+	}
+	reader.join();
+
+	CHECK(started == CONCURRENT_READS);
+	CHECK(spb.Transfers == 2 * CONCURRENT_READS);
+	CHECK(spb.Transfers == mockspb.transfers);
+	CHECK(spb.BytesTransferred == mockspb.bytes);
+
+	teardown(&spb);
+}
+
+int main(void) {
+	test_sequence_read();
+	test_write();
+	test_fallback();
+	test_async();
+	test_concurrent_counters();
+	return CHECK_RESULT();
+}
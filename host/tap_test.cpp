@@ -0,0 +1,102 @@
+//
+// Tap to click against frame timing: a tap clicks on the frame its
+// finger lifts, and only that frame, even when the next frame carries
+// the same timestamp
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "gesture.h"
+
+static int clicks;
+
+static void tap_mouse(void *context, uint8_t buttons, uint8_t x, uint8_t y,
+	uint8_t wheel, uint8_t hwheel) {
+	static uint8_t lastbuttons;
+
+	(void)context;
+	(void)x;
+	(void)y;
+	(void)wheel;
+	(void)hwheel;
+	if (buttons && !lastbuttons)
+		clicks++;
+	lastbuttons = buttons;
+}
+
+static void tap_keyboard(void *context, uint8_t shiftKeys, uint8_t *keyCodes) {
+	(void)context;
+	(void)shiftKeys;
+	(void)keyCodes;
+}
+
+static void tap_scroll(void *context, uint8_t flag, uint16_t x1, uint16_t y1,
+	uint16_t x2, uint16_t y2) {
+	(void)context;
+	(void)flag;
+	(void)x1;
+	(void)y1;
+	(void)x2;
+	(void)y2;
+}
+
+static struct csgesture_sink sink = { NULL, tap_mouse, tap_keyboard, tap_scroll };
+
+static struct csgesture_softc sc;
+
+static void frame(int nfingers, int id, uint32_t timems) {
+	struct cyapa_regs regs;
+
+	memset(&regs, 0, sizeof(regs));
+	regs.stat = CYAPA_STAT_RUNNING;
+	regs.fngr = (uint8_t)(nfingers << 4);
+	if (nfingers) {
+		regs.touch[0].xy_high = (uint8_t)(((400 >> 4) & 0xF0) | ((300 >> 8) & 0x0F));
+		regs.touch[0].x_low = (uint8_t)400;
+		regs.touch[0].y_low = (uint8_t)300;
+		regs.touch[0].pressure = 40;
+		regs.touch[0].id = (uint8_t)id;
+	}
+	TrackpadRawInput(&sink, &sc, &regs, timems);
+}
+
+static void reset(void) {
+	memset(&sc, 0, sizeof(sc));
+	SetDefaultSettings(&sc.settings);
+	clicks = 0;
+}
+
+static void test_tap(void) {
+	reset();
+
+	frame(1, 1, 1000);
+	frame(1, 1, 1010);
+	frame(0, 0, 1020);
+	CHECK(clicks == 1);
+}
+
+//
+// A long press lifts without clicking. A finger landing on a frame
+// stamped the same millisecond as that lift is not a tap.
+//
+static void test_same_millisecond(void) {
+	reset();
+
+	for (uint32_t t = 1000; t <= 1300; t += 10)
+		frame(1, 1, t);
+	frame(0, 0, 1310);
+	CHECK(clicks == 0);
+
+	frame(1, 2, 1310);
+	frame(1, 2, 1310);
+	CHECK(clicks == 0);
+	CHECK(!sc.mouseDownDueToTap);
+}
+
+int main(void) {
+	test_tap();
+	test_same_millisecond();
+	return CHECK_RESULT();
+}
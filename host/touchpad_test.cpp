@@ -0,0 +1,318 @@
+//
+// Touchpad output mode: contact reports built from frames, lifted
+// contacts, the descriptor extent patch, and switching modes in the
+// middle of a gesture
+//
+
+#include <string.h>
+
+#include "check.h"
+#include "gesture.h"
+#include "touchpad.h"
+
+//
+// hidcommon.h only needs these two from the Windows headers
+//
+typedef uint8_t BYTE;
+typedef uint16_t USHORT;
+
+#include "hidcommon.h"
+
+static void setcontact(struct cyapa_regs *regs, int slot, int id, int x, int y) {
+	regs->touch[slot].xy_high = (uint8_t)(((x >> 4) & 0xF0) | ((y >> 8) & 0x0F));
+	regs->touch[slot].x_low = (uint8_t)x;
+	regs->touch[slot].y_low = (uint8_t)y;
+	regs->touch[slot].pressure = 40;
+	regs->touch[slot].id = (uint8_t)id;
+}
+
+static void setframe(struct cyapa_regs *regs, int nfingers, int firstid, bool button) {
+	memset(regs, 0, sizeof(*regs));
+	regs->stat = CYAPA_STAT_RUNNING;
+	regs->fngr = (uint8_t)((nfingers << 4) | (button ? CYAPA_FNGR_LEFT : 0));
+	for (int i = 0; i < nfingers; i++)
+		setcontact(regs, i, firstid + i, 100 + i * 200, 100 + i * 100);
+}
+
+static int countstatus(CyapaTouchpadReport *report, uint8_t status) {
+	int count = 0;
+
+	for (int i = 0; i < report->ContactCount; i++) {
+		if (report->Contacts[i].Status == status)
+			count++;
+	}
+	return count;
+}
+
+static void test_extent(struct csgesture_softc *sc) {
+	uint16_t maxx, maxy;
+
+	touchpad_extent(sc, &maxx, &maxy);
+	CHECK(maxx == 1000 && maxy == 700);
+
+	sc->infoSetup = true;
+	sc->resx = 1280;
+	sc->resy = 800;
+	sc->phyx = 105;
+	sc->phyy = 68;
+	touchpad_extent(sc, &maxx, &maxy);
+	CHECK(maxx == 1050 && maxy == 680);
+}
+
+static void test_report(struct csgesture_softc *sc) {
+	struct touchpad_state state;
+	struct cyapa_regs regs;
+	CyapaTouchpadReport report;
+
+	memset(&state, 0, sizeof(state));
+
+	//
+	// Two contacts and the button, scaled from sensor units to 0.1 mm
+	//
+	setframe(&regs, 2, 3, true);
+	setcontact(&regs, 0, 3, 1280, 800);
+	CHECK(touchpad_report(&state, sc, &regs, 10, &report));
+	CHECK(report.ReportID == REPORTID_TOUCHPAD);
+	CHECK(report.ContactCount == 2 && report.Button == 1 && report.ScanTime == 10);
+	CHECK(report.Contacts[0].ContactID == 3 && report.Contacts[0].XValue == 1050 &&
+		report.Contacts[0].YValue == 680);
+	CHECK(countstatus(&report, TOUCHPAD_CONTACT_CONFIDENCE | TOUCHPAD_CONTACT_TIP) == 2);
+
+	//
+	// The first contact lifts: reported once more, tip up, where it was
+	//
+	setframe(&regs, 1, 4, false);
+	setcontact(&regs, 0, 4, 300, 200);
+	CHECK(touchpad_report(&state, sc, &regs, 20, &report));
+	CHECK(report.ContactCount == 2 && report.Button == 0);
+	CHECK(report.Contacts[1].ContactID == 3 && report.Contacts[1].Status == TOUCHPAD_CONTACT_CONFIDENCE &&
+		report.Contacts[1].XValue == 1050);
+
+	setframe(&regs, 0, 0, false);
+	CHECK(touchpad_report(&state, sc, &regs, 30, &report));
+	CHECK(report.ContactCount == 1 && report.Contacts[0].ContactID == 4 &&
+		report.Contacts[0].Status == TOUCHPAD_CONTACT_CONFIDENCE);
+
+	//
+	// Nothing down, nothing lifted, button unchanged
+	//
+	CHECK(!touchpad_report(&state, sc, &regs, 40, &report));
+}
+
+static void test_pending_lifts(struct csgesture_softc *sc) {
+	struct touchpad_state state;
+	struct cyapa_regs regs;
+	CyapaTouchpadReport report;
+
+	memset(&state, 0, sizeof(state));
+
+	setframe(&regs, 3, 1, false);
+	CHECK(touchpad_report(&state, sc, &regs, 10, &report));
+	CHECK(report.ContactCount == 3);
+
+	//
+	// Three new contacts and three lifts do not fit in one report, the
+	// lift left over goes out with the next one
+	//
+	setframe(&regs, 3, 4, false);
+	CHECK(touchpad_report(&state, sc, &regs, 20, &report));
+	CHECK(report.ContactCount == TOUCHPAD_CONTACTS);
+	CHECK(countstatus(&report, TOUCHPAD_CONTACT_CONFIDENCE) == 2);
+	CHECK(state.liftmask == (1 << 3));
+
+	CHECK(touchpad_report(&state, sc, &regs, 30, &report));
+	CHECK(report.ContactCount == 4);
+	CHECK(countstatus(&report, TOUCHPAD_CONTACT_CONFIDENCE) == 1);
+	CHECK(report.Contacts[3].ContactID == 3);
+	CHECK(state.liftmask == 0);
+
+	CHECK(touchpad_report(&state, sc, &regs, 40, &report));
+	CHECK(report.ContactCount == 3 && countstatus(&report, TOUCHPAD_CONTACT_CONFIDENCE) == 0);
+}
+
+static void test_descriptor_patch(void) {
+	//
+	// Generic Desktop X with 2 byte maximums, then the same for a usage
+	// that must be left alone
+	//
+	uint8_t descriptor[] = {
+		0x05, 0x01,		/* USAGE_PAGE (Generic Desktop) */
+		0x26, 0xe8, 0x03,	/* LOGICAL_MAXIMUM (1000) */
+		0x46, 0xe8, 0x03,	/* PHYSICAL_MAXIMUM (1000) */
+		0x09, 0x30,		/* USAGE (X) */
+		0x81, 0x02,		/* INPUT (Data,Var,Abs) */
+		0x26, 0xbc, 0x02,	/* LOGICAL_MAXIMUM (700) */
+		0x46, 0xbc, 0x02,	/* PHYSICAL_MAXIMUM (700) */
+		0x09, 0x31,		/* USAGE (Y) */
+		0x81, 0x02,		/* INPUT (Data,Var,Abs) */
+		0x26, 0xff, 0x00,	/* LOGICAL_MAXIMUM (255) */
+		0x46, 0xff, 0x00,	/* PHYSICAL_MAXIMUM (255) */
+		0x09, 0x38,		/* USAGE (Wheel) */
+		0x81, 0x06,		/* INPUT (Data,Var,Rel) */
+	};
+
+	touchpad_patch_descriptor(descriptor, sizeof(descriptor), 1050, 680);
+	CHECK(descriptor[3] == 0x1a && descriptor[4] == 0x04);
+	CHECK(descriptor[6] == 0x1a && descriptor[7] == 0x04);
+	CHECK(descriptor[13] == 0xa8 && descriptor[14] == 0x02);
+	CHECK(descriptor[16] == 0xa8 && descriptor[17] == 0x02);
+	CHECK(descriptor[23] == 0xff && descriptor[24] == 0x00);
+	CHECK(descriptor[26] == 0xff && descriptor[27] == 0x00);
+}
+
+//
+// What the engine last told the host, as the mode switch tests see it
+//
+struct heldinput {
+	uint8_t buttons;
+	uint8_t shiftKeys;
+	uint8_t keyCode;
+	int mousereports;
+};
+
+static struct heldinput held;
+
+static void held_mouse(void *context, uint8_t buttons, uint8_t x, uint8_t y,
+	uint8_t wheel, uint8_t hwheel) {
+	(void)context;
+	(void)x;
+	(void)y;
+	(void)wheel;
+	(void)hwheel;
+	held.buttons = buttons;
+	held.mousereports++;
+}
+
+static void held_keyboard(void *context, uint8_t shiftKeys, uint8_t *keyCodes) {
+	(void)context;
+	held.shiftKeys = shiftKeys;
+	held.keyCode = keyCodes[0];
+}
+
+static void held_scroll(void *context, uint8_t flag, uint16_t x1, uint16_t y1,
+	uint16_t x2, uint16_t y2) {
+	(void)context;
+	(void)flag;
+	(void)x1;
+	(void)y1;
+	(void)x2;
+	(void)y2;
+}
+
+static struct csgesture_sink heldsink = { NULL, held_mouse, held_keyboard, held_scroll };
+
+//
+// Contacts spaced out along x, all at y and moved right by dx
+//
+static void moveframe(struct csgesture_softc *sc, int nfingers, int x, int dx, uint32_t timems) {
+	struct cyapa_regs regs;
+
+	setframe(&regs, nfingers, 1, false);
+	for (int i = 0; i < nfingers; i++)
+		setcontact(&regs, i, 1 + i, x + dx + i * 150, 300);
+	TrackpadRawInput(&heldsink, sc, &regs, timems);
+}
+
+//
+// What CyapaSetFeature does on a DeviceMode change, under GestureLock
+//
+static void switchmode(struct csgesture_softc *sc, struct touchpad_state *state) {
+	GestureReset(&heldsink, sc);
+	memset(state, 0, sizeof(*state));
+}
+
+static void test_switch_during_drag(struct csgesture_softc *sc) {
+	struct touchpad_state state;
+	struct cyapa_regs regs;
+	CyapaTouchpadReport report;
+	uint32_t timems = 1000;
+
+	memset(sc, 0, sizeof(*sc));
+	SetDefaultSettings(&sc->settings);
+	memset(&held, 0, sizeof(held));
+	memset(&state, 0, sizeof(state));
+
+	//
+	// Tap, then touch again and move: the tap holds the left button
+	// down for the drag
+	//
+	moveframe(sc, 1, 400, 0, timems += 10);
+	moveframe(sc, 1, 400, 0, timems += 10);
+	moveframe(sc, 0, 0, 0, timems += 10);
+	moveframe(sc, 0, 0, 0, timems += 10);
+	for (int i = 0; i < 10; i++)
+		moveframe(sc, 1, 400, i * 20, timems += 10);
+	CHECK(sc->mousedown && held.buttons == MOUSE_BUTTON_1);
+
+	//
+	// To touchpad mode mid drag: the button goes up right away
+	//
+	switchmode(sc, &state);
+	CHECK(held.buttons == 0);
+	CHECK(!sc->mousedown && !sc->mouseDownDueToTap && sc->buttonmask == 0);
+	CHECK(GestureIdle(sc));
+	CHECK(sc->settings.tapDragEnabled && sc->slotsready == false);
+
+	setframe(&regs, 1, 1, false);
+	CHECK(touchpad_report(&state, sc, &regs, timems += 10, &report));
+
+	//
+	// Back to mouse mode with the same finger still moving: pointer
+	// motion only, no button from the drag that went before
+	//
+	switchmode(sc, &state);
+	held.mousereports = 0;
+	for (int i = 10; i < 20; i++)
+		moveframe(sc, 1, 400, i * 20, timems += 10);
+	moveframe(sc, 0, 0, 0, timems += 10);
+	CHECK(held.mousereports > 0);
+	CHECK(held.buttons == 0);
+	CHECK(!sc->mousedown);
+}
+
+static void test_switch_during_alttab(struct csgesture_softc *sc) {
+	struct touchpad_state state;
+	uint32_t timems = 1000;
+
+	memset(sc, 0, sizeof(*sc));
+	SetDefaultSettings(&sc->settings);
+	memset(&held, 0, sizeof(held));
+	memset(&state, 0, sizeof(state));
+
+	//
+	// Three fingers swiping right open the switcher, which holds LALT
+	// until they lift
+	//
+	for (int i = 0; i < 15; i++)
+		moveframe(sc, 3, 200, i * 15, timems += 10);
+	CHECK(sc->alttabswitchershowing);
+	CHECK(held.shiftKeys == KBD_LALT_BIT);
+
+	switchmode(sc, &state);
+	CHECK(held.shiftKeys == 0 && held.keyCode == 0);
+	CHECK(held.buttons == 0);
+	CHECK(!sc->alttabswitchershowing && !sc->multitaskinggesturestarted);
+	CHECK(GestureIdle(sc));
+
+	//
+	// Back in mouse mode the fingers are still down: nothing presses
+	// LALT again
+	//
+	switchmode(sc, &state);
+	for (int i = 15; i < 20; i++)
+		moveframe(sc, 3, 200, i * 15, timems += 10);
+	CHECK(!sc->alttabswitchershowing);
+	CHECK(!(held.shiftKeys & KBD_LALT_BIT));
+}
+
+static struct csgesture_softc sc;
+
+int main(void) {
+	test_extent(&sc);
+	test_report(&sc);
+	test_pending_lifts(&sc);
+	test_descriptor_patch();
+	test_switch_during_drag(&sc);
+	test_switch_during_alttab(&sc);
+	return CHECK_RESULT();
+}
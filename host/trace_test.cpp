@@ -0,0 +1,122 @@
+//
+// Trace events: each softc raises them on its own sink, gesture events
+// only go out when the decision changes, and a sink's runtime mask
+// drops what it was not asked for
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "gesture.h"
+#include "tracesink.h"
+
+struct tracecount {
+	int gestures;
+	uint32_t lastdecision;
+};
+
+static void count_event(void *context, uint8_t id, uint32_t arg0, uint32_t arg1) {
+	struct tracecount *count = (struct tracecount *)context;
+
+	(void)arg1;
+	if (id == TRACE_EVENT_GESTURE) {
+		count->gestures++;
+		count->lastdecision = arg0;
+	}
+}
+
+static void ignore_mouse(void *context, uint8_t buttons, uint8_t x, uint8_t y,
+	uint8_t wheel, uint8_t hwheel) {
+	(void)context;
+	(void)buttons;
+	(void)x;
+	(void)y;
+	(void)wheel;
+	(void)hwheel;
+}
+
+static void ignore_keyboard(void *context, uint8_t shiftKeys, uint8_t *keyCodes) {
+	(void)context;
+	(void)shiftKeys;
+	(void)keyCodes;
+}
+
+static void ignore_scroll(void *context, uint8_t flag, uint16_t x1, uint16_t y1,
+	uint16_t x2, uint16_t y2) {
+	(void)context;
+	(void)flag;
+	(void)x1;
+	(void)y1;
+	(void)x2;
+	(void)y2;
+}
+
+static struct csgesture_sink sink = { NULL, ignore_mouse, ignore_keyboard, ignore_scroll };
+
+static void frame(struct csgesture_softc *sc, int nfingers, int x, uint32_t timems) {
+	struct cyapa_regs regs;
+
+	memset(&regs, 0, sizeof(regs));
+	regs.stat = CYAPA_STAT_RUNNING;
+	regs.fngr = (uint8_t)(nfingers << 4);
+	for (int i = 0; i < nfingers; i++) {
+		int cx = x + i * 200;
+
+		regs.touch[i].xy_high = (uint8_t)(((cx >> 4) & 0xF0) | ((300 >> 8) & 0x0F));
+		regs.touch[i].x_low = (uint8_t)cx;
+		regs.touch[i].y_low = (uint8_t)300;
+		regs.touch[i].pressure = 40;
+		regs.touch[i].id = (uint8_t)(i + 1);
+	}
+	TrackpadRawInput(&sink, sc, &regs, timems);
+}
+
+//
+// One finger moving for a while and lifting, on two engines at once
+//
+static void test_transitions(void) {
+	static struct csgesture_softc first, second;
+	struct tracecount firstcount = { 0, 0 }, secondcount = { 0, 0 };
+	struct trace_sink firsttrace = { &firstcount, count_event, 0xFFFFFFFF };
+	struct trace_sink secondtrace = { &secondcount, count_event, 0xFFFFFFFF };
+
+	SetDefaultSettings(&first.settings);
+	SetDefaultSettings(&second.settings);
+	first.trace = &firsttrace;
+	second.trace = &secondtrace;
+
+	uint32_t timems = 1000;
+	for (int i = 0; i < 30; i++) {
+		frame(&first, 1, 200 + i * 10, timems);
+		timems += 10;
+	}
+	for (int i = 0; i < 3; i++) {
+		frame(&first, 0, 0, timems);
+		timems += 10;
+	}
+
+	//
+	// Into pointer motion once and back out once, however many frames
+	// moved, and nothing on the other engine's sink
+	//
+	CHECK(firstcount.gestures == 2);
+	CHECK(firstcount.lastdecision == TRACE_GESTURE_NONE);
+	CHECK(secondcount.gestures == 0);
+
+	//
+	// A sink that switched gesture events off hears nothing
+	//
+	secondtrace.enabled = TRACE_EVENTS_TRANSITIONS & ~(1u << TRACE_EVENT_GESTURE);
+	timems = 1000;
+	for (int i = 0; i < 30; i++) {
+		frame(&second, 1, 200 + i * 10, timems);
+		timems += 10;
+	}
+	CHECK(secondcount.gestures == 0);
+}
+
+int main(void) {
+	test_transitions();
+	return CHECK_RESULT();
+}
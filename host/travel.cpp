@@ -0,0 +1,197 @@
+//
+// Pointer travel over replayed frames. Sums what one finger moved while it
+// was the only one on the pad and what the mouse reports moved the
+// cursor, runs the frames a few times for the time per frame, and fails
+// if the cursor did not go as far as the finger at the pointer speed
+// setting, to within one count.
+//
+// Finger travel starts once the contact is 50 ms old, when ProcessMove
+// starts panning. Besides the captures given, a synthetic fast swipe at a
+// high pointer speed checks moves too big for a single report.
+//
+// cyapa_travel <capture>...
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gesture.h"
+#include "hostio.h"
+#include "synth.h"
+
+#define TRAVEL_RUNS 5
+
+//
+// ProcessMove pans a contact only once it is this old
+//
+#define PAN_START_MS 50
+
+struct travel {
+	long fingerx, fingery;
+	long cursorx, cursory;
+	unsigned long reports;
+	unsigned long splits;
+	double best;
+};
+
+static void travel_mouse(void *context, uint8_t buttons, uint8_t x, uint8_t y,
+	uint8_t wheel, uint8_t hwheel) {
+	struct travel *travel = (struct travel *)context;
+
+	(void)buttons; (void)wheel; (void)hwheel;
+	travel->cursorx += (int8_t)x;
+	travel->cursory += (int8_t)y;
+	travel->reports++;
+
+	//
+	// A full report is part of a move that was split
+	//
+	if (abs((int8_t)x) == 127 || abs((int8_t)y) == 127)
+		travel->splits++;
+}
+
+static void travel_keyboard(void *context, uint8_t shiftKeys, uint8_t *keyCodes) {
+	(void)context; (void)shiftKeys; (void)keyCodes;
+}
+
+static void travel_scroll(void *context, uint8_t flag, uint16_t x1, uint16_t y1,
+	uint16_t x2, uint16_t y2) {
+	(void)context; (void)flag; (void)x1; (void)y1; (void)x2; (void)y2;
+}
+
+static double nowns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+//
+// What the finger moved, from the frames alone
+//
+static void fingertravel(struct capture_frameset *set, struct travel *travel) {
+	int lastid = -1, lastx = 0, lasty = 0;
+	uint32_t downtime = 0;
+
+	for (int i = 0; i < set->count; i++) {
+		struct cyapa_regs *regs = &set->frames[i];
+
+		if ((regs->stat & CYAPA_STAT_RUNNING) == 0 || CYAPA_FNGR_NUMFINGERS(regs->fngr) != 1) {
+			lastid = -1;
+			continue;
+		}
+
+		int id = regs->touch[0].id;
+		int x = CYAPA_TOUCH_X(regs, 0);
+		int y = CYAPA_TOUCH_Y(regs, 0);
+
+		if (id != lastid)
+			downtime = set->times[i];
+		else if (set->times[i] - downtime >= PAN_START_MS) {
+			travel->fingerx += x - lastx;
+			travel->fingery += y - lasty;
+		}
+
+		lastid = id;
+		lastx = x;
+		lasty = y;
+	}
+}
+
+static struct csgesture_softc sc;
+
+static void cursortravel(struct capture_frameset *set, int multiplier, struct travel *travel) {
+	struct csgesture_sink sink = { travel, travel_mouse, travel_keyboard, travel_scroll };
+
+	for (int run = 0; run < TRAVEL_RUNS; run++) {
+		memset(&sc, 0, sizeof(sc));
+		SetDefaultSettings(&sc.settings);
+		sc.settings.pointerMultiplier = multiplier;
+		travel->cursorx = travel->cursory = 0;
+		travel->reports = travel->splits = 0;
+
+		double start = nowns();
+		for (int i = 0; i < set->count; i++)
+			TrackpadRawInput(&sink, &sc, &set->frames[i], set->times[i]);
+		double elapsed = nowns() - start;
+
+		if (run == 0 || elapsed < travel->best)
+			travel->best = elapsed;
+	}
+}
+
+static bool within(long cursor, long finger, int multiplier) {
+	long expected = finger * multiplier / 10;
+	long error = cursor - expected;
+
+	return error >= -1 && error <= 1;
+}
+
+static bool check(const char *name, struct capture_frameset *set, int multiplier) {
+	struct travel travel;
+
+	memset(&travel, 0, sizeof(travel));
+	fingertravel(set, &travel);
+	cursortravel(set, multiplier, &travel);
+
+	bool ok = within(travel.cursorx, travel.fingerx, multiplier) &&
+		within(travel.cursory, travel.fingery, multiplier);
+
+	printf("%-12s speed %2d  finger %6ld,%6ld  cursor %6ld,%6ld  %6lu reports %4lu split"
+		"  %6.1f ns/frame  %s\n",
+		name, multiplier, travel.fingerx, travel.fingery, travel.cursorx, travel.cursory,
+		travel.reports, travel.splits, set->count ? travel.best / set->count : 0.0,
+		ok ? "ok" : "MISMATCH");
+	return ok;
+}
+
+//
+// One finger crossing the pad at 6000 units/s, 60 units a frame at 100 Hz
+// and well over a report's worth of counts at 3x pointer speed
+//
+static void fastframes(struct capture_frameset *set) {
+	struct synth_script script;
+	struct synth_state state;
+
+	synth_preset(&script, SYNTH_POINTING, 200);
+	script.fingers[0].startx = 100;
+	script.fingers[0].starty = 100;
+	script.fingers[0].vx = 6000;
+	script.fingers[0].vy = 2000;
+
+	set->frames = (struct cyapa_regs *)malloc(64 * sizeof(*set->frames));
+	set->times = (uint32_t *)malloc(64 * sizeof(*set->times));
+	if (!set->frames || !set->times)
+		exit(1);
+
+	set->count = 0;
+	synth_init(&state, &script);
+	while (set->count < 64 && synth_next(&state, &set->frames[set->count], &set->times[set->count]))
+		set->count++;
+}
+
+int main(int argc, char **argv) {
+	static const int multipliers[] = { 10, 7, 25 };
+	struct capture_frameset set;
+	bool ok = true;
+
+	for (int arg = 1; arg < argc; arg++) {
+		const char *name = strrchr(argv[arg], '/') ? strrchr(argv[arg], '/') + 1 : argv[arg];
+
+		if (!readframes(argv[arg], &set))
+			return 2;
+
+		for (size_t i = 0; i < sizeof(multipliers) / sizeof(multipliers[0]); i++)
+			ok &= check(name, &set, multipliers[i]);
+
+		free(set.frames);
+		free(set.times);
+	}
+
+	fastframes(&set);
+	ok &= check("fast", &set, 30);
+	free(set.frames);
+	free(set.times);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1 @@
+#include "wdkhost.h"
@@ -0,0 +1,379 @@
+//
+// Just enough of the WDK for the driver's bus code to build on the host:
+// the types and macros its headers use, and the framework calls that
+// sys/spb.cpp makes. Those are implemented by the mock I/O target in
+// host/mockspb.cpp, nothing else is.
+//
+// The header names the driver includes (wdm.h, wdf.h, spb.h, ...) all
+// come here.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+//
+// Annotations and basic types
+//
+
+#define IN
+#define OUT
+#define _In_
+#define _Out_
+#define _Inout_
+#define _In_reads_bytes_(size)
+#define _Out_writes_bytes_(size)
+
+#define VOID void
+#define CONST const
+#define FORCEINLINE static inline
+
+#ifndef FALSE
+#define FALSE 0
+#define TRUE 1
+#endif
+
+typedef unsigned char UCHAR, *PUCHAR, BOOLEAN, BYTE;
+typedef char CHAR, *PCHAR;
+typedef short SHORT;
+typedef unsigned short USHORT;
+typedef int LONG;
+typedef unsigned int ULONG, *PULONG;
+typedef long long LONGLONG, LONG64;
+typedef unsigned long long ULONGLONG;
+typedef size_t ULONG_PTR, SIZE_T;
+typedef void *PVOID;
+typedef wchar_t WCHAR, *PWSTR;
+typedef LONG NTSTATUS;
+typedef UCHAR KIRQL;
+
+typedef union _LARGE_INTEGER {
+	struct {
+		ULONG LowPart;
+		LONG HighPart;
+	};
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _UNICODE_STRING {
+	USHORT Length;
+	USHORT MaximumLength;
+	PWSTR Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+
+typedef struct _KEVENT {
+	LONG Signaled;
+} KEVENT;
+
+#define UNREFERENCED_PARAMETER(p) (void)(p)
+#define FIELD_OFFSET(type, field) offsetof(type, field)
+#define RTL_FIELD_SIZE(type, field) (sizeof(((type *)0)->field))
+#define C_ASSERT(e) static_assert(e, #e)
+
+#define RtlCopyMemory(d, s, l) memcpy((d), (s), (l))
+#define RtlZeroMemory(d, l) memset((d), 0, (l))
+
+static inline void RtlInitEmptyUnicodeString(PUNICODE_STRING String, PWSTR Buffer, USHORT Size) {
+	String->Length = 0;
+	String->MaximumLength = Size;
+	String->Buffer = Buffer;
+}
+
+//
+// Status codes
+//
+
+#define NT_SUCCESS(status) ((NTSTATUS)(status) >= 0)
+
+#define STATUS_SUCCESS                ((NTSTATUS)0x00000000L)
+#define STATUS_PENDING                ((NTSTATUS)0x00000103L)
+#define STATUS_DEVICE_BUSY            ((NTSTATUS)0x80000011L)
+#define STATUS_INVALID_PARAMETER      ((NTSTATUS)0xC000000DL)
+#define STATUS_INVALID_DEVICE_REQUEST ((NTSTATUS)0xC0000010L)
+#define STATUS_BUFFER_TOO_SMALL       ((NTSTATUS)0xC0000023L)
+#define STATUS_INSUFFICIENT_RESOURCES ((NTSTATUS)0xC000009AL)
+#define STATUS_NOT_SUPPORTED          ((NTSTATUS)0xC00000BBL)
+#define STATUS_CANCELLED              ((NTSTATUS)0xC0000120L)
+#define STATUS_DEVICE_PROTOCOL_ERROR  ((NTSTATUS)0xC0000186L)
+
+//
+// Interlocked operations and timing
+//
+
+#define InterlockedIncrement(p) __sync_add_and_fetch((p), 1)
+#define InterlockedDecrement(p) __sync_sub_and_fetch((p), 1)
+#define InterlockedExchange(p, v) __sync_lock_test_and_set((p), (v))
+#define InterlockedExchangeAdd(p, v) __sync_fetch_and_add((p), (v))
+#define InterlockedExchangeAdd64(p, v) __sync_fetch_and_add((p), (LONG64)(v))
+#define InterlockedCompareExchange(p, e, c) __sync_val_compare_and_swap((p), (c), (e))
+#define KeMemoryBarrier() __sync_synchronize()
+
+LARGE_INTEGER KeQueryPerformanceCounter(LARGE_INTEGER *Frequency);
+
+//
+// Framework objects
+//
+
+#define WDF_HANDLE(name) typedef struct name##__ *name
+WDF_HANDLE(WDFOBJECT);
+WDF_HANDLE(WDFDRIVER);
+WDF_HANDLE(WDFDEVICE);
+WDF_HANDLE(WDFQUEUE);
+WDF_HANDLE(WDFREQUEST);
+WDF_HANDLE(WDFIOTARGET);
+WDF_HANDLE(WDFMEMORY);
+WDF_HANDLE(WDFWAITLOCK);
+WDF_HANDLE(WDFSPINLOCK);
+WDF_HANDLE(WDFINTERRUPT);
+WDF_HANDLE(WDFTIMER);
+WDF_HANDLE(WDFWORKITEM);
+#undef WDF_HANDLE
+
+typedef PVOID WDFCONTEXT;
+
+typedef struct _WDF_OBJECT_ATTRIBUTES {
+	PVOID ParentObject;
+} WDF_OBJECT_ATTRIBUTES, *PWDF_OBJECT_ATTRIBUTES;
+
+#define WDF_NO_OBJECT_ATTRIBUTES ((PWDF_OBJECT_ATTRIBUTES)NULL)
+#define WDF_NO_SEND_OPTIONS NULL
+
+static inline void WDF_OBJECT_ATTRIBUTES_INIT(PWDF_OBJECT_ATTRIBUTES Attributes) {
+	memset(Attributes, 0, sizeof(*Attributes));
+}
+
+#define WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(type, accessor) \
+	type *accessor(PVOID Handle);
+
+void WdfObjectDelete(PVOID Object);
+
+NTSTATUS WdfWaitLockCreate(PWDF_OBJECT_ATTRIBUTES Attributes, WDFWAITLOCK *Lock);
+NTSTATUS WdfWaitLockAcquire(WDFWAITLOCK Lock, LONGLONG *Timeout);
+void WdfWaitLockRelease(WDFWAITLOCK Lock);
+
+//
+// Memory
+//
+
+typedef enum _POOL_TYPE {
+	NonPagedPool,
+	NonPagedPoolNx = 512
+} POOL_TYPE;
+
+typedef struct _WDFMEMORY_OFFSET {
+	size_t BufferOffset;
+	size_t BufferLength;
+} WDFMEMORY_OFFSET, *PWDFMEMORY_OFFSET;
+
+typedef enum _WDF_MEMORY_DESCRIPTOR_TYPE {
+	WdfMemoryDescriptorTypeInvalid,
+	WdfMemoryDescriptorTypeBuffer,
+	WdfMemoryDescriptorTypeMdl,
+	WdfMemoryDescriptorTypeHandle
+} WDF_MEMORY_DESCRIPTOR_TYPE;
+
+typedef struct _WDF_MEMORY_DESCRIPTOR {
+	WDF_MEMORY_DESCRIPTOR_TYPE Type;
+	union {
+		struct {
+			PVOID Buffer;
+			ULONG Length;
+		} BufferType;
+		struct {
+			WDFMEMORY Memory;
+			PWDFMEMORY_OFFSET Offsets;
+		} HandleType;
+	} u;
+} WDF_MEMORY_DESCRIPTOR, *PWDF_MEMORY_DESCRIPTOR;
+
+static inline void WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(PWDF_MEMORY_DESCRIPTOR Descriptor,
+	PVOID Buffer, ULONG Length) {
+	memset(Descriptor, 0, sizeof(*Descriptor));
+	Descriptor->Type = WdfMemoryDescriptorTypeBuffer;
+	Descriptor->u.BufferType.Buffer = Buffer;
+	Descriptor->u.BufferType.Length = Length;
+}
+
+static inline void WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(PWDF_MEMORY_DESCRIPTOR Descriptor,
+	WDFMEMORY Memory, PWDFMEMORY_OFFSET Offsets) {
+	memset(Descriptor, 0, sizeof(*Descriptor));
+	Descriptor->Type = WdfMemoryDescriptorTypeHandle;
+	Descriptor->u.HandleType.Memory = Memory;
+	Descriptor->u.HandleType.Offsets = Offsets;
+}
+
+NTSTATUS WdfMemoryCreate(PWDF_OBJECT_ATTRIBUTES Attributes, POOL_TYPE PoolType, ULONG PoolTag,
+	size_t BufferSize, WDFMEMORY *Memory, PVOID *Buffer);
+PVOID WdfMemoryGetBuffer(WDFMEMORY Memory, size_t *BufferSize);
+
+//
+// Requests and I/O targets
+//
+
+typedef struct _IO_STATUS_BLOCK {
+	NTSTATUS Status;
+	ULONG_PTR Information;
+} IO_STATUS_BLOCK;
+
+typedef struct _WDF_REQUEST_COMPLETION_PARAMS {
+	ULONG Size;
+	IO_STATUS_BLOCK IoStatus;
+} WDF_REQUEST_COMPLETION_PARAMS, *PWDF_REQUEST_COMPLETION_PARAMS;
+
+typedef VOID EVT_WDF_REQUEST_COMPLETION_ROUTINE(WDFREQUEST Request, WDFIOTARGET Target,
+	PWDF_REQUEST_COMPLETION_PARAMS Params, WDFCONTEXT Context);
+
+typedef enum _WDF_REQUEST_REUSE_FLAGS {
+	WDF_REQUEST_REUSE_NO_FLAGS = 0
+} WDF_REQUEST_REUSE_FLAGS;
+
+typedef struct _WDF_REQUEST_REUSE_PARAMS {
+	ULONG Flags;
+	NTSTATUS Status;
+} WDF_REQUEST_REUSE_PARAMS;
+
+static inline void WDF_REQUEST_REUSE_PARAMS_INIT(WDF_REQUEST_REUSE_PARAMS *Params,
+	ULONG Flags, NTSTATUS Status) {
+	Params->Flags = Flags;
+	Params->Status = Status;
+}
+
+typedef enum _WDF_IO_TARGET_SENT_IO_ACTION {
+	WdfIoTargetCancelSentIo = 1,
+	WdfIoTargetWaitForSentIoToComplete,
+	WdfIoTargetLeaveSentIoPending
+} WDF_IO_TARGET_SENT_IO_ACTION;
+
+#define GENERIC_READ          0x80000000L
+#define GENERIC_WRITE         0x40000000L
+#define FILE_OPEN             0x00000001
+#define FILE_ATTRIBUTE_NORMAL 0x00000080
+
+typedef struct _WDF_IO_TARGET_OPEN_PARAMS {
+	PUNICODE_STRING TargetDeviceName;
+	ULONG DesiredAccess;
+	ULONG ShareAccess;
+	ULONG CreateDisposition;
+	ULONG FileAttributes;
+} WDF_IO_TARGET_OPEN_PARAMS;
+
+static inline void WDF_IO_TARGET_OPEN_PARAMS_INIT_OPEN_BY_NAME(WDF_IO_TARGET_OPEN_PARAMS *Params,
+	PUNICODE_STRING Name, ULONG DesiredAccess) {
+	memset(Params, 0, sizeof(*Params));
+	Params->TargetDeviceName = Name;
+	Params->DesiredAccess = DesiredAccess;
+}
+
+NTSTATUS WdfRequestCreate(PWDF_OBJECT_ATTRIBUTES Attributes, WDFIOTARGET Target, WDFREQUEST *Request);
+NTSTATUS WdfRequestReuse(WDFREQUEST Request, WDF_REQUEST_REUSE_PARAMS *Params);
+void WdfRequestSetCompletionRoutine(WDFREQUEST Request,
+	EVT_WDF_REQUEST_COMPLETION_ROUTINE *Routine, WDFCONTEXT Context);
+BOOLEAN WdfRequestSend(WDFREQUEST Request, WDFIOTARGET Target, PVOID Options);
+NTSTATUS WdfRequestGetStatus(WDFREQUEST Request);
+BOOLEAN WdfRequestCancelSentRequest(WDFREQUEST Request);
+
+NTSTATUS WdfIoTargetCreate(WDFDEVICE Device, PWDF_OBJECT_ATTRIBUTES Attributes, WDFIOTARGET *Target);
+NTSTATUS WdfIoTargetOpen(WDFIOTARGET Target, WDF_IO_TARGET_OPEN_PARAMS *Params);
+void WdfIoTargetStop(WDFIOTARGET Target, WDF_IO_TARGET_SENT_IO_ACTION Action);
+NTSTATUS WdfIoTargetSendWriteSynchronously(WDFIOTARGET Target, WDFREQUEST Request,
+	PWDF_MEMORY_DESCRIPTOR InputBuffer, LONGLONG *DeviceOffset, PVOID Options,
+	ULONG_PTR *BytesWritten);
+NTSTATUS WdfIoTargetSendReadSynchronously(WDFIOTARGET Target, WDFREQUEST Request,
+	PWDF_MEMORY_DESCRIPTOR OutputBuffer, LONGLONG *DeviceOffset, PVOID Options,
+	ULONG_PTR *BytesRead);
+NTSTATUS WdfIoTargetSendIoctlSynchronously(WDFIOTARGET Target, WDFREQUEST Request, ULONG IoctlCode,
+	PWDF_MEMORY_DESCRIPTOR InputBuffer, PWDF_MEMORY_DESCRIPTOR OutputBuffer, PVOID Options,
+	ULONG_PTR *BytesReturned);
+NTSTATUS WdfIoTargetFormatRequestForIoctl(WDFIOTARGET Target, WDFREQUEST Request, ULONG IoctlCode,
+	WDFMEMORY InputBuffer, PWDFMEMORY_OFFSET InputBufferOffset,
+	WDFMEMORY OutputBuffer, PWDFMEMORY_OFFSET OutputBufferOffset);
+
+//
+// Resource hub paths, the mock target opens whatever it is given
+//
+
+#define RESOURCE_HUB_PATH_SIZE 64
+
+static inline NTSTATUS RESOURCE_HUB_CREATE_PATH_FROM_ID(PUNICODE_STRING Path,
+	ULONG IdLowPart, ULONG IdHighPart) {
+	(void)IdLowPart;
+	(void)IdHighPart;
+	Path->Length = 0;
+	return STATUS_SUCCESS;
+}
+
+//
+// HID class driver types
+//
+
+typedef struct _HID_DESCRIPTOR {
+	UCHAR bLength;
+	UCHAR bDescriptorType;
+	USHORT bcdHID;
+	UCHAR bCountry;
+	UCHAR bNumDescriptors;
+	struct _HID_DESCRIPTOR_DESC_LIST {
+		UCHAR bReportType;
+		USHORT wReportLength;
+	} DescriptorList[1];
+} __attribute__((packed)) HID_DESCRIPTOR;
+
+//
+// Simple peripheral bus sequences
+//
+
+#define IOCTL_SPB_EXECUTE_SEQUENCE 0x0007001CL
+
+typedef enum _SPB_TRANSFER_DIRECTION {
+	SpbTransferDirectionNone,
+	SpbTransferDirectionFromDevice,
+	SpbTransferDirectionToDevice
+} SPB_TRANSFER_DIRECTION;
+
+typedef struct _SPB_TRANSFER_BUFFER {
+	ULONG Format;
+	union {
+		struct {
+			PVOID Buffer;
+			ULONG BufferCb;
+		} Simple;
+	};
+} SPB_TRANSFER_BUFFER;
+
+typedef struct _SPB_TRANSFER_LIST_ENTRY {
+	SPB_TRANSFER_DIRECTION Direction;
+	ULONG DelayInUs;
+	SPB_TRANSFER_BUFFER Buffer;
+} SPB_TRANSFER_LIST_ENTRY;
+
+typedef struct _SPB_TRANSFER_LIST {
+	ULONG Size;
+	ULONG Reserved;
+	ULONG TransferCount;
+	SPB_TRANSFER_LIST_ENTRY Transfers[1];
+} SPB_TRANSFER_LIST;
+
+#define SPB_TRANSFER_LIST_AND_ENTRIES(count)						\
+	struct {														\
+		SPB_TRANSFER_LIST List;										\
+		SPB_TRANSFER_LIST_ENTRY MoreEntries[(count) - 1];			\
+	}
+
+static inline void SPB_TRANSFER_LIST_INIT(SPB_TRANSFER_LIST *List, ULONG TransferCount) {
+	List->Size = sizeof(*List);
+	List->Reserved = 0;
+	List->TransferCount = TransferCount;
+}
+
+static inline SPB_TRANSFER_LIST_ENTRY SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+	SPB_TRANSFER_DIRECTION Direction, ULONG DelayInUs, PVOID Buffer, ULONG BufferCb) {
+	SPB_TRANSFER_LIST_ENTRY entry;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.Direction = Direction;
+	entry.DelayInUs = DelayInUs;
+	entry.Buffer.Simple.Buffer = Buffer;
+	entry.Buffer.Simple.BufferCb = BufferCb;
+	return entry;
+}
@@ -0,0 +1,292 @@
+#include "capture.h"
+
+#define CAPTURE_FRAME_MAX (2 + CYAPA_MAX_MT * 5)
+
+static uint32_t capture_free(struct capture_ring *ring) {
+	return CAPTURE_RING_SIZE - (ring->head - ring->tail);
+}
+
+static void capture_put(struct capture_ring *ring, const uint8_t *data, uint32_t length) {
+	for (uint32_t i = 0; i < length; i++) {
+		ring->data[ring->head & (CAPTURE_RING_SIZE - 1)] = data[i];
+		ring->head++;
+	}
+}
+
+static void capture_put_record(struct capture_ring *ring, uint8_t type, uint32_t timems,
+	const uint8_t *payload, uint8_t length) {
+	uint8_t header[CAPTURE_HEADER_SIZE];
+
+	header[0] = type;
+	header[1] = length;
+	header[2] = (uint8_t)timems;
+	header[3] = (uint8_t)(timems >> 8);
+	header[4] = (uint8_t)(timems >> 16);
+	header[5] = (uint8_t)(timems >> 24);
+
+	capture_put(ring, header, sizeof(header));
+	capture_put(ring, payload, length);
+}
+
+static bool capture_record(struct capture_ring *ring, uint8_t type, uint32_t timems,
+	const uint8_t *payload, uint8_t length) {
+	uint32_t needed = CAPTURE_HEADER_SIZE + length;
+
+	if (!ring->enabled)
+		return false;
+
+	//
+	// Once something was dropped, the next record that fits is preceded by
+	// a count of what went missing so gaps are visible in the trace
+	//
+	if (ring->lost)
+		needed += CAPTURE_HEADER_SIZE + 4;
+
+	if (capture_free(ring) < needed) {
+		ring->lost++;
+		return false;
+	}
+
+	if (ring->lost) {
+		uint8_t lost[4];
+		lost[0] = (uint8_t)ring->lost;
+		lost[1] = (uint8_t)(ring->lost >> 8);
+		lost[2] = (uint8_t)(ring->lost >> 16);
+		lost[3] = (uint8_t)(ring->lost >> 24);
+		capture_put_record(ring, CAPTURE_RECORD_LOST, timems, lost, sizeof(lost));
+		ring->lost = 0;
+	}
+
+	capture_put_record(ring, type, timems, payload, length);
+	return true;
+}
+
+void capture_start(struct capture_ring *ring, uint32_t timems) {
+	uint8_t version = CAPTURE_VERSION;
+
+	ring->head = 0;
+	ring->tail = 0;
+	ring->lost = 0;
+	ring->enabled = true;
+	capture_record(ring, CAPTURE_RECORD_START, timems, &version, sizeof(version));
+}
+
+bool capture_frame(struct capture_ring *ring, uint32_t timems, struct cyapa_regs *regs) {
+	int nfingers = CYAPA_FNGR_NUMFINGERS(regs->fngr);
+
+	if (nfingers > CYAPA_MAX_MT)
+		nfingers = CYAPA_MAX_MT;
+
+	//
+	// Slots past the finger count are never looked at, leave them out
+	//
+	return capture_record(ring, CAPTURE_RECORD_FRAME, timems,
+		(const uint8_t *)regs, (uint8_t)(2 + nfingers * 5));
+}
+
+bool capture_mouse(struct capture_ring *ring, uint32_t timems, uint8_t buttons,
+	uint8_t x, uint8_t y, uint8_t wheel, uint8_t hwheel) {
+	uint8_t payload[5] = { buttons, x, y, wheel, hwheel };
+
+	return capture_record(ring, CAPTURE_RECORD_MOUSE, timems, payload, sizeof(payload));
+}
+
+bool capture_keyboard(struct capture_ring *ring, uint32_t timems, uint8_t shiftKeys, uint8_t *keyCodes) {
+	uint8_t payload[7];
+
+	payload[0] = shiftKeys;
+	for (int i = 0; i < 6; i++)
+		payload[i + 1] = keyCodes[i];
+
+	return capture_record(ring, CAPTURE_RECORD_KEYBOARD, timems, payload, sizeof(payload));
+}
+
+bool capture_scroll(struct capture_ring *ring, uint32_t timems, uint8_t flag,
+	uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
+	uint8_t payload[9] = {
+		flag,
+		(uint8_t)x1, (uint8_t)(x1 >> 8),
+		(uint8_t)y1, (uint8_t)(y1 >> 8),
+		(uint8_t)x2, (uint8_t)(x2 >> 8),
+		(uint8_t)y2, (uint8_t)(y2 >> 8)
+	};
+
+	return capture_record(ring, CAPTURE_RECORD_SCROLL, timems, payload, sizeof(payload));
+}
+
+bool capture_event(struct capture_ring *ring, uint32_t timems, uint8_t id,
+	uint32_t arg0, uint32_t arg1) {
+	uint8_t payload[9] = {
+		id,
+		(uint8_t)arg0, (uint8_t)(arg0 >> 8), (uint8_t)(arg0 >> 16), (uint8_t)(arg0 >> 24),
+		(uint8_t)arg1, (uint8_t)(arg1 >> 8), (uint8_t)(arg1 >> 16), (uint8_t)(arg1 >> 24)
+	};
+
+	return capture_record(ring, CAPTURE_RECORD_EVENT, timems, payload, sizeof(payload));
+}
+
+static void capture_sink_mouse(void *context, uint8_t buttons, uint8_t x, uint8_t y,
+	uint8_t wheel, uint8_t hwheel) {
+	struct capture_recorder *recorder = (struct capture_recorder *)context;
+
+	capture_mouse(recorder->ring, recorder->sc->frametime, buttons, x, y, wheel, hwheel);
+}
+
+static void capture_sink_keyboard(void *context, uint8_t shiftKeys, uint8_t *keyCodes) {
+	struct capture_recorder *recorder = (struct capture_recorder *)context;
+
+	capture_keyboard(recorder->ring, recorder->sc->frametime, shiftKeys, keyCodes);
+}
+
+static void capture_sink_scroll(void *context, uint8_t flag, uint16_t x1, uint16_t y1,
+	uint16_t x2, uint16_t y2) {
+	struct capture_recorder *recorder = (struct capture_recorder *)context;
+
+	capture_scroll(recorder->ring, recorder->sc->frametime, flag, x1, y1, x2, y2);
+}
+
+static void capture_trace_event(void *context, uint8_t id, uint32_t arg0, uint32_t arg1) {
+	struct capture_recorder *recorder = (struct capture_recorder *)context;
+
+	capture_event(recorder->ring, recorder->sc->frametime, id, arg0, arg1);
+}
+
+void capture_recorder_init(struct capture_recorder *recorder, struct capture_ring *ring,
+	struct csgesture_softc *sc) {
+	recorder->ring = ring;
+	recorder->sc = sc;
+
+	recorder->sink.context = recorder;
+	recorder->sink.mouse = capture_sink_mouse;
+	recorder->sink.keyboard = capture_sink_keyboard;
+	recorder->sink.scroll = capture_sink_scroll;
+
+	recorder->trace.context = recorder;
+	recorder->trace.event = capture_trace_event;
+	recorder->trace.enabled = 0xFFFFFFFF;
+}
+
+uint32_t capture_read(struct capture_ring *ring, uint8_t *buffer, uint32_t length) {
+	uint32_t available = ring->head - ring->tail;
+
+	if (length > available)
+		length = available;
+
+	for (uint32_t i = 0; i < length; i++) {
+		buffer[i] = ring->data[ring->tail & (CAPTURE_RING_SIZE - 1)];
+		ring->tail++;
+	}
+	return length;
+}
+
+static uint16_t capture_u16(const uint8_t *p) {
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+//
+// Steps to the next record of a capture. Returns 1 with the record's
+// type, time and payload filled in, 0 at the end, -1 if it is truncated.
+//
+static int capture_next(const uint8_t *data, uint32_t length, uint32_t *offset,
+	uint8_t *type, uint8_t *size, uint32_t *timems, const uint8_t **payload) {
+	if (*offset == length)
+		return 0;
+	if (length - *offset < CAPTURE_HEADER_SIZE)
+		return -1;
+
+	const uint8_t *record = data + *offset;
+
+	*type = record[0];
+	*size = record[1];
+	*timems = record[2] | (record[3] << 8) | (record[4] << 16) | ((uint32_t)record[5] << 24);
+	*payload = record + CAPTURE_HEADER_SIZE;
+
+	if (length - *offset - CAPTURE_HEADER_SIZE < *size)
+		return -1;
+	*offset += CAPTURE_HEADER_SIZE + *size;
+	return 1;
+}
+
+//
+// Frame records may be shorter than cyapa_regs, the rest reads as zero
+//
+static bool capture_regs(const uint8_t *payload, uint8_t size, struct cyapa_regs *regs) {
+	uint8_t *raw = (uint8_t *)regs;
+
+	if (size < 2 || size > CAPTURE_FRAME_MAX)
+		return false;
+	for (uint32_t i = 0; i < sizeof(*regs); i++)
+		raw[i] = i < size ? payload[i] : 0;
+	return true;
+}
+
+int capture_replay(const uint8_t *data, uint32_t length, struct csgesture_softc *sc,
+	struct csgesture_sink *sink, struct csgesture_sink *recorded) {
+	uint32_t offset = 0;
+	int frames = 0;
+	int more;
+	uint8_t type, size;
+	uint32_t timems;
+	const uint8_t *payload;
+
+	while ((more = capture_next(data, length, &offset, &type, &size, &timems, &payload)) > 0) {
+		switch (type) {
+		case CAPTURE_RECORD_START:
+			if (size < 1 || payload[0] > CAPTURE_VERSION)
+				return -1;
+			break;
+		case CAPTURE_RECORD_FRAME: {
+			struct cyapa_regs regs;
+
+			if (!capture_regs(payload, size, &regs))
+				break;
+			TrackpadRawInput(sink, sc, &regs, timems);
+			frames++;
+			break;
+		}
+		case CAPTURE_RECORD_MOUSE:
+			if (recorded && size >= 5)
+				recorded->mouse(recorded->context, payload[0], payload[1], payload[2],
+					payload[3], payload[4]);
+			break;
+		case CAPTURE_RECORD_KEYBOARD:
+			if (recorded && size >= 7)
+				recorded->keyboard(recorded->context, payload[0], (uint8_t *)payload + 1);
+			break;
+		case CAPTURE_RECORD_SCROLL:
+			if (recorded && size >= 9)
+				recorded->scroll(recorded->context, payload[0], capture_u16(payload + 1),
+					capture_u16(payload + 3), capture_u16(payload + 5), capture_u16(payload + 7));
+			break;
+		}
+	}
+	return more < 0 ? -1 : frames;
+}
+
+int capture_frames(const uint8_t *data, uint32_t length, struct cyapa_regs *frames,
+	uint32_t *times, int maxframes) {
+	uint32_t offset = 0;
+	int count = 0;
+	int more;
+	uint8_t type, size;
+	uint32_t timems;
+	const uint8_t *payload;
+
+	while ((more = capture_next(data, length, &offset, &type, &size, &timems, &payload)) > 0) {
+		if (type == CAPTURE_RECORD_START && (size < 1 || payload[0] > CAPTURE_VERSION))
+			return -1;
+		if (type != CAPTURE_RECORD_FRAME)
+			continue;
+
+		struct cyapa_regs regs;
+
+		if (!capture_regs(payload, size, &regs))
+			continue;
+		if (count < maxframes) {
+			frames[count] = regs;
+			times[count] = timems;
+		}
+		count++;
+	}
+	return more < 0 ? -1 : count;
+}
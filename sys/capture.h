@@ -0,0 +1,105 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include "stdint.h"
+
+#include "cyapa.h"
+#include "gesture.h"
+#include "tracesink.h"
+
+//
+// Touch trace capture. Raw frames and the reports the gesture engine made
+// from them are appended to a byte ring as small records, which are pulled
+// out through REPORTID_CAPTURE and can be replayed through the engine
+// offline.
+//
+// Every record is a 6 byte header followed by its payload:
+//
+//   uint8_t  type     CAPTURE_RECORD_xxx
+//   uint8_t  length   payload bytes
+//   uint32_t time     frame time in ms, little endian
+//
+// A capture always starts with CAPTURE_RECORD_START carrying the format
+// version. Decoders must skip record types they don't know.
+//
+
+#define CAPTURE_VERSION 1
+
+#define CAPTURE_RECORD_START	0x01	/* uint8_t version */
+#define CAPTURE_RECORD_FRAME	0x02	/* stat, fngr, 5 bytes per finger */
+#define CAPTURE_RECORD_MOUSE	0x03	/* buttons, x, y, wheel, hwheel */
+#define CAPTURE_RECORD_KEYBOARD	0x04	/* shift keys, 6 key codes */
+#define CAPTURE_RECORD_SCROLL	0x05	/* flag, 4 x uint16_t little endian */
+#define CAPTURE_RECORD_LOST	0x06	/* uint32_t records dropped, little endian */
+#define CAPTURE_RECORD_EVENT	0x07	/* TRACE_EVENT_xxx, 2 x uint32_t little endian */
+
+#define CAPTURE_HEADER_SIZE 6
+
+//
+// Must be a power of two
+//
+#define CAPTURE_RING_SIZE 4096
+
+struct capture_ring {
+	uint32_t head;
+	uint32_t tail;
+	uint32_t lost;
+	bool enabled;
+	uint8_t data[CAPTURE_RING_SIZE];
+};
+
+void capture_start(struct capture_ring *ring, uint32_t timems);
+
+bool capture_frame(struct capture_ring *ring, uint32_t timems, struct cyapa_regs *regs);
+
+bool capture_mouse(struct capture_ring *ring, uint32_t timems, uint8_t buttons,
+	uint8_t x, uint8_t y, uint8_t wheel, uint8_t hwheel);
+
+bool capture_keyboard(struct capture_ring *ring, uint32_t timems, uint8_t shiftKeys, uint8_t *keyCodes);
+
+bool capture_scroll(struct capture_ring *ring, uint32_t timems, uint8_t flag,
+	uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+
+bool capture_event(struct capture_ring *ring, uint32_t timems, uint8_t id,
+	uint32_t arg0, uint32_t arg1);
+
+//
+// Sink that records everything the engine running on sc reports, stamped
+// with its frame time. Two runs over the same frames record the same
+// bytes, so a capture doubles as expected output for a frame trace.
+// Pointing sc->trace at trace adds the trace events in between.
+//
+struct capture_recorder {
+	struct capture_ring *ring;
+	struct csgesture_softc *sc;
+	struct csgesture_sink sink;
+	struct trace_sink trace;
+};
+
+void capture_recorder_init(struct capture_recorder *recorder, struct capture_ring *ring,
+	struct csgesture_softc *sc);
+
+//
+// Copies up to length captured bytes out of the ring, returns the count
+//
+uint32_t capture_read(struct capture_ring *ring, uint8_t *buffer, uint32_t length);
+
+//
+// Feeds the frames of a capture through the gesture engine with their
+// recorded timestamps. Reports the engine makes go to sink, the reports
+// recorded alongside the frames go to recorded (may be NULL) so the two
+// can be compared. Returns the number of frames replayed, or -1 if the
+// capture is truncated or of a newer version.
+//
+int capture_replay(const uint8_t *data, uint32_t length, struct csgesture_softc *sc,
+	struct csgesture_sink *sink, struct csgesture_sink *recorded);
+
+//
+// Copies the frames of a capture and their timestamps out, up to
+// maxframes of them, for running them some other way than capture_replay.
+// Returns the number of frames in the capture, or -1 like capture_replay.
+//
+int capture_frames(const uint8_t *data, uint32_t length, struct cyapa_regs *frames,
+	uint32_t *times, int maxframes);
+
+#endif
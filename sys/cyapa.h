@@ -35,7 +35,11 @@
 #include "stdint.h"
 
 #ifndef __packed
+#ifdef _MSC_VER
 #define __packed( __Declaration__ ) __pragma( pack(push, 1) ) __Declaration__ __pragma( pack(pop) )
+#else
+#define __packed( __Declaration__ ) __Declaration__ __attribute__((packed))
+#endif
 #endif
 
 #ifndef _SYS_DEV_SMBUS_CYAPA_CYAPA_H_
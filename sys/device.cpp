@@ -343,11 +343,24 @@ OnD0Entry(
     PDEVICE_CONTEXT pDevice = GetDeviceContext(FxDevice);
     NTSTATUS status = STATUS_SUCCESS;
 
-	WdfTimerStart(pDevice->Timer, WDF_REL_TIMEOUT_IN_MS(10));
+	pDevice->TimerParked = 0;
+	WdfTimerStart(pDevice->Timer, WDF_REL_TIMEOUT_IN_MS(CYAPA_TIMER_PERIOD_MS));
 
 	BOOTTRACKPAD(pDevice);
 
 	pDevice->RegsSet = false;
+	pDevice->FrameRing.Head = 0;
+	pDevice->FrameRing.Tail = 0;
+	pDevice->ReadPending = 0;
+	pDevice->ReadInFlight = 0;
+	pDevice->LastFingers = CYAPA_MAX_MT;
+
+	WdfSpinLockAcquire(pDevice->ReportLock);
+	pDevice->ReportRing.Head = 0;
+	pDevice->ReportRing.Count = 0;
+	for (int i = 0; i < CYAPA_REPORT_STREAMS; i++)
+		pDevice->ReportRing.Latest[i].Length = 0;
+	WdfSpinLockRelease(pDevice->ReportLock);
 	pDevice->ConnectInterrupt = true;
 
     FuncExit(TRACE_FLAG_WDFLOADING);
@@ -383,10 +396,25 @@ OnD0Exit(
 
     PDEVICE_CONTEXT pDevice = GetDeviceContext(FxDevice);
 
-	WdfTimerStop(pDevice->Timer, TRUE);
-
 	pDevice->ConnectInterrupt = false;
 
+	//
+	// Take the read slot for ourselves so no new read can start, and wait
+	// for the one in flight to finish with the preallocated request. The
+	// completion may still queue frames and re-arm the timer, so the timer
+	// is stopped only after that. D0Entry hands the slot back.
+	//
+	while (InterlockedCompareExchange(&pDevice->ReadInFlight, 1, 0) != 0) {
+		LARGE_INTEGER delay;
+
+		SpbCancelAsynchronousRead(&pDevice->I2CContext);
+		delay.QuadPart = WDF_REL_TIMEOUT_IN_MS(1);
+		KeDelayExecutionThread(KernelMode, FALSE, &delay);
+	}
+	WdfWorkItemFlush(pDevice->ReadWorkItem);
+
+	WdfTimerStop(pDevice->Timer, TRUE);
+
     FuncExit(TRACE_FLAG_WDFLOADING);
 
     return STATUS_SUCCESS;
@@ -578,6 +606,14 @@ Return Value:
 		//
 		status = CyapaGetFeature(pDevice, FxRequest, &fSync);
 		break;
+
+	case IOCTL_HID_SET_FEATURE:
+		//
+		// This sends a HID class feature report to a top-level collection of
+		// a HID class device.
+		//
+		status = CyapaSetFeature(pDevice, FxRequest);
+		break;
 	case IOCTL_HID_ACTIVATE_DEVICE:
 		//
 		// Makes the device ready for I/O operations.
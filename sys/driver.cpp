@@ -4,15 +4,137 @@
 #include "ntstrsafe.h"
 #include "hiddevice.h"	
 #include "input.h"
+#include "gesture.h"
 
-void TrackpadRawInput(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc, struct cyapa_regs *regs, int tickinc);
-void SetDefaultSettings(struct csgesture_softc *sc);
-void CyapaTimerFunc(_In_ WDFTIMER hTimer);
+#include <TraceLoggingProvider.h>
 
-#define MAX_FINGERS 15
+void CyapaTimerFunc(_In_ WDFTIMER hTimer);
+VOID CyapaReadWorkItem(IN WDFWORKITEM WorkItem);
 
 //#include "driver.tmh"
 
+//
+// csgesture_sink callbacks, turning engine output into HID reports
+//
+
+C_ASSERT(sizeof(_CYAPA_RELATIVE_MOUSE_REPORT) <= CYAPA_REPORT_MAX_SIZE);
+C_ASSERT(sizeof(_CYAPA_KEYBOARD_REPORT) <= CYAPA_REPORT_MAX_SIZE);
+C_ASSERT(sizeof(_CYAPA_SCROLL_REPORT) <= CYAPA_REPORT_MAX_SIZE);
+
+static void CyapaSinkMouse(void *context, uint8_t buttons, uint8_t x, uint8_t y,
+	uint8_t wheel, uint8_t hwheel) {
+	PDEVICE_CONTEXT pDevice = (PDEVICE_CONTEXT)context;
+	CYAPA_REPORT_WRITER writer;
+
+	if (pDevice->Capture.enabled) {
+		WdfSpinLockAcquire(pDevice->CaptureLock);
+		capture_mouse(&pDevice->Capture, pDevice->sc.frametime, buttons, x, y, wheel, hwheel);
+		WdfSpinLockRelease(pDevice->CaptureLock);
+	}
+
+	_CYAPA_RELATIVE_MOUSE_REPORT *report =
+		(_CYAPA_RELATIVE_MOUSE_REPORT *)CyapaBeginReport(pDevice, sizeof(*report), &writer);
+	if (report == NULL)
+		return;
+	report->ReportID = REPORTID_RELATIVE_MOUSE;
+	report->Button = buttons;
+	report->XValue = x;
+	report->YValue = y;
+	report->WheelPosition = wheel;
+	report->HWheelPosition = hwheel;
+
+	size_t bytesWritten;
+	CyapaCommitReport(pDevice, &writer, &bytesWritten);
+}
+
+static void CyapaSinkKeyboard(void *context, uint8_t shiftKeys, uint8_t *keyCodes) {
+	PDEVICE_CONTEXT pDevice = (PDEVICE_CONTEXT)context;
+	CYAPA_REPORT_WRITER writer;
+
+	if (pDevice->Capture.enabled) {
+		WdfSpinLockAcquire(pDevice->CaptureLock);
+		capture_keyboard(&pDevice->Capture, pDevice->sc.frametime, shiftKeys, keyCodes);
+		WdfSpinLockRelease(pDevice->CaptureLock);
+	}
+
+	_CYAPA_KEYBOARD_REPORT *report =
+		(_CYAPA_KEYBOARD_REPORT *)CyapaBeginReport(pDevice, sizeof(*report), &writer);
+	if (report == NULL)
+		return;
+	report->ReportID = REPORTID_KEYBOARD;
+	report->ShiftKeyFlags = shiftKeys;
+	report->Reserved = 0;
+	for (int i = 0; i < KBD_KEY_CODES; i++){
+		report->KeyCodes[i] = keyCodes[i];
+	}
+
+	size_t bytesWritten;
+	CyapaCommitReport(pDevice, &writer, &bytesWritten);
+}
+
+static void CyapaSinkScroll(void *context, uint8_t flag, uint16_t x1, uint16_t y1,
+	uint16_t x2, uint16_t y2) {
+	PDEVICE_CONTEXT pDevice = (PDEVICE_CONTEXT)context;
+	CYAPA_REPORT_WRITER writer;
+
+	if (pDevice->Capture.enabled) {
+		WdfSpinLockAcquire(pDevice->CaptureLock);
+		capture_scroll(&pDevice->Capture, pDevice->sc.frametime, flag, x1, y1, x2, y2);
+		WdfSpinLockRelease(pDevice->CaptureLock);
+	}
+
+	_CYAPA_SCROLL_REPORT *report =
+		(_CYAPA_SCROLL_REPORT *)CyapaBeginReport(pDevice, sizeof(*report), &writer);
+	if (report == NULL)
+		return;
+	report->ReportID = REPORTID_SCROLL;
+	report->Flag = flag;
+	report->Touch1XValue = x1;
+	report->Touch1YValue = y1;
+	report->Touch2XValue = x2;
+	report->Touch2YValue = y2;
+
+	size_t bytesWritten;
+	CyapaCommitReport(pDevice, &writer, &bytesWritten);
+}
+
+//
+// ETW provider trace events go out on, {5a0b6c8e-3d47-4f1e-9b2c-7e41d0a3f6b9}.
+// TraceLogging needs no generated .tmh files, so the portable engine's
+// events can use it too.
+//
+TRACELOGGING_DEFINE_PROVIDER(CyapaTraceProvider, "Cyapa.Trackpad",
+	(0x5a0b6c8e, 0x3d47, 0x4f1e, 0x9b, 0x2c, 0x7e, 0x41, 0xd0, 0xa3, 0xf6, 0xb9));
+
+//
+// trace_sink callback, events land in the capture ring next to the frames
+//
+
+static void CyapaTraceEvent(void *context, uint8_t id, uint32_t arg0, uint32_t arg1) {
+	PDEVICE_CONTEXT pDevice = (PDEVICE_CONTEXT)context;
+
+	//
+	// Reading the capture out must not refill it
+	//
+	if (id == TRACE_EVENT_REPORT && arg0 == REPORTID_CAPTURE)
+		return;
+
+	if (TraceLoggingProviderEnabled(CyapaTraceProvider, 0, 0)) {
+		TraceLoggingWrite(CyapaTraceProvider, "Event",
+			TraceLoggingPointer(pDevice, "Device"),
+			TraceLoggingUInt8(id, "Id"),
+			TraceLoggingHexUInt32(arg0, "Arg0"),
+			TraceLoggingHexUInt32(arg1, "Arg1"));
+	}
+
+	if (!pDevice->Capture.enabled)
+		return;
+
+	WdfSpinLockAcquire(pDevice->CaptureLock);
+	capture_event(&pDevice->Capture, (uint32_t)(KeQueryInterruptTime() / 10000), id, arg0, arg1);
+	WdfSpinLockRelease(pDevice->CaptureLock);
+}
+
 NTSTATUS
 #pragma prefast(suppress:__WARNING_DRIVER_FUNCTION_TYPE, "thanks, i know this already")
 DriverEntry(
@@ -27,6 +149,7 @@ DriverEntry(
 	WDFDRIVER fxDriver;
 
 	WPP_INIT_TRACING(DriverObject, RegistryPath);
+	TraceLoggingRegister(CyapaTraceProvider);
 
 	FuncEntry(TRACE_FLAG_WDFLOADING);
 
@@ -54,6 +177,11 @@ DriverEntry(
 			TRACE_FLAG_WDFLOADING,
 			"Error creating WDF driver object - %!STATUS!",
 			status);
+
+		//
+		// No driver object, so OnDriverCleanup will not run
+		//
+		TraceLoggingUnregister(CyapaTraceProvider);
 		goto exit;
 	}
 
@@ -78,6 +206,7 @@ OnDriverCleanup(
 
     UNREFERENCED_PARAMETER(Object);
 
+    TraceLoggingUnregister(CyapaTraceProvider);
     WPP_CLEANUP(nullptr);
 
     FuncExit(TRACE_FLAG_WDFLOADING);
@@ -178,7 +307,20 @@ OnDeviceAdd(
         pDevice = GetDeviceContext(fxDevice);
         NT_ASSERT(pDevice != nullptr);
 
-		SetDefaultSettings(&pDevice->sc);
+		pDevice->Sink.context = pDevice;
+		pDevice->Sink.mouse = CyapaSinkMouse;
+		pDevice->Sink.keyboard = CyapaSinkKeyboard;
+		pDevice->Sink.scroll = CyapaSinkScroll;
+
+		pDevice->TraceSink.context = pDevice;
+		pDevice->TraceSink.event = CyapaTraceEvent;
+		pDevice->TraceSink.enabled = CYAPA_TRACE_EVENTS;
+		pDevice->sc.trace = &pDevice->TraceSink;
+		pDevice->I2CContext.TraceSink = &pDevice->TraceSink;
+
+		SetDefaultSettings(&pDevice->Settings.settings);
+		pDevice->sc.settings = pDevice->Settings.settings;
+		pDevice->sc.settingsSequence = pDevice->Settings.sequence;
 
         pDevice->FxDevice = fxDevice;
     }
@@ -308,7 +450,43 @@ OnDeviceAdd(
 	WDFTIMER                      hTimer;
 	WDF_OBJECT_ATTRIBUTES         attributes;
 
-	WDF_TIMER_CONFIG_INIT_PERIODIC(&timerConfig, CyapaTimerFunc, 10);
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = fxDevice;
+	status = WdfSpinLockCreate(&attributes, &pDevice->GestureLock);
+	if (!NT_SUCCESS(status))
+	{
+		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "(%!FUNC!) WdfSpinLockCreate failed status:%!STATUS!\n", status);
+		return status;
+	}
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = fxDevice;
+	status = WdfSpinLockCreate(&attributes, &pDevice->ReportLock);
+	if (!NT_SUCCESS(status))
+	{
+		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "(%!FUNC!) WdfSpinLockCreate failed status:%!STATUS!\n", status);
+		return status;
+	}
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = fxDevice;
+	status = WdfSpinLockCreate(&attributes, &pDevice->CaptureLock);
+	if (!NT_SUCCESS(status))
+	{
+		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "(%!FUNC!) WdfSpinLockCreate failed status:%!STATUS!\n", status);
+		return status;
+	}
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = fxDevice;
+	status = WdfSpinLockCreate(&attributes, &pDevice->SettingsLock);
+	if (!NT_SUCCESS(status))
+	{
+		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "(%!FUNC!) WdfSpinLockCreate failed status:%!STATUS!\n", status);
+		return status;
+	}
+
+	WDF_TIMER_CONFIG_INIT_PERIODIC(&timerConfig, CyapaTimerFunc, CYAPA_TIMER_PERIOD_MS);
 
 	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
 	attributes.ParentObject = fxDevice;
@@ -320,11 +498,28 @@ OnDeviceAdd(
 		return status;
 	}
 
+	WDF_WORKITEM_CONFIG workitemConfig;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = fxDevice;
+	WDF_WORKITEM_CONFIG_INIT(&workitemConfig, CyapaReadWorkItem);
+	status = WdfWorkItemCreate(&workitemConfig, &attributes, &pDevice->ReadWorkItem);
+	if (!NT_SUCCESS(status))
+	{
+		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_PNP, "(%!FUNC!) WdfWorkItemCreate failed status:%!STATUS!\n", status);
+		return status;
+	}
+
 	CyapaPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
 		"Success! 0x%x\n", status);
 
 	pDevice->DeviceMode = DEVICE_MODE_MOUSE;
 
+	LARGE_INTEGER frequency;
+	KeQueryPerformanceCounter(&frequency);
+	pDevice->TicksPerSecond = frequency.QuadPart;
+	pDevice->ProcessOnInterrupt = true;
+
 exit:
 
     FuncExit(TRACE_FLAG_WDFLOADING);
@@ -333,891 +528,402 @@ exit:
 }
 
 
-BOOLEAN OnInterruptIsr(
-	WDFINTERRUPT Interrupt,
-	ULONG MessageID){
-	UNREFERENCED_PARAMETER(MessageID);
-
-	WDFDEVICE Device = WdfInterruptGetDevice(Interrupt);
-	PDEVICE_CONTEXT pDevice = GetDeviceContext(Device);
-
-	if (!pDevice->ConnectInterrupt)
-		return true;
+static void CyapaRefreshSettings(PDEVICE_CONTEXT pDevice) {
+	csgesture_settings_block *block = &pDevice->Settings;
+	LONG sequence = block->sequence;
 
-	CyapaPrint(DEBUG_LEVEL_INFO, DBG_IOCTL, "Interrupt!\n");
+	if (sequence == pDevice->sc.settingsSequence || (sequence & 1))
+		return;
 
-	struct cyapa_regs regs;
-	SpbReadDataSynchronously(&pDevice->I2CContext, 0, &regs, sizeof(regs));
-	pDevice->lastregs = regs;
-	pDevice->RegsSet = true;
-	return true;
-}
+	KeMemoryBarrier();
+	csgesture_settings settings = block->settings;
+	KeMemoryBarrier();
 
-void CyapaTimerFunc(_In_ WDFTIMER hTimer){
-	WDFDEVICE Device = (WDFDEVICE)WdfTimerGetParentObject(hTimer);
-	PDEVICE_CONTEXT pDevice = GetDeviceContext(Device);
-
-	if (!pDevice->ConnectInterrupt)
-		return;
-	if (!pDevice->RegsSet)
+	//
+	// Never spin on the writer here, it may be preempted on this processor.
+	// A torn copy is simply retried on the next frame.
+	//
+	if (block->sequence != sequence)
 		return;
 
-	struct cyapa_regs regs = pDevice->lastregs;
-
-	csgesture_softc sc = pDevice->sc;
-	TrackpadRawInput(pDevice, &sc, &regs, 1);
-	pDevice->sc = sc;
-	return;
+	pDevice->sc.settings = settings;
+	pDevice->sc.settingsSequence = sequence;
 }
 
-static int distancesq(int delta_x, int delta_y){
-	return (delta_x * delta_x) + (delta_y*delta_y);
-}
+static void CyapaSendTouchpadReport(PDEVICE_CONTEXT pDevice, struct cyapa_regs *regs, ULONGLONG timestamp) {
+	CyapaTouchpadReport report;
 
-_CYAPA_RELATIVE_MOUSE_REPORT lastreport;
-
-static void update_relative_mouse(PDEVICE_CONTEXT pDevice, BYTE button,
-	BYTE x, BYTE y, BYTE wheelPosition, BYTE wheelHPosition){
-	_CYAPA_RELATIVE_MOUSE_REPORT report;
-	report.ReportID = REPORTID_RELATIVE_MOUSE;
-	report.Button = button;
-	report.XValue = x;
-	report.YValue = y;
-	report.WheelPosition = wheelPosition;
-	report.HWheelPosition = wheelHPosition;
-	if (report.Button == lastreport.Button &&
-		report.XValue == lastreport.XValue &&
-		report.YValue == lastreport.YValue &&
-		report.WheelPosition == lastreport.WheelPosition &&
-		report.HWheelPosition == lastreport.HWheelPosition)
+	//
+	// Scan time is in 100 us and wraps, the host only looks at differences
+	//
+	if (!touchpad_report(&pDevice->Touchpad, &pDevice->sc, regs, (uint16_t)(timestamp / 1000), &report))
 		return;
-	lastreport = report;
 
 	size_t bytesWritten;
 	CyapaProcessVendorReport(pDevice, &report, sizeof(report), &bytesWritten);
 }
 
-static void update_keyboard(PDEVICE_CONTEXT pDevice, BYTE shiftKeys, BYTE keyCodes[KBD_KEY_CODES]){
-	_CYAPA_KEYBOARD_REPORT report;
-	report.ReportID = REPORTID_KEYBOARD;
-	report.ShiftKeyFlags = shiftKeys;
-	for (int i = 0; i < KBD_KEY_CODES; i++){
-		report.KeyCodes[i] = keyCodes[i];
+static void CyapaProcessFrame(PDEVICE_CONTEXT pDevice, struct cyapa_regs *regs, ULONGLONG timestamp) {
+	if (pDevice->DeviceMode == DEVICE_MODE_TOUCHPAD) {
+		CyapaSendTouchpadReport(pDevice, regs, timestamp);
+		return;
 	}
 
-	size_t bytesWritten;
-	CyapaProcessVendorReport(pDevice, &report, sizeof(report), &bytesWritten);
-}
-
-static void stop_scroll(PDEVICE_CONTEXT pDevice) {
-	_CYAPA_SCROLL_REPORT report;
-	report.ReportID = REPORTID_SCROLL;
-	report.Flag = 1;
-	report.Touch1XValue = 65535;
-	report.Touch1YValue = 65535;
-	report.Touch2XValue = 65535;
-	report.Touch2YValue = 65535;
-
-	size_t bytesWritten;
-	CyapaProcessVendorReport(pDevice, &report, sizeof(report), &bytesWritten);
-}
-
-USHORT filterNegative(int val) {
-	if (val > 0)
-		return val;
-	return 65535;
+	CyapaRefreshSettings(pDevice);
+	TrackpadRawInput(&pDevice->Sink, &pDevice->sc, regs, (uint32_t)(timestamp / 10000));
 }
 
-bool ProcessMove(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, int abovethreshold, int iToUse[3]) {
-	if (abovethreshold == 1 || sc->panningActive) {
-		int i = iToUse[0];
-		if (!sc->panningActive && sc->tick[i] < 5)
-			return false;
+static BOOLEAN CyapaFrameRingPush(PCYAPA_FRAME_RING Ring, struct cyapa_regs *regs, ULONGLONG timestamp, LONGLONG readTicks) {
+	ULONG head = Ring->Head;
+	ULONG depth = head - Ring->Tail;
 
-		stop_scroll(pDevice);
+	if (depth >= CYAPA_FRAME_RING_SIZE) {
+		InterlockedIncrement(&Ring->Overflows);
+		return false;
+	}
 
-		if (sc->panningActive && i == -1)
-			i = sc->idForPanning;
+	PCYAPA_FRAME frame = &Ring->Frames[head & (CYAPA_FRAME_RING_SIZE - 1)];
+	frame->Timestamp = timestamp;
+	frame->ReadTicks = readTicks;
+	frame->Regs = *regs;
 
-		int delta_x = sc->x[i] - sc->lastx[i];
-		int delta_y = sc->y[i] - sc->lasty[i];
+	//
+	// Publish the frame only once its contents are visible to the consumer
+	//
+	InterlockedExchange((volatile LONG *)&Ring->Head, head + 1);
 
-		if (abs(delta_x) > 75 || abs(delta_y) > 75) {
-			delta_x = 0;
-			delta_y = 0;
-		}
+	if ((LONG)(depth + 1) > Ring->HighWater)
+		Ring->HighWater = depth + 1;
+	return true;
+}
 
-		for (int j = 0;j < MAX_FINGERS;j++) {
-			if (j != i) {
-				if (sc->blacklistedids[j] != 1) {
-					if (sc->y[j] > sc->y[i]) {
-						if (sc->truetick[j] > sc->truetick[i] + 15) {
-							sc->blacklistedids[j] = 1;
-						}
-					}
-				}
-			}
-		}
+static BOOLEAN CyapaFrameRingPop(PCYAPA_FRAME_RING Ring, PCYAPA_FRAME Frame) {
+	ULONG tail = Ring->Tail;
 
-		sc->dx = delta_x;
-		sc->dy = delta_y;
+	if (tail == Ring->Head)
+		return false;
 
-		sc->dx *= sc->settings.pointerMultiplier;
-		sc->dx /= 10;
+	KeMemoryBarrier();
+	*Frame = Ring->Frames[tail & (CYAPA_FRAME_RING_SIZE - 1)];
 
-		sc->dy *= sc->settings.pointerMultiplier;
-		sc->dy /= 10;
+	//
+	// Hand the slot back to the producer after it has been copied out
+	//
+	InterlockedExchange((volatile LONG *)&Ring->Tail, tail + 1);
+	return true;
+}
 
-		sc->panningActive = true;
-		sc->idForPanning = i;
-		return true;
+static int CyapaDrainFrames(PDEVICE_CONTEXT pDevice) {
+	CYAPA_FRAME frame;
+	int processed = 0;
+
+	while (CyapaFrameRingPop(&pDevice->FrameRing, &frame)) {
+		pDevice->lastregs = frame.Regs;
+		pDevice->RegsSet = true;
+		CyapaProcessFrame(pDevice, &frame.Regs, frame.Timestamp);
+		CyapaRecordLatency(&pDevice->GestureLatency,
+			CyapaTicks() - frame.ReadTicks, pDevice->TicksPerSecond);
+		processed++;
 	}
-	return false;
+	return processed;
 }
 
-bool ProcessScroll(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, int abovethreshold, int iToUse[3]) {
-	if (!sc->settings.scrollEnabled)
-		return false;
-
-	sc->scrollx = 0;
-	sc->scrolly = 0;
-	if (abovethreshold == 2 || sc->scrollingActive) {
-		int i1 = iToUse[0];
-		int i2 = iToUse[1];
+static void CyapaFrameReady(PDEVICE_CONTEXT pDevice, struct cyapa_regs *regs, ULONGLONG timestamp) {
+	LONGLONG readTicks = CyapaTicks();
 
-		if (!sc->scrollingActive && !sc->scrollInertiaActive) {
-			if (sc->truetick[i1] < 4 && sc->truetick[i2] < 4)
-				return false; 
-		}
+	CyapaRecordLatency(&pDevice->ReadLatency,
+		readTicks - pDevice->ReadStartTicks, pDevice->TicksPerSecond);
+	CyapaFrameRingPush(&pDevice->FrameRing, regs, timestamp, readTicks);
 
-		if (sc->scrollingActive){
-			if (i1 == -1) {
-				if (i2 != sc->idsForScrolling[0])
-					i1 = sc->idsForScrolling[0];
-				else
-					i1 = sc->idsForScrolling[1];
-			}
-			if (i2 == -1) {
-				if (i1 != sc->idsForScrolling[0])
-					i2 = sc->idsForScrolling[0];
-				else
-					i2 = sc->idsForScrolling[1];
-			}
-		}
+	if (InterlockedCompareExchange(&pDevice->TimerParked, 0, 1) == 1) {
+		ULONGLONG parked = timestamp - pDevice->TimerParkTime;
+		InterlockedExchangeAdd(&pDevice->TimerFiresAvoided,
+			(LONG)(parked / (CYAPA_TIMER_PERIOD_MS * 10000)));
+		WdfTimerStart(pDevice->Timer, WDF_REL_TIMEOUT_IN_MS(CYAPA_TIMER_PERIOD_MS));
+	}
 
-		int delta_x1 = sc->x[i1] - sc->lastx[i1];
-		int delta_y1 = sc->y[i1] - sc->lasty[i1];
+	if (pDevice->ProcessOnInterrupt) {
+		//
+		// Handle the new frame right away instead of waiting up to
+		// a full timer period for CyapaTimerFunc to pick it up
+		//
+		WdfSpinLockAcquire(pDevice->GestureLock);
+		if (CyapaDrainFrames(pDevice) > 0)
+			pDevice->FrameProcessedSinceTick = true;
+		WdfSpinLockRelease(pDevice->GestureLock);
+	}
+}
 
-		int delta_x2 = sc->x[i2] - sc->lastx[i2];
-		int delta_y2 = sc->y[i2] - sc->lasty[i2];
+//
+// A frame is the status and finger bytes followed by one record per touch
+// slot, so the first n slots can be fetched without reading the rest
+//
 
-		/*
-		if ((abs(delta_y1) + abs(delta_y2)) > (abs(delta_x1) + abs(delta_x2))) {
-			int avgy = (delta_y1 + delta_y2) / 2;
-			sc->scrolly = avgy;
-		}
-		else {
-			int avgx = (delta_x1 + delta_x2) / 2;
-			sc->scrollx = avgx;
-		}
-		if (abs(sc->scrollx) > 100)
-			sc->scrollx = 0;
-		if (abs(sc->scrolly) > 100)
-			sc->scrolly = 0;
-		if (sc->scrolly > 8)
-			sc->scrolly = sc->scrolly / 8;
-		else if (sc->scrolly > 5)
-			sc->scrolly = 1;
-		else if (sc->scrolly < -8)
-			sc->scrolly = sc->scrolly / 8;
-		else if (sc->scrolly < -5)
-			sc->scrolly = -1;
-		else
-			sc->scrolly = 0;
+#define CYAPA_SLOT_SIZE RTL_FIELD_SIZE(struct cyapa_regs, touch[0])
 
-		if (sc->scrollx > 8) {
-			sc->scrollx = sc->scrollx / 8;
-			sc->scrollx = -sc->scrollx;
-		}
-		else if (sc->scrollx > 5)
-			sc->scrollx = -1;
-		else if (sc->scrollx < -8) {
-			sc->scrollx = sc->scrollx / 8;
-			sc->scrollx = -sc->scrollx;
-		}
-		else if (sc->scrollx < -5)
-			sc->scrollx = 1;
-		else
-			sc->scrollx = 0;*/
+static ULONG CyapaFrameLength(int slots) {
+	return FIELD_OFFSET(struct cyapa_regs, touch) + slots * CYAPA_SLOT_SIZE;
+}
 
-		int scrollx = 0;
-		int scrolly = 0;
+static int CyapaFrameFingers(struct cyapa_regs *regs) {
+	int nfingers = CYAPA_FNGR_NUMFINGERS(regs->fngr);
 
-		if ((abs(delta_y1) + abs(delta_y2)) > (abs(delta_x1) + abs(delta_x2))) {
-			int avgy = (delta_y1 + delta_y2) / 2;
-			scrolly = avgy;
-		}
-		else {
-			int avgx = (delta_x1 + delta_x2) / 2;
-			scrollx = avgx;
-		}
+	if ((regs->stat & CYAPA_STAT_RUNNING) == 0)
+		return 0;
+	if (nfingers > CYAPA_MAX_MT)
+		nfingers = CYAPA_MAX_MT;
+	return nfingers;
+}
 
-		if (abs(scrollx) < 5 && abs(scrolly) < 5 && !sc->scrollingActive)
-			return false;
-
-		_CYAPA_SCROLL_REPORT report;
-		report.ReportID = REPORTID_SCROLL;
-		report.Flag = 0;
-		report.Touch1XValue = filterNegative(sc->x[i1]);
-		report.Touch1YValue = filterNegative(sc->y[i1]);
-		report.Touch2XValue = filterNegative(sc->x[i2]);
-		report.Touch2YValue = filterNegative(sc->y[i2]);
-
-		size_t bytesWritten;
-		CyapaProcessVendorReport(pDevice, &report, sizeof(report), &bytesWritten);
-
-		int fngrcount = 0;
-		int totfingers = 0;
-		for (int i = 0; i < MAX_FINGERS; i++) {
-			if (sc->x[i] != -1) {
-				totfingers++;
-				if (i == i1 || i == i2)
-					fngrcount++;
-			}
-		}
+static int CyapaMissingSlots(PDEVICE_CONTEXT pDevice) {
+	int nfingers = CyapaFrameFingers(&pDevice->ReadRegs);
 
-		if (fngrcount == 2)
-			sc->ticksSinceScrolling = 0;
-		else
-			sc->ticksSinceScrolling++;
-		if (fngrcount == 2 || sc->ticksSinceScrolling <= 5) {
-			sc->scrollingActive = true;
-			if (abovethreshold == 2){
-				sc->idsForScrolling[0] = iToUse[0];
-				sc->idsForScrolling[1] = iToUse[1];
-			}
-		}
-		else {
-			sc->scrollingActive = false;
-			sc->idsForScrolling[0] = -1;
-			sc->idsForScrolling[1] = -1;
-		}
-		return true;
-	}
-	return false;
+	return nfingers > pDevice->ReadSlots ? nfingers - pDevice->ReadSlots : 0;
 }
 
-bool ProcessThreeFingerSwipe(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, int abovethreshold, int iToUse[3]) {
-	if (sc->alttabswitchershowing) {
-		BYTE shiftKeys = KBD_LALT_BIT;
-		BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-		update_keyboard(pDevice, shiftKeys, keyCodes);
-	}
-	if (abovethreshold == 3 || abovethreshold == 4) {
-		stop_scroll(pDevice);
-
-		int i1 = iToUse[0];
-		int delta_x1 = sc->x[i1] - sc->lastx[i1];
-		int delta_y1 = sc->y[i1] - sc->lasty[i1];
-
-		int i2 = iToUse[1];
-		int delta_x2 = sc->x[i2] - sc->lastx[i2];
-		int delta_y2 = sc->y[i2] - sc->lasty[i2];
-
-		int i3 = iToUse[2];
-		int delta_x3 = sc->x[i3] - sc->lastx[i3];
-		int delta_y3 = sc->y[i3] - sc->lasty[i3];
-
-		int avgx = (delta_x1 + delta_x2 + delta_x3) / 3;
-		int avgy = (delta_y1 + delta_y2 + delta_y3) / 3;
-
-		sc->multitaskingx += avgx;
-		sc->multitaskingy += avgy;
-		sc->multitaskinggesturetick++;
-
-		if (sc->multitaskinggesturetick > 5 && !sc->multitaskingdone) {
-			if ((abs(delta_y1) + abs(delta_y2) + abs(delta_y3)) > (abs(delta_x1) + abs(delta_x2) + abs(delta_x3))) {
-				if (abs(sc->multitaskingy) > 15) {
-					if (sc->multitaskingy < 0) {
-						if (sc->alttabswitchershowing) {
-							for (int i = 0; i < 3; i++) {
-								sc->idsforalttab[i] = iToUse[i];
-							}
-
-							BYTE shiftKeys = KBD_LALT_BIT;
-							BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-							keyCodes[0] = 0x52; //Alt + Up
-							update_keyboard(pDevice, shiftKeys, keyCodes);
-							keyCodes[0] = 0x0;
-							update_keyboard(pDevice, shiftKeys, keyCodes);
-							sc->multitaskingx = 0;
-							sc->multitaskingy = 0;
-							sc->multitaskingdone = true;
-						} 
-						else if (abovethreshold == 3 && sc->settings.threeFingerSwipeUpGesture == SwipeUpGestureTaskView ||
-							abovethreshold == 4 && sc->settings.fourFingerSwipeUpGesture == SwipeUpGestureTaskView) {
-							if (abs(sc->multitaskingy) > 50) {
-								BYTE shiftKeys = KBD_LGUI_BIT;
-								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-								keyCodes[0] = 0x2B; //Windows Key + Tab
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								shiftKeys = 0;
-								keyCodes[0] = 0x0;
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								sc->multitaskingx = 0;
-								sc->multitaskingy = 0;
-								sc->multitaskingdone = true;
-							}
-						}
-					}
-					else {
-						if (sc->alttabswitchershowing) {
-							for (int i = 0; i < 3; i++) {
-								sc->idsforalttab[i] = iToUse[i];
-							}
-
-							BYTE shiftKeys = KBD_LALT_BIT;
-							BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-							keyCodes[0] = 0x51; //Alt + Down
-							update_keyboard(pDevice, shiftKeys, keyCodes);
-							keyCodes[0] = 0x0;
-							update_keyboard(pDevice, shiftKeys, keyCodes);
-							sc->multitaskingx = 0;
-							sc->multitaskingy = 0;
-							sc->multitaskingdone = true;
-						}
-						else if (abovethreshold == 3 && sc->settings.threeFingerSwipeDownGesture == SwipeDownGestureShowDesktop ||
-							abovethreshold == 4 && sc->settings.fourFingerSwipeDownGesture == SwipeDownGestureShowDesktop) {
-							if (abs(sc->multitaskingy) > 50) {
-								BYTE shiftKeys = KBD_LGUI_BIT;
-								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-								keyCodes[0] = 0x07;  //Windows Key + D
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								shiftKeys = 0;
-								keyCodes[0] = 0x0;
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								sc->multitaskingx = 0;
-								sc->multitaskingy = 0;
-								sc->multitaskingdone = true;
-							}
-						}
-					}
-				}
-			}
-			else {
-				if (abs(sc->multitaskingx) > 15) {
-					if (sc->multitaskingx > 0) {
-						if ((abovethreshold == 3 && sc->settings.threeFingerSwipeLeftRightGesture == SwipeGestureSwitchWorkspace ||
-							abovethreshold == 4 && sc->settings.fourFingerSwipeLeftRightGesture == SwipeGestureSwitchWorkspace) &&
-							!sc->alttabswitchershowing) {
-							if (abs(sc->multitaskingx) > 50) {
-								BYTE shiftKeys = KBD_LGUI_BIT | KBD_LCONTROL_BIT;
-								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-								keyCodes[0] = 0x50; //Ctrl + Windows Key + Left
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								shiftKeys = 0;
-								keyCodes[0] = 0x0;
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								sc->multitaskingx = 0;
-								sc->multitaskingy = 0;
-								sc->multitaskingdone = true;
-							}
-						}
-						else if (abovethreshold == 3 && sc->settings.threeFingerSwipeLeftRightGesture == SwipeGestureAltTabSwitcher ||
-							abovethreshold == 4 && sc->settings.fourFingerSwipeLeftRightGesture == SwipeGestureAltTabSwitcher ||
-							sc->alttabswitchershowing) {
-							for (int i = 0; i < 3; i++) {
-								sc->idsforalttab[i] = iToUse[i];
-							}
-
-							if (!sc->alttabswitchershowing) {
-								BYTE shiftKeys = KBD_LALT_BIT;
-								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-								keyCodes[0] = 0x2B; //Alt + Tab
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								shiftKeys = KBD_LALT_BIT;
-								keyCodes[0] = 0x0;
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								sc->multitaskingx = 0;
-								sc->multitaskingy = 0;
-								sc->multitaskingdone = true;
-								sc->alttabswitchershowing = true;
-							}
-							else {
-								BYTE shiftKeys = KBD_LALT_BIT;
-								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-								keyCodes[0] = 0x4F; //Alt + Right
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								keyCodes[0] = 0x0;
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								sc->multitaskingx = 0;
-								sc->multitaskingy = 0;
-								sc->multitaskingdone = true;
-							}
-						}
-					}
-					else {
-						if ((abovethreshold == 3 && sc->settings.threeFingerSwipeLeftRightGesture == SwipeGestureSwitchWorkspace ||
-							abovethreshold == 4 && sc->settings.fourFingerSwipeLeftRightGesture == SwipeGestureSwitchWorkspace) &&
-							!sc->alttabswitchershowing) {
-							if (abs(sc->multitaskingx) > 50) {
-								BYTE shiftKeys = KBD_LGUI_BIT | KBD_LCONTROL_BIT;
-								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-								keyCodes[0] = 0x4F; //Ctrl + Windows Key + Right
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								shiftKeys = 0;
-								keyCodes[0] = 0x0;
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								sc->multitaskingx = 0;
-								sc->multitaskingy = 0;
-								sc->multitaskingdone = true;
-							}
-						}
-						else if (abovethreshold == 3 && sc->settings.threeFingerSwipeLeftRightGesture == SwipeGestureAltTabSwitcher ||
-							abovethreshold == 4 && sc->settings.fourFingerSwipeLeftRightGesture == SwipeGestureAltTabSwitcher ||
-							sc->alttabswitchershowing) {
-							for (int i = 0; i < 3; i++) {
-								sc->idsforalttab[i] = iToUse[i];
-							}
-
-							if (!sc->alttabswitchershowing) {
-								BYTE shiftKeys = KBD_LALT_BIT | KBD_LSHIFT_BIT;
-								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-								keyCodes[0] = 0x2B; //Alt + Shift + Tab
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								shiftKeys = KBD_LALT_BIT;
-								keyCodes[0] = 0x0;
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								sc->multitaskingx = 0;
-								sc->multitaskingy = 0;
-								sc->multitaskingdone = true;
-								sc->alttabswitchershowing = true;
-							}
-							else {
-								BYTE shiftKeys = KBD_LALT_BIT;
-								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-								keyCodes[0] = 0x50; //Alt + Left
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								keyCodes[0] = 0x0;
-								update_keyboard(pDevice, shiftKeys, keyCodes);
-								sc->multitaskingx = 0;
-								sc->multitaskingy = 0;
-								sc->multitaskingdone = true;
-							}
-						}
-					}
-				}
-			}
-		}
-		else if (sc->multitaskinggesturetick > 25) {
-			sc->multitaskingx = 0;
-			sc->multitaskingy = 0;
-			sc->multitaskinggesturetick = 0;
-			sc->multitaskingdone = false;
-		}
-		return true;
-	}
-	else {
-		if (sc->alttabswitchershowing) {
-			bool foundTouch = false;
-			for (int i = 0; i < MAX_FINGERS; i++) {
-				if (foundTouch)
-					break;
-				if (sc->x[i] == -1)
-					continue;
-				for (int j = 0; j < 3; j++) {
-					if (i = sc->idsforalttab[j]) {
-						foundTouch = true;
-						break;
-					}
-				}
-			}
-			if (!foundTouch) {
-				BYTE shiftKeys = 0;
-				BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-				keyCodes[0] = 0x0;
-				update_keyboard(pDevice, shiftKeys, keyCodes);
-				sc->alttabswitchershowing = false;
-				for (int i = 0; i < 3; i++) {
-					sc->idsforalttab[i] = -1;
-				}
-			}
-		}
-		sc->multitaskingx = 0;
-		sc->multitaskingy = 0;
-		sc->multitaskinggesturetick = 0;
-		sc->multitaskingdone = false;
-		return false;
-	}
-}
+static void CyapaFrameRead(PDEVICE_CONTEXT pDevice, bool success) {
+	TraceEvent(&pDevice->TraceSink, TRACE_EVENT_READ, success, success ? CyapaFrameFingers(&pDevice->ReadRegs) : 0);
 
-void TapToClickOrDrag(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, int button) {
-	if (!sc->settings.tapToClickEnabled)
-		return;
-	sc->tickssinceclick++;
-	if (sc->mouseDownDueToTap && sc->idForMouseDown == -1) {
-		if (sc->tickssinceclick > 10) {
-			sc->mouseDownDueToTap = false;
-			sc->mousedown = false;
-			sc->buttonmask = 0;
-			//Tap Drag Timed out
-		}
+	if (!success) {
+		//
+		// Fetch every slot next time so a lost follow-up read can't keep
+		// dropping fingers
+		//
+		pDevice->LastFingers = CYAPA_MAX_MT;
+		pDevice->ReadErrors++;
 		return;
 	}
-	if (sc->mousedown) {
-		sc->tickssinceclick = 0;
-		return;
-	}
-
-	for (int i = 0; i < MAX_FINGERS; i++) {
-		if (sc->truetick[i] < 10 && sc->truetick[i] > 0)
-			button++;
-	}
 
-	if (button == 0)
-		return;
-
-	int buttonmask = 0;
-
-	if (sc->scrollInertiaActive) {
-		stop_scroll(pDevice);
-		return;
-	}
+	pDevice->FramesRead++;
+	pDevice->LastFingers = (UCHAR)CyapaFrameFingers(&pDevice->ReadRegs);
 
-	switch (button) {
-	case 1:
-		if (!sc->settings.swapLeftRightFingers)
-			buttonmask = MOUSE_BUTTON_1;
-		else
-			buttonmask = MOUSE_BUTTON_2;
-		break;
-	case 2:
-		if (sc->settings.multiFingerTap) {
-			if (!sc->settings.swapLeftRightFingers)
-				buttonmask = MOUSE_BUTTON_2;
-			else
-				buttonmask = MOUSE_BUTTON_1;
-		}
-		break;
-	case 3:
-		if (sc->settings.multiFingerTap) {
-			if (sc->settings.threeFingerTapAction == ThreeFingerTapActionWheelClick)
-				buttonmask = MOUSE_BUTTON_3;
-			else if (sc->settings.threeFingerTapAction == ThreeFingerTapActionCortana) {
-				buttonmask = 0;
-
-				BYTE shiftKeys = KBD_LGUI_BIT;
-				BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-				keyCodes[0] = 0x06; //Windows Key + C for Cortana
-				update_keyboard(pDevice, shiftKeys, keyCodes);
-				shiftKeys = 0;
-				keyCodes[0] = 0x0;
-				update_keyboard(pDevice, shiftKeys, keyCodes);
-			}
-		}
-		break;
-	case 4:
-		if (sc->settings.fourFingerTapEnabled) {
-			buttonmask = 0;
-
-			BYTE shiftKeys = KBD_LGUI_BIT;
-			BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
-			keyCodes[0] = 0x04; //Windows Key + A for Action Center
-			update_keyboard(pDevice, shiftKeys, keyCodes);
-			shiftKeys = 0;
-			keyCodes[0] = 0x0;
-			update_keyboard(pDevice, shiftKeys, keyCodes);
-		}
-		break;
-	}
-	if (buttonmask != 0 && sc->tickssinceclick > 10 && sc->ticksincelastrelease == 0) {
-		sc->idForMouseDown = -1;
-		sc->mouseDownDueToTap = true;
-		sc->buttonmask = buttonmask;
-		sc->mousebutton = button;
-		sc->mousedown = true;
-		sc->tickssinceclick = 0;
+	if (pDevice->Capture.enabled) {
+		WdfSpinLockAcquire(pDevice->CaptureLock);
+		capture_frame(&pDevice->Capture, (uint32_t)(pDevice->ReadTimestamp / 10000), &pDevice->ReadRegs);
+		WdfSpinLockRelease(pDevice->CaptureLock);
 	}
+	CyapaFrameReady(pDevice, &pDevice->ReadRegs, pDevice->ReadTimestamp);
 }
 
-void ClearTapDrag(PDEVICE_CONTEXT pDevice, csgesture_softc *sc, int i) {
-	if (i == sc->idForMouseDown && sc->mouseDownDueToTap == true) {
-		if (sc->tick[i] < 10) {
-			//Double Tap
-			update_relative_mouse(pDevice, 0, 0, 0, 0, 0);
-			update_relative_mouse(pDevice, sc->buttonmask, 0, 0, 0, 0);
-		}
-		sc->mouseDownDueToTap = false;
-		sc->mousedown = false;
-		sc->buttonmask = 0;
-		sc->idForMouseDown = -1;
-		//Clear Tap Drag
+static void CyapaReadFrameSynchronously(PDEVICE_CONTEXT pDevice) {
+	ULONG length = CyapaFrameLength(pDevice->ReadSlots);
+	NTSTATUS status;
+	int missing;
+
+	status = SpbReadDataSynchronously(&pDevice->I2CContext, 0, &pDevice->ReadRegs, length);
+	if (NT_SUCCESS(status) && (missing = CyapaMissingSlots(pDevice)) > 0) {
+		pDevice->FollowUpReads++;
+		status = SpbReadDataSynchronously(&pDevice->I2CContext, (UCHAR)length,
+			(PUCHAR)&pDevice->ReadRegs + length, missing * CYAPA_SLOT_SIZE);
+		pDevice->ReadSlots += missing;
 	}
+	CyapaFrameRead(pDevice, NT_SUCCESS(status));
 }
 
-void ProcessGesture(PDEVICE_CONTEXT pDevice, csgesture_softc *sc) {
-#pragma mark reset inputs
-	sc->dx = 0;
-	sc->dy = 0;
-
-#pragma mark process touch thresholds
-	int avgx[MAX_FINGERS];
-	int avgy[MAX_FINGERS];
-
-	int abovethreshold = 0;
-	int recentlyadded = 0;
-	int lastrecentlyadded = -1;
-	int iToUse[3] = { -1,-1,-1 };
-	int a = 0;
-
-	int nfingers = 0;
-	for (int i = 0;i < MAX_FINGERS;i++) {
-		if (sc->x[i] != -1)
-			nfingers++;
-	}
+static void CyapaStartRead(PDEVICE_CONTEXT pDevice);
 
-	for (int i = 0;i < MAX_FINGERS;i++) {
-		if (sc->truetick[i] < 30 && sc->truetick[i] != 0) {
-			recentlyadded++;
-			lastrecentlyadded = i;
-		}
-		if (sc->tick[i] == 0)
-			continue;
-		if (sc->blacklistedids[i] == 1)
-			continue;
-		avgx[i] = sc->flextotalx[i] / sc->tick[i];
-		avgy[i] = sc->flextotaly[i] / sc->tick[i];
-		if (distancesq(avgx[i], avgy[i]) > 2) {
-			abovethreshold++;
-			iToUse[a] = i;
-			a++;
-		}
-	}
-
-#pragma mark process different gestures
-	bool handled = false;
-	bool handledByScroll = false;
+VOID CyapaTailReadCompletion(PVOID Context, NTSTATUS Status, PVOID Data, ULONG Length) {
+	PDEVICE_CONTEXT pDevice = (PDEVICE_CONTEXT)Context;
+	int missing = CyapaMissingSlots(pDevice);
+	bool success = NT_SUCCESS(Status) && Length == missing * CYAPA_SLOT_SIZE;
 
-	if (!handled)
-		handled = ProcessThreeFingerSwipe(pDevice, sc, abovethreshold, iToUse);
-	if (!handled)
-		handledByScroll = handled = ProcessScroll(pDevice, sc, abovethreshold, iToUse);
-	if (!handled)
-		handled = ProcessMove(pDevice, sc, abovethreshold, iToUse);
+	if (success) {
+		RtlCopyMemory((PUCHAR)&pDevice->ReadRegs + CyapaFrameLength(pDevice->ReadSlots), Data, Length);
+		pDevice->ReadSlots += missing;
+	}
+	else
+		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Follow-up read failed 0x%x\n", Status);
 
-#pragma mark process clickpad press state
-	int buttonmask = 0;
+	CyapaFrameRead(pDevice, success);
 
-	sc->mousebutton = recentlyadded;
+	InterlockedExchange(&pDevice->ReadInFlight, 0);
+	if (pDevice->ConnectInterrupt)
+		CyapaStartRead(pDevice);
+}
 
-	if (sc->settings.rightClickBottomRight) {
-		if (sc->mousebutton == 1 && lastrecentlyadded != -1) {
-			if (sc->x[lastrecentlyadded] > sc->resx / 2 && sc->y[lastrecentlyadded] > (sc->resy - 60))
-				sc->mousebutton = 2;
+VOID CyapaReadCompletion(PVOID Context, NTSTATUS Status, PVOID Data, ULONG Length) {
+	PDEVICE_CONTEXT pDevice = (PDEVICE_CONTEXT)Context;
+	ULONG length = CyapaFrameLength(pDevice->ReadSlots);
+	bool success = NT_SUCCESS(Status) && Length == length;
+	int missing;
+
+	if (success) {
+		RtlCopyMemory(&pDevice->ReadRegs, Data, Length);
+
+		//
+		// More fingers came down than were read, fetch the extra slots
+		// before handing the frame on
+		//
+		missing = CyapaMissingSlots(pDevice);
+		if (missing > 0) {
+			pDevice->FollowUpReads++;
+			if (SpbReadDataAsynchronously(&pDevice->I2CContext, (UCHAR)length,
+				missing * CYAPA_SLOT_SIZE, CyapaTailReadCompletion, pDevice) == STATUS_PENDING)
+				return;
+			success = false;
 		}
 	}
+	else
+		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL, "Async read failed 0x%x\n", Status);
 
-	if (sc->mousebutton == 0)
-		sc->mousebutton = abovethreshold;
+	CyapaFrameRead(pDevice, success);
 
-	if (sc->mousebutton == 0) {
-		if (sc->panningActive)
-			sc->mousebutton = 1;
-		else
-			sc->mousebutton = nfingers;
-		if (sc->mousebutton == 0 && sc->settings.clickWithNoFingers)
-			sc->mousebutton = 1;
-	}
-	if (sc->mousebutton > 3)
-		sc->mousebutton = 3;
-
-	if (!sc->mouseDownDueToTap) {
-		if (sc->buttondown && !sc->mousedown) {
-			sc->mousedown = true;
-			sc->tickssinceclick = 0;
-
-			switch (sc->mousebutton) {
-			case 1:
-				if (!sc->settings.swapLeftRightFingers)
-					buttonmask = MOUSE_BUTTON_1;
-				else
-					buttonmask = MOUSE_BUTTON_2;
-				break;
-			case 2:
-				if (sc->settings.multiFingerClick) {
-					if (!sc->settings.swapLeftRightFingers)
-						buttonmask = MOUSE_BUTTON_2;
-					else
-						buttonmask = MOUSE_BUTTON_1;
-				}
-				break;
-			case 3:
-				if (sc->settings.multiFingerClick) {
-					buttonmask = MOUSE_BUTTON_3;
-				}
-				break;
-			}
-			sc->buttonmask = buttonmask;
-		}
-		else if (sc->mousedown && !sc->buttondown) {
-			sc->mousedown = false;
-			sc->mousebutton = 0;
-			sc->buttonmask = 0;
-		}
-	}
+	//
+	// Pick up any interrupt that came in while this read was in flight
+	//
+	InterlockedExchange(&pDevice->ReadInFlight, 0);
+	if (pDevice->ConnectInterrupt)
+		CyapaStartRead(pDevice);
+}
 
-#pragma mark shift to last
-	int releasedfingers = 0;
-
-	for (int i = 0;i < MAX_FINGERS;i++) {
-		if (sc->x[i] != -1) {
-			if (sc->lastx[i] == -1) {
-				if (sc->ticksincelastrelease < 10 && sc->mouseDownDueToTap && sc->idForMouseDown == -1) {
-					if (sc->settings.tapDragEnabled)
-						sc->idForMouseDown = i; //Associate Tap Drag
-				}
-			}
-			sc->truetick[i]++;
-			if (sc->tick[i] < 10) {
-				if (sc->lastx[i] != -1) {
-					sc->totalx[i] += abs(sc->x[i] - sc->lastx[i]);
-					sc->totaly[i] += abs(sc->y[i] - sc->lasty[i]);
-					sc->totalp[i] += sc->p[i];
-
-					sc->flextotalx[i] = sc->totalx[i];
-					sc->flextotaly[i] = sc->totaly[i];
-
-					int j = sc->tick[i];
-					sc->xhistory[i][j] = abs(sc->x[i] - sc->lastx[i]);
-					sc->yhistory[i][j] = abs(sc->y[i] - sc->lasty[i]);
-				}
-				sc->tick[i]++;
-			}
-			else if (sc->lastx[i] != -1) {
-				int absx = abs(sc->x[i] - sc->lastx[i]);
-				int absy = abs(sc->y[i] - sc->lasty[i]);
-
-				int newtotalx = sc->flextotalx[i] - sc->xhistory[i][0] + absx;
-				int newtotaly = sc->flextotaly[i] - sc->yhistory[i][0] + absy;
-
-				sc->totalx[i] += absx;
-				sc->totaly[i] += absy;
-
-				sc->flextotalx[i] -= sc->xhistory[i][0];
-				sc->flextotaly[i] -= sc->yhistory[i][0];
-				for (int j = 1;j < 10;j++) {
-					sc->xhistory[i][j - 1] = sc->xhistory[i][j];
-					sc->yhistory[i][j - 1] = sc->yhistory[i][j];
-				}
-				sc->flextotalx[i] += absx;
-				sc->flextotaly[i] += absy;
-
-				int j = 9;
-				sc->xhistory[i][j] = absx;
-				sc->yhistory[i][j] = absy;
-			}
+static void CyapaStartRead(PDEVICE_CONTEXT pDevice) {
+	NTSTATUS status;
+
+	while (InterlockedExchange(&pDevice->ReadPending, 0)) {
+		if (InterlockedCompareExchange(&pDevice->ReadInFlight, 1, 0) != 0) {
+			//
+			// The read in flight will reissue this one once it completes,
+			// unless it already finished in the meantime
+			//
+			InterlockedExchange(&pDevice->ReadPending, 1);
+			if (pDevice->ReadInFlight)
+				return;
+			continue;
 		}
-		if (sc->x[i] == -1) {
-			ClearTapDrag(pDevice, sc, i);
-			if (sc->lastx[i] != -1)
-				sc->ticksincelastrelease = -1;
-			for (int j = 0;j < 10;j++) {
-				sc->xhistory[i][j] = 0;
-				sc->yhistory[i][j] = 0;
-			}
-			if (sc->tick[i] < 10 && sc->tick[i] != 0) {
-				int avgp = sc->totalp[i] / sc->tick[i];
-				if (avgp > 7)
-					releasedfingers++;
-			}
-			sc->totalx[i] = 0;
-			sc->totaly[i] = 0;
-			sc->totalp[i] = 0;
-			sc->tick[i] = 0;
-			sc->truetick[i] = 0;
-
-			sc->blacklistedids[i] = 0;
-
-			if (sc->idForPanning == i) {
-				sc->panningActive = false;
-				sc->idForPanning = -1;
-			}
+
+		pDevice->ReadTimestamp = pDevice->LastInterruptTime;
+		pDevice->ReadStartTicks = pDevice->InterruptTicks;
+		pDevice->ReadSlots = pDevice->AdaptiveReads ? pDevice->LastFingers : CYAPA_MAX_MT;
+		RtlZeroMemory(&pDevice->ReadRegs, sizeof(pDevice->ReadRegs));
+
+		status = SpbReadDataAsynchronously(&pDevice->I2CContext, 0,
+			CyapaFrameLength(pDevice->ReadSlots), CyapaReadCompletion, pDevice);
+		if (status == STATUS_PENDING)
+			return;
+
+		//
+		// No async path (or the bus refused it), fall back to a blocking read.
+		// That is only allowed from the passive-level ISR, not from a completion
+		//
+		if (KeGetCurrentIrql() != PASSIVE_LEVEL) {
+			InterlockedExchange(&pDevice->ReadInFlight, 0);
+			InterlockedExchange(&pDevice->ReadPending, 1);
+			WdfWorkItemEnqueue(pDevice->ReadWorkItem);
+			return;
 		}
-		sc->lastx[i] = sc->x[i];
-		sc->lasty[i] = sc->y[i];
-		sc->lastp[i] = sc->p[i];
+
+		CyapaReadFrameSynchronously(pDevice);
+		InterlockedExchange(&pDevice->ReadInFlight, 0);
 	}
-	sc->ticksincelastrelease++;
+}
 
-#pragma mark process tap to click
-	if (!handledByScroll)
-		TapToClickOrDrag(pDevice, sc, releasedfingers);
+VOID CyapaReadWorkItem(IN WDFWORKITEM WorkItem) {
+	WDFDEVICE Device = (WDFDEVICE)WdfWorkItemGetParentObject(WorkItem);
+	PDEVICE_CONTEXT pDevice = GetDeviceContext(Device);
 
-#pragma mark send to system
-	update_relative_mouse(pDevice, sc->buttonmask, sc->dx, sc->dy, sc->scrolly, sc->scrollx);
+	if (pDevice->ConnectInterrupt)
+		CyapaStartRead(pDevice);
 }
 
-void TrackpadRawInput(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc, struct cyapa_regs *regs, int tickinc){
-	int nfingers;
-	int afingers;	/* actual fingers after culling */
-	int i;
-
-	if ((regs->stat & CYAPA_STAT_RUNNING) == 0) {
-		regs->fngr = 0;
-	}
+BOOLEAN OnInterruptIsr(
+	WDFINTERRUPT Interrupt,
+	ULONG MessageID){
+	UNREFERENCED_PARAMETER(MessageID);
 
-	nfingers = CYAPA_FNGR_NUMFINGERS(regs->fngr);
+	WDFDEVICE Device = WdfInterruptGetDevice(Interrupt);
+	PDEVICE_CONTEXT pDevice = GetDeviceContext(Device);
 
-	for (int i = 0;i < 15;i++) {
-		sc->x[i] = -1;
-		sc->y[i] = -1;
-		sc->p[i] = -1;
-	}
-	for (int i = 0;i < nfingers;i++) {
-		int a = regs->touch[i].id;
-		int x = CYAPA_TOUCH_X(regs, i);
-		int y = CYAPA_TOUCH_Y(regs, i);
-		int p = CYAPA_TOUCH_P(regs, i);
-		sc->x[a] = x;
-		sc->y[a] = y;
-		sc->p[a] = p;
-	}
+	if (!pDevice->ConnectInterrupt)
+		return true;
 
-	sc->buttondown = (regs->fngr & CYAPA_FNGR_LEFT);
+	CyapaPrint(DEBUG_LEVEL_INFO, DBG_IOCTL, "Interrupt!\n");
 
-	ProcessGesture(pDevice, sc);
+	//
+	// Only queue the read here; the frame is decoded from the read
+	// completion so the next interrupt is not held up behind it
+	//
+	pDevice->LastInterruptTime = KeQueryInterruptTime();
+	pDevice->InterruptTicks = CyapaTicks();
+	InterlockedExchange(&pDevice->ReadPending, 1);
+	CyapaStartRead(pDevice);
+	return true;
 }
 
-void SetDefaultSettings(struct csgesture_softc *sc) {
-	sc->settings.pointerMultiplier = 10; //done
-
-	//click settings
-	sc->settings.swapLeftRightFingers = false;
-	sc->settings.clickWithNoFingers = true;
-	sc->settings.multiFingerClick = true;
-	sc->settings.rightClickBottomRight = false;
+//
+// Called with GestureLock held. Frames handled from the interrupt take the
+// lock too, so none can be processed between deciding the pad is idle and
+// parking, which would leave the timer off with a gesture pending.
+//
+static void CyapaParkTimer(PDEVICE_CONTEXT pDevice, WDFTIMER hTimer) {
+	WdfTimerStop(hTimer, FALSE);
+	pDevice->TimerParkTime = KeQueryInterruptTime();
+	InterlockedExchange(&pDevice->TimerParked, 1);
 
-	//tap settings
-	sc->settings.tapToClickEnabled = true;
-	sc->settings.multiFingerTap = true;
-	sc->settings.tapDragEnabled = true;
+	//
+	// A frame queued before TimerParked was set did not re-arm the timer,
+	// so take the timer back and restart it ourselves
+	//
+	if (pDevice->FrameRing.Head != pDevice->FrameRing.Tail &&
+		InterlockedCompareExchange(&pDevice->TimerParked, 0, 1) == 1)
+		WdfTimerStart(hTimer, WDF_REL_TIMEOUT_IN_MS(CYAPA_TIMER_PERIOD_MS));
+}
 
-	sc->settings.threeFingerTapAction = ThreeFingerTapActionCortana;
+void CyapaTimerFunc(_In_ WDFTIMER hTimer){
+	WDFDEVICE Device = (WDFDEVICE)WdfTimerGetParentObject(hTimer);
+	PDEVICE_CONTEXT pDevice = GetDeviceContext(Device);
 
-	sc->settings.fourFingerTapEnabled = true;
+	WdfSpinLockAcquire(pDevice->GestureLock);
+	if (!pDevice->ConnectInterrupt) {
+		//
+		// Nothing is read until the pad is connected again, and the first
+		// frame after that re-arms the timer
+		//
+		CyapaParkTimer(pDevice, hTimer);
+		WdfSpinLockRelease(pDevice->GestureLock);
+		return;
+	}
 
-	//scroll settings
-	sc->settings.scrollEnabled = true;
+	InterlockedIncrement(&pDevice->TimerFires);
 
-	//three finger gestures
-	sc->settings.threeFingerSwipeUpGesture = SwipeUpGestureTaskView;
-	sc->settings.threeFingerSwipeDownGesture = SwipeDownGestureShowDesktop;
-	sc->settings.threeFingerSwipeLeftRightGesture = SwipeGestureAltTabSwitcher;
+	if (CyapaDrainFrames(pDevice) > 0 || !pDevice->RegsSet) {
+		pDevice->FrameProcessedSinceTick = false;
+	}
+	else if (pDevice->DeviceMode == DEVICE_MODE_TOUCHPAD) {
+		//
+		// The host keeps its own timeouts, a replayed frame would only
+		// repeat the last report. Lifts that did not fit in the last
+		// report still have to go out though.
+		//
+		pDevice->FrameProcessedSinceTick = false;
+		if (pDevice->Touchpad.liftmask) {
+			struct cyapa_regs regs = pDevice->lastregs;
+			CyapaProcessFrame(pDevice, &regs, KeQueryInterruptTime());
+		}
+	}
+	else if (pDevice->ProcessOnInterrupt && pDevice->FrameProcessedSinceTick) {
+		//
+		// In interrupt mode the engine already saw every new frame, so only
+		// replay the last one when the pad went quiet to keep timeouts ticking
+		//
+		pDevice->FrameProcessedSinceTick = false;
+	}
+	else {
+		struct cyapa_regs regs = pDevice->lastregs;
+		CyapaProcessFrame(pDevice, &regs, KeQueryInterruptTime());
+	}
 
-	//four finger gestures
-	sc->settings.fourFingerSwipeUpGesture = SwipeUpGestureTaskView;
-	sc->settings.fourFingerSwipeDownGesture = SwipeDownGestureShowDesktop;
-	sc->settings.fourFingerSwipeLeftRightGesture = SwipeGestureSwitchWorkspace;
+	bool idle;
+	if (!pDevice->RegsSet)
+		idle = true;
+	else if (pDevice->DeviceMode == DEVICE_MODE_TOUCHPAD)
+		idle = !pDevice->Touchpad.liftmask;
+	else
+		idle = GestureIdle(&pDevice->sc);
+
+	if (idle)
+		CyapaParkTimer(pDevice, hTimer);
+	WdfSpinLockRelease(pDevice->GestureLock);
+	return;
 }
 
 void ProcessInfo(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc, int infoValue) {
@@ -1235,67 +941,123 @@ void ProcessInfo(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc, int infoVa
 	case 2: //firmware version
 		strcpy((char *)report.Value, sc->firmware_version);
 		break;
-	}
-
-	size_t bytesWritten;
-	CyapaProcessVendorReport(pDevice, &report, sizeof(report), &bytesWritten);
-}
-
-void ProcessSetting(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc, int settingRegister, int settingValue) {
-	switch (settingRegister) {
-	case 0:
-		sc->settings.pointerMultiplier = settingValue;
-		break;
-	case 1:
-		sc->settings.swapLeftRightFingers = settingValue;
-		break;
-	case 2:
-		sc->settings.clickWithNoFingers = settingValue;
-		break;
-	case 3:
-		sc->settings.multiFingerClick = settingValue;
-		break;
-	case 4:
-		sc->settings.rightClickBottomRight = settingValue;
-		break;
-	case 5:
-		sc->settings.tapToClickEnabled = settingValue;
-		break;
-	case 6:
-		sc->settings.multiFingerTap = settingValue;
-		break;
-	case 7:
-		sc->settings.tapDragEnabled = settingValue;
+	case 3: //bus statistics
+		RtlStringCbPrintfA((char *)report.Value, sizeof(report.Value),
+			"%lu frames %lu xfers %I64u bytes %lu extra",
+			pDevice->FramesRead, pDevice->I2CContext.Transfers,
+			pDevice->I2CContext.BytesTransferred, pDevice->FollowUpReads);
 		break;
-	case 8:
-		sc->settings.threeFingerTapAction = (ThreeFingerTapAction)settingValue;
+	case 4: //report statistics
+		RtlStringCbPrintfA((char *)report.Value, sizeof(report.Value),
+			"%lu queued %lu coalesced %lu dropped",
+			pDevice->ReportRing.Queued, pDevice->ReportRing.Coalesced,
+			pDevice->ReportRing.Dropped);
 		break;
-	case 9:
-		sc->settings.fourFingerTapEnabled = settingValue;
+	case 5: //pipeline counters
+		RtlStringCbPrintfA((char *)report.Value, sizeof(report.Value),
+			"%lu frames %ld reports %lu drops %lu spb errors",
+			pDevice->FramesRead, pDevice->ReportsDelivered,
+			pDevice->FrameRing.Overflows + pDevice->ReportRing.Dropped,
+			pDevice->ReadErrors);
 		break;
-	case 10:
-		sc->settings.scrollEnabled = settingValue;
+	case 6: //interrupt to read completion latency histogram
+		C_ASSERT(sizeof(pDevice->ReadLatency.Buckets) <= sizeof(report.Value));
+		RtlCopyMemory(report.Value, (PVOID)pDevice->ReadLatency.Buckets, sizeof(pDevice->ReadLatency.Buckets));
 		break;
-	case 11:
-		sc->settings.threeFingerSwipeUpGesture = (SwipeUpGesture)settingValue;
+	case 7: //read completion to gesture processed latency histogram
+		RtlCopyMemory(report.Value, (PVOID)pDevice->GestureLatency.Buckets, sizeof(pDevice->GestureLatency.Buckets));
 		break;
-	case 12:
-		sc->settings.threeFingerSwipeDownGesture = (SwipeDownGesture)settingValue;
+	case 8: //report to HID read completion latency histogram
+		RtlCopyMemory(report.Value, (PVOID)pDevice->ReportLatency.Buckets, sizeof(pDevice->ReportLatency.Buckets));
 		break;
-	case 13:
-		sc->settings.threeFingerSwipeLeftRightGesture = (SwipeGesture)settingValue;
+	case 9: //same, transition reports only
+		RtlCopyMemory(report.Value, (PVOID)pDevice->TransitionLatency.Buckets, sizeof(pDevice->TransitionLatency.Buckets));
 		break;
-	case 14:
-		sc->settings.fourFingerSwipeUpGesture = (SwipeUpGesture)settingValue;
+	case 10: //same, continuous reports only
+		RtlCopyMemory(report.Value, (PVOID)pDevice->ContinuousLatency.Buckets, sizeof(pDevice->ContinuousLatency.Buckets));
 		break;
-	case 15:
-		sc->settings.fourFingerSwipeDownGesture = (SwipeDownGesture)settingValue;
-		break;
-	case 16:
-		sc->settings.fourFingerSwipeLeftRightGesture = (SwipeGesture)settingValue;
-		break;
-	case 255: //255 is for driver info
+	}
+
+	size_t bytesWritten;
+	CyapaProcessVendorReport(pDevice, &report, sizeof(report), &bytesWritten);
+}
+
+//
+// Sends the next chunk of the capture ring, an empty report once drained
+//
+void ProcessCapture(PDEVICE_CONTEXT pDevice) {
+	_CYAPA_CAPTURE_REPORT report;
+	report.ReportID = REPORTID_CAPTURE;
+	RtlZeroMemory(report.Data, sizeof(report.Data));
+
+	WdfSpinLockAcquire(pDevice->CaptureLock);
+	report.Length = (BYTE)capture_read(&pDevice->Capture, report.Data, sizeof(report.Data));
+	WdfSpinLockRelease(pDevice->CaptureLock);
+
+	size_t bytesWritten;
+	CyapaProcessVendorReport(pDevice, &report, sizeof(report), &bytesWritten);
+}
+
+NTSTATUS ProcessSetting(PDEVICE_CONTEXT pDevice, struct csgesture_softc *sc, int settingRegister, int settingValue) {
+	struct csgesture_settings *settings = &pDevice->Settings.settings;
+
+	if (settingRegister == 255) { //255 is for driver info
 		ProcessInfo(pDevice, sc, settingValue);
-		break;
+		return STATUS_SUCCESS;
+	}
+
+	if (settingRegister == 19) { //capture control
+		WdfSpinLockAcquire(pDevice->CaptureLock);
+		if (settingValue)
+			capture_start(&pDevice->Capture, (uint32_t)(KeQueryInterruptTime() / 10000));
+		else
+			pDevice->Capture.enabled = false;
+		WdfSpinLockRelease(pDevice->CaptureLock);
+		return STATUS_SUCCESS;
+	}
+
+	if (settingRegister == 20) { //read capture
+		ProcessCapture(pDevice);
+		return STATUS_SUCCESS;
+	}
+
+	//
+	// Driver switches rather than engine settings, the engine never sees
+	// them so they leave the settings block alone
+	//
+	if (settingRegister == 17) { //process frames from the interrupt
+		pDevice->ProcessOnInterrupt = settingValue;
+		return STATUS_SUCCESS;
+	}
+
+	if (settingRegister == 18) { //adaptive frame reads
+		pDevice->AdaptiveReads = settingValue;
+		return STATUS_SUCCESS;
 	}
+
+	if (settingRegister == 23) { //trace events, (1 << TRACE_EVENT_xxx) bits
+		InterlockedExchange((volatile LONG *)&pDevice->TraceSink.enabled, settingValue);
+		return STATUS_SUCCESS;
+	}
+
+	//
+	// Two writers bumping the sequence at once could leave it even while
+	// one of them is still halfway through its update. The register is
+	// tried on a copy first, so one the engine does not know leaves the
+	// sequence alone and readers never retry for nothing.
+	//
+	WdfSpinLockAcquire(pDevice->SettingsLock);
+
+	struct csgesture_settings updated = *settings;
+	if (!ApplySetting(&updated, settingRegister, settingValue)) {
+		WdfSpinLockRelease(pDevice->SettingsLock);
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	InterlockedIncrement(&pDevice->Settings.sequence);
+	*settings = updated;
+	InterlockedIncrement(&pDevice->Settings.sequence);
+
+	WdfSpinLockRelease(pDevice->SettingsLock);
+	return STATUS_SUCCESS;
 }
\ No newline at end of file
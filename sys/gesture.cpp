@@ -0,0 +1,1422 @@
+//
+// System headers go first so their abs() is declared before the one in
+// stdint.h, the same order the driver sources get from wdm.h
+//
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//
+// SSE2 is always there on x64 and kernel code may use the xmm registers
+// freely there, so the contact kernel uses it by default. 32 bit x86
+// would need KeSaveFloatingPointState and gets the scalar path, as does
+// anything else without SSE2.
+//
+#ifndef CSGESTURE_SIMD
+#if defined(_M_X64) || (defined(__SSE2__) && defined(__x86_64__))
+#define CSGESTURE_SIMD 1
+#else
+#define CSGESTURE_SIMD 0
+#endif
+#endif
+
+#if CSGESTURE_SIMD
+#include <emmintrin.h>
+#include <stddef.h>
+#endif
+
+#include "gesture.h"
+
+//
+// hidcommon.h only needs these two from the Windows headers
+//
+typedef uint8_t BYTE;
+typedef uint16_t USHORT;
+
+#include "hidcommon.h"
+#include "tracesink.h"
+
+#define MAX_FINGERS 15
+
+//
+// Contact masks carry bit i for slot i. Hot loops walk the set bits
+// instead of testing every slot for -1.
+//
+#define CONTACT_BIT(i) (1u << (i))
+
+static int contactcount(uint32_t mask) {
+	int count = 0;
+	for (; mask; mask &= mask - 1)
+		count++;
+	return count;
+}
+
+static int lowestcontact(uint32_t mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+static int highestcontact(uint32_t mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, mask);
+	return (int)index;
+#else
+	return 31 - __builtin_clz(mask);
+#endif
+}
+
+//
+// Runs the body once per set bit of mask, lowest slot first, with i set
+// to the slot
+//
+#define FOR_EACH_CONTACT(i, mask) \
+	for (uint32_t _contacts = (mask); _contacts && ((i) = lowestcontact(_contacts), true); _contacts &= _contacts - 1)
+
+#if !CSGESTURE_SIMD
+//
+// Only the scalar contact kernel measures distances, the SIMD one compares
+// the window totals directly
+//
+static int distancesq(int delta_x, int delta_y){
+	return (delta_x * delta_x) + (delta_y*delta_y);
+}
+#endif
+
+//
+// Milliseconds since the contact went down, 0 if it was not present
+// on the previous frame
+//
+static int contactage(csgesture_softc *sc, int i) {
+	if (sc->contacts[i].lastx == -1)
+		return 0;
+	return (int)(sc->frametime - sc->contacts[i].downtime);
+}
+
+//
+// Motion per CSGESTURE_FRAME_MS, so the window averages do not depend on
+// how often frames arrive
+//
+static int normalizespeed(int delta, int interval) {
+	return (delta * CSGESTURE_FRAME_MS + interval / 2) / interval;
+}
+
+//
+// ms since the previous frame, at least 1
+//
+static int frameinterval(csgesture_softc *sc) {
+	int interval = (int)(sc->frametime - sc->lastframetime);
+
+	return interval < 1 ? 1 : interval;
+}
+
+static BYTE clamp_relative(int value) {
+	if (value > RELATIVE_MOUSE_MAX_COORDINATE)
+		return RELATIVE_MOUSE_MAX_COORDINATE;
+	if (value < RELATIVE_MOUSE_MIN_COORDINATE)
+		return (BYTE)RELATIVE_MOUSE_MIN_COORDINATE;
+	return (BYTE)value;
+}
+
+static void update_relative_mouse(struct csgesture_sink *sink, csgesture_softc *sc, BYTE button,
+	int x, int y, BYTE wheelPosition, BYTE wheelHPosition){
+	//
+	// Only an idle report repeating the last buttons is redundant, repeated
+	// motion is still motion
+	//
+	if (x == 0 && y == 0 && wheelPosition == 0 && wheelHPosition == 0 &&
+		button == sc->lastreportbuttons)
+		return;
+	sc->lastreportbuttons = button;
+
+	//
+	// Moves beyond what a report can hold are split over several reports
+	// rather than wrapping around
+	//
+	do {
+		BYTE stepx = clamp_relative(x);
+		BYTE stepy = clamp_relative(y);
+		x -= (int8_t)stepx;
+		y -= (int8_t)stepy;
+
+		sink->mouse(sink->context, button, stepx, stepy, wheelPosition, wheelHPosition);
+
+		wheelPosition = 0;
+		wheelHPosition = 0;
+	} while (x != 0 || y != 0);
+}
+
+static void update_keyboard(struct csgesture_sink *sink, BYTE shiftKeys, BYTE keyCodes[KBD_KEY_CODES]){
+	sink->keyboard(sink->context, shiftKeys, keyCodes);
+}
+
+static void stop_scroll(struct csgesture_sink *sink) {
+	sink->scroll(sink->context, 1, 65535, 65535, 65535, 65535);
+}
+
+//
+// Pad units of two finger travel per wheel notch in ScrollModeWheel
+//
+#define WHEEL_UNITS_PER_NOTCH 64
+
+//
+// Adds the wheel counts for a scroll delta to the current counts. With the
+// host's resolution multiplier on a count is a fraction of a notch. Travel
+// short of a count, or beyond what one report can hold, is carried.
+//
+static int wheelcounts(int current, int delta, int *remainder, bool highres) {
+	int unitspercount = WHEEL_UNITS_PER_NOTCH;
+	if (highres)
+		unitspercount /= MOUSE_WHEEL_MULTIPLIER;
+
+	int total = delta + *remainder;
+	int counts = total / unitspercount;
+	if (current + counts > RELATIVE_MOUSE_MAX_COORDINATE)
+		counts = RELATIVE_MOUSE_MAX_COORDINATE - current;
+	else if (current + counts < RELATIVE_MOUSE_MIN_COORDINATE)
+		counts = RELATIVE_MOUSE_MIN_COORDINATE - current;
+
+	*remainder = total - counts * unitspercount;
+	return current + counts;
+}
+
+//
+// Fling speeds, in 1/256 pad units per CSGESTURE_FRAME_MS: a release has to
+// be this fast to start one, and it ends once it has slowed down to this
+//
+#define FLING_START_VELOCITY (4 * 256)
+#define FLING_STOP_VELOCITY 64
+
+//
+// Smoothed scroll velocity, weighted towards the latest frames so a pause
+// before lifting leaves nothing to fling
+//
+static void trackvelocity(csgesture_softc *sc, int wheelx, int wheely) {
+	int interval = frameinterval(sc);
+
+	sc->flingvelx = (sc->flingvelx + normalizespeed(wheelx * 256, interval)) / 2;
+	sc->flingvely = (sc->flingvely + normalizespeed(wheely * 256, interval)) / 2;
+}
+
+static void startfling(csgesture_softc *sc) {
+	if (sc->settings.scrollFriction <= 0)
+		return;
+	if (abs(sc->flingvelx) < FLING_START_VELOCITY && abs(sc->flingvely) < FLING_START_VELOCITY)
+		return;
+
+	sc->flinging = true;
+	sc->flingtravelx = 0;
+	sc->flingtravely = 0;
+}
+
+static void stopfling(csgesture_softc *sc) {
+	sc->flinging = false;
+	sc->flingvelx = 0;
+	sc->flingvely = 0;
+}
+
+//
+// Advances a fling by the time since the last frame. Frames keep coming
+// from the timer while one runs, GestureIdle holds it off parking.
+//
+void ProcessFling(csgesture_softc *sc) {
+	if (!sc->flinging)
+		return;
+
+	//
+	// Anything landing on the pad or a click stops it dead
+	//
+	if ((sc->activemask & ~sc->lastactivemask) || sc->buttondown ||
+		!sc->settings.scrollEnabled || sc->settings.scrollMode != ScrollModeWheel) {
+		stopfling(sc);
+		return;
+	}
+
+	int friction = sc->settings.scrollFriction;
+	if (friction > 999)
+		friction = 999;
+
+	int interval = (int)(sc->frametime - sc->lastframetime);
+	int steps = (interval + CSGESTURE_FRAME_MS / 2) / CSGESTURE_FRAME_MS;
+	if (steps < 1)
+		steps = 1;
+	else if (steps > 100)
+		steps = 100;
+
+	for (int step = 0; step < steps; step++) {
+		sc->flingvelx = sc->flingvelx * friction / 1000;
+		sc->flingvely = sc->flingvely * friction / 1000;
+		sc->flingtravelx += sc->flingvelx;
+		sc->flingtravely += sc->flingvely;
+	}
+
+	int unitsx = sc->flingtravelx / 256;
+	int unitsy = sc->flingtravely / 256;
+	sc->flingtravelx -= unitsx * 256;
+	sc->flingtravely -= unitsy * 256;
+
+	sc->scrollx = wheelcounts(sc->scrollx, unitsx, &sc->hwheelremainder,
+		(sc->wheelmultipliers & MOUSE_WHEEL_MULTIPLIER_HORIZONTAL) != 0);
+	sc->scrolly = wheelcounts(sc->scrolly, unitsy, &sc->wheelremainder,
+		(sc->wheelmultipliers & MOUSE_WHEEL_MULTIPLIER_VERTICAL) != 0);
+
+	if (abs(sc->flingvelx) < FLING_STOP_VELOCITY && abs(sc->flingvely) < FLING_STOP_VELOCITY)
+		stopfling(sc);
+}
+
+static USHORT filterNegative(int val) {
+	if (val > 0)
+		return val;
+	return 65535;
+}
+
+bool ProcessMove(struct csgesture_sink *sink, csgesture_softc *sc, int abovethreshold, int iToUse[3]) {
+	if (abovethreshold == 1 || sc->panningActive) {
+		int i = iToUse[0];
+		if (!sc->panningActive && contactage(sc, i) < 50)
+			return false;
+
+		stop_scroll(sink);
+
+		if (sc->panningActive && i == -1)
+			i = sc->idForPanning;
+
+		int delta_x = sc->contacts[i].x - sc->contacts[i].lastx;
+		int delta_y = sc->contacts[i].y - sc->contacts[i].lasty;
+
+		//
+		// Faster than 75 units per CSGESTURE_FRAME_MS is a sensor glitch
+		//
+		int interval = frameinterval(sc);
+		if (normalizespeed(abs(delta_x), interval) > 75 || normalizespeed(abs(delta_y), interval) > 75) {
+			delta_x = 0;
+			delta_y = 0;
+		}
+
+		int j;
+		FOR_EACH_CONTACT(j, sc->activemask & ~sc->blacklistmask & ~CONTACT_BIT(i)) {
+			if (sc->contacts[j].y > sc->contacts[i].y) {
+				if (contactage(sc, j) > contactage(sc, i) + 150) {
+					sc->blacklistmask |= CONTACT_BIT(j);
+				}
+			}
+		}
+
+		if (!sc->panningActive) {
+			sc->dxremainder = 0;
+			sc->dyremainder = 0;
+		}
+
+		//
+		// Scale in tenths and carry whatever doesn't make a whole count over
+		// to the next frame, so slow moves are not rounded away
+		//
+		int scaledx = delta_x * sc->settings.pointerMultiplier + sc->dxremainder;
+		int scaledy = delta_y * sc->settings.pointerMultiplier + sc->dyremainder;
+
+		sc->dx = scaledx / 10;
+		sc->dy = scaledy / 10;
+
+		sc->dxremainder = scaledx - sc->dx * 10;
+		sc->dyremainder = scaledy - sc->dy * 10;
+
+		sc->panningActive = true;
+		sc->idForPanning = i;
+		return true;
+	}
+	return false;
+}
+
+bool ProcessScroll(struct csgesture_sink *sink, csgesture_softc *sc, int abovethreshold, int iToUse[3]) {
+	if (!sc->settings.scrollEnabled)
+		return false;
+
+	sc->scrollx = 0;
+	sc->scrolly = 0;
+	if (abovethreshold == 2 || sc->scrollingActive) {
+		int i1 = iToUse[0];
+		int i2 = iToUse[1];
+
+		if (!sc->scrollingActive && !sc->scrollInertiaActive) {
+			if (contactage(sc, i1) < 40 && contactage(sc, i2) < 40)
+				return false; 
+		}
+
+		if (sc->scrollingActive){
+			if (i1 == -1) {
+				if (i2 != sc->idsForScrolling[0])
+					i1 = sc->idsForScrolling[0];
+				else
+					i1 = sc->idsForScrolling[1];
+			}
+			if (i2 == -1) {
+				if (i1 != sc->idsForScrolling[0])
+					i2 = sc->idsForScrolling[0];
+				else
+					i2 = sc->idsForScrolling[1];
+			}
+		}
+
+		//
+		// A finger that just lifted has no position to move from
+		//
+		int delta_x1 = 0, delta_y1 = 0;
+		if (sc->contacts[i1].x != -1 && sc->contacts[i1].lastx != -1) {
+			delta_x1 = sc->contacts[i1].x - sc->contacts[i1].lastx;
+			delta_y1 = sc->contacts[i1].y - sc->contacts[i1].lasty;
+		}
+
+		int delta_x2 = 0, delta_y2 = 0;
+		if (sc->contacts[i2].x != -1 && sc->contacts[i2].lastx != -1) {
+			delta_x2 = sc->contacts[i2].x - sc->contacts[i2].lastx;
+			delta_y2 = sc->contacts[i2].y - sc->contacts[i2].lasty;
+		}
+
+		/*
+		if ((abs(delta_y1) + abs(delta_y2)) > (abs(delta_x1) + abs(delta_x2))) {
+			int avgy = (delta_y1 + delta_y2) / 2;
+			sc->scrolly = avgy;
+		}
+		else {
+			int avgx = (delta_x1 + delta_x2) / 2;
+			sc->scrollx = avgx;
+		}
+		if (abs(sc->scrollx) > 100)
+			sc->scrollx = 0;
+		if (abs(sc->scrolly) > 100)
+			sc->scrolly = 0;
+		if (sc->scrolly > 8)
+			sc->scrolly = sc->scrolly / 8;
+		else if (sc->scrolly > 5)
+			sc->scrolly = 1;
+		else if (sc->scrolly < -8)
+			sc->scrolly = sc->scrolly / 8;
+		else if (sc->scrolly < -5)
+			sc->scrolly = -1;
+		else
+			sc->scrolly = 0;
+
+		if (sc->scrollx > 8) {
+			sc->scrollx = sc->scrollx / 8;
+			sc->scrollx = -sc->scrollx;
+		}
+		else if (sc->scrollx > 5)
+			sc->scrollx = -1;
+		else if (sc->scrollx < -8) {
+			sc->scrollx = sc->scrollx / 8;
+			sc->scrollx = -sc->scrollx;
+		}
+		else if (sc->scrollx < -5)
+			sc->scrollx = 1;
+		else
+			sc->scrollx = 0;*/
+
+		int scrollx = 0;
+		int scrolly = 0;
+
+		if ((abs(delta_y1) + abs(delta_y2)) > (abs(delta_x1) + abs(delta_x2))) {
+			int avgy = (delta_y1 + delta_y2) / 2;
+			scrolly = avgy;
+		}
+		else {
+			int avgx = (delta_x1 + delta_x2) / 2;
+			scrollx = avgx;
+		}
+
+		//
+		// Scrolling starts at 5 units per CSGESTURE_FRAME_MS
+		//
+		int interval = frameinterval(sc);
+		if (normalizespeed(abs(scrollx), interval) < 5 && normalizespeed(abs(scrolly), interval) < 5 &&
+			!sc->scrollingActive)
+			return false;
+
+		int fngrcount = contactcount(sc->activemask & (CONTACT_BIT(i1) | CONTACT_BIT(i2)));
+
+		if (sc->settings.scrollMode == ScrollModeWheel) {
+			if (!sc->scrollingActive) {
+				sc->wheelremainder = 0;
+				sc->hwheelremainder = 0;
+				sc->flingvelx = 0;
+				sc->flingvely = 0;
+			}
+
+			//
+			// Content follows the fingers: down is wheel up, right is pan left
+			//
+			sc->scrolly = wheelcounts(0, scrolly, &sc->wheelremainder,
+				(sc->wheelmultipliers & MOUSE_WHEEL_MULTIPLIER_VERTICAL) != 0);
+			sc->scrollx = wheelcounts(0, -scrollx, &sc->hwheelremainder,
+				(sc->wheelmultipliers & MOUSE_WHEEL_MULTIPLIER_HORIZONTAL) != 0);
+
+			//
+			// Fling off with the speed the fingers had on the frame one of
+			// them lifted
+			//
+			if (fngrcount == 2)
+				trackvelocity(sc, -scrollx, scrolly);
+			else if (sc->scrollingActive && sc->lastScrollTime == sc->lastframetime)
+				startfling(sc);
+		}
+		else {
+			sink->scroll(sink->context, 0,
+				filterNegative(sc->contacts[i1].x), filterNegative(sc->contacts[i1].y),
+				filterNegative(sc->contacts[i2].x), filterNegative(sc->contacts[i2].y));
+		}
+
+		if (fngrcount == 2)
+			sc->lastScrollTime = sc->frametime;
+		if (fngrcount == 2 || sc->frametime - sc->lastScrollTime <= 50) {
+			sc->scrollingActive = true;
+			if (abovethreshold == 2){
+				sc->idsForScrolling[0] = iToUse[0];
+				sc->idsForScrolling[1] = iToUse[1];
+			}
+		}
+		else {
+			sc->scrollingActive = false;
+			sc->idsForScrolling[0] = -1;
+			sc->idsForScrolling[1] = -1;
+		}
+		return true;
+	}
+	return false;
+}
+
+bool ProcessThreeFingerSwipe(struct csgesture_sink *sink, csgesture_softc *sc, int abovethreshold, int iToUse[3]) {
+	if (sc->alttabswitchershowing) {
+		BYTE shiftKeys = KBD_LALT_BIT;
+		BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+		update_keyboard(sink, shiftKeys, keyCodes);
+	}
+	if (abovethreshold == 3 || abovethreshold == 4) {
+		stop_scroll(sink);
+
+		int i1 = iToUse[0];
+		int delta_x1 = sc->contacts[i1].x - sc->contacts[i1].lastx;
+		int delta_y1 = sc->contacts[i1].y - sc->contacts[i1].lasty;
+
+		int i2 = iToUse[1];
+		int delta_x2 = sc->contacts[i2].x - sc->contacts[i2].lastx;
+		int delta_y2 = sc->contacts[i2].y - sc->contacts[i2].lasty;
+
+		int i3 = iToUse[2];
+		int delta_x3 = sc->contacts[i3].x - sc->contacts[i3].lastx;
+		int delta_y3 = sc->contacts[i3].y - sc->contacts[i3].lasty;
+
+		if (!sc->multitaskinggesturestarted) {
+			sc->multitaskinggesturestarted = true;
+			sc->multitaskinggesturestart = sc->frametime;
+			sc->multitaskingremx = 0;
+			sc->multitaskingremy = 0;
+		}
+
+		//
+		// Carry what the average drops, at high report rates the per-frame
+		// deltas are small enough for the truncation to eat the swipe
+		//
+		int sumx = delta_x1 + delta_x2 + delta_x3 + sc->multitaskingremx;
+		int sumy = delta_y1 + delta_y2 + delta_y3 + sc->multitaskingremy;
+		int avgx = sumx / 3;
+		int avgy = sumy / 3;
+
+		sc->multitaskingremx = sumx - avgx * 3;
+		sc->multitaskingremy = sumy - avgy * 3;
+		sc->multitaskingx += avgx;
+		sc->multitaskingy += avgy;
+		uint32_t multitaskingelapsed = sc->frametime - sc->multitaskinggesturestart;
+
+		if (multitaskingelapsed >= 50 && !sc->multitaskingdone) {
+			if ((abs(delta_y1) + abs(delta_y2) + abs(delta_y3)) > (abs(delta_x1) + abs(delta_x2) + abs(delta_x3))) {
+				if (abs(sc->multitaskingy) > 15) {
+					if (sc->multitaskingy < 0) {
+						if (sc->alttabswitchershowing) {
+							for (int i = 0; i < 3; i++) {
+								sc->idsforalttab[i] = iToUse[i];
+							}
+
+							BYTE shiftKeys = KBD_LALT_BIT;
+							BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+							keyCodes[0] = 0x52; //Alt + Up
+							update_keyboard(sink, shiftKeys, keyCodes);
+							keyCodes[0] = 0x0;
+							update_keyboard(sink, shiftKeys, keyCodes);
+							sc->multitaskingx = 0;
+							sc->multitaskingy = 0;
+							sc->multitaskingdone = true;
+						} 
+						else if (abovethreshold == 3 && sc->settings.threeFingerSwipeUpGesture == SwipeUpGestureTaskView ||
+							abovethreshold == 4 && sc->settings.fourFingerSwipeUpGesture == SwipeUpGestureTaskView) {
+							if (abs(sc->multitaskingy) > 50) {
+								BYTE shiftKeys = KBD_LGUI_BIT;
+								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+								keyCodes[0] = 0x2B; //Windows Key + Tab
+								update_keyboard(sink, shiftKeys, keyCodes);
+								shiftKeys = 0;
+								keyCodes[0] = 0x0;
+								update_keyboard(sink, shiftKeys, keyCodes);
+								sc->multitaskingx = 0;
+								sc->multitaskingy = 0;
+								sc->multitaskingdone = true;
+							}
+						}
+					}
+					else {
+						if (sc->alttabswitchershowing) {
+							for (int i = 0; i < 3; i++) {
+								sc->idsforalttab[i] = iToUse[i];
+							}
+
+							BYTE shiftKeys = KBD_LALT_BIT;
+							BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+							keyCodes[0] = 0x51; //Alt + Down
+							update_keyboard(sink, shiftKeys, keyCodes);
+							keyCodes[0] = 0x0;
+							update_keyboard(sink, shiftKeys, keyCodes);
+							sc->multitaskingx = 0;
+							sc->multitaskingy = 0;
+							sc->multitaskingdone = true;
+						}
+						else if (abovethreshold == 3 && sc->settings.threeFingerSwipeDownGesture == SwipeDownGestureShowDesktop ||
+							abovethreshold == 4 && sc->settings.fourFingerSwipeDownGesture == SwipeDownGestureShowDesktop) {
+							if (abs(sc->multitaskingy) > 50) {
+								BYTE shiftKeys = KBD_LGUI_BIT;
+								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+								keyCodes[0] = 0x07;  //Windows Key + D
+								update_keyboard(sink, shiftKeys, keyCodes);
+								shiftKeys = 0;
+								keyCodes[0] = 0x0;
+								update_keyboard(sink, shiftKeys, keyCodes);
+								sc->multitaskingx = 0;
+								sc->multitaskingy = 0;
+								sc->multitaskingdone = true;
+							}
+						}
+					}
+				}
+			}
+			else {
+				if (abs(sc->multitaskingx) > 15) {
+					if (sc->multitaskingx > 0) {
+						if ((abovethreshold == 3 && sc->settings.threeFingerSwipeLeftRightGesture == SwipeGestureSwitchWorkspace ||
+							abovethreshold == 4 && sc->settings.fourFingerSwipeLeftRightGesture == SwipeGestureSwitchWorkspace) &&
+							!sc->alttabswitchershowing) {
+							if (abs(sc->multitaskingx) > 50) {
+								BYTE shiftKeys = KBD_LGUI_BIT | KBD_LCONTROL_BIT;
+								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+								keyCodes[0] = 0x50; //Ctrl + Windows Key + Left
+								update_keyboard(sink, shiftKeys, keyCodes);
+								shiftKeys = 0;
+								keyCodes[0] = 0x0;
+								update_keyboard(sink, shiftKeys, keyCodes);
+								sc->multitaskingx = 0;
+								sc->multitaskingy = 0;
+								sc->multitaskingdone = true;
+							}
+						}
+						else if (abovethreshold == 3 && sc->settings.threeFingerSwipeLeftRightGesture == SwipeGestureAltTabSwitcher ||
+							abovethreshold == 4 && sc->settings.fourFingerSwipeLeftRightGesture == SwipeGestureAltTabSwitcher ||
+							sc->alttabswitchershowing) {
+							for (int i = 0; i < 3; i++) {
+								sc->idsforalttab[i] = iToUse[i];
+							}
+
+							if (!sc->alttabswitchershowing) {
+								BYTE shiftKeys = KBD_LALT_BIT;
+								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+								keyCodes[0] = 0x2B; //Alt + Tab
+								update_keyboard(sink, shiftKeys, keyCodes);
+								shiftKeys = KBD_LALT_BIT;
+								keyCodes[0] = 0x0;
+								update_keyboard(sink, shiftKeys, keyCodes);
+								sc->multitaskingx = 0;
+								sc->multitaskingy = 0;
+								sc->multitaskingdone = true;
+								sc->alttabswitchershowing = true;
+							}
+							else {
+								BYTE shiftKeys = KBD_LALT_BIT;
+								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+								keyCodes[0] = 0x4F; //Alt + Right
+								update_keyboard(sink, shiftKeys, keyCodes);
+								keyCodes[0] = 0x0;
+								update_keyboard(sink, shiftKeys, keyCodes);
+								sc->multitaskingx = 0;
+								sc->multitaskingy = 0;
+								sc->multitaskingdone = true;
+							}
+						}
+					}
+					else {
+						if ((abovethreshold == 3 && sc->settings.threeFingerSwipeLeftRightGesture == SwipeGestureSwitchWorkspace ||
+							abovethreshold == 4 && sc->settings.fourFingerSwipeLeftRightGesture == SwipeGestureSwitchWorkspace) &&
+							!sc->alttabswitchershowing) {
+							if (abs(sc->multitaskingx) > 50) {
+								BYTE shiftKeys = KBD_LGUI_BIT | KBD_LCONTROL_BIT;
+								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+								keyCodes[0] = 0x4F; //Ctrl + Windows Key + Right
+								update_keyboard(sink, shiftKeys, keyCodes);
+								shiftKeys = 0;
+								keyCodes[0] = 0x0;
+								update_keyboard(sink, shiftKeys, keyCodes);
+								sc->multitaskingx = 0;
+								sc->multitaskingy = 0;
+								sc->multitaskingdone = true;
+							}
+						}
+						else if (abovethreshold == 3 && sc->settings.threeFingerSwipeLeftRightGesture == SwipeGestureAltTabSwitcher ||
+							abovethreshold == 4 && sc->settings.fourFingerSwipeLeftRightGesture == SwipeGestureAltTabSwitcher ||
+							sc->alttabswitchershowing) {
+							for (int i = 0; i < 3; i++) {
+								sc->idsforalttab[i] = iToUse[i];
+							}
+
+							if (!sc->alttabswitchershowing) {
+								BYTE shiftKeys = KBD_LALT_BIT | KBD_LSHIFT_BIT;
+								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+								keyCodes[0] = 0x2B; //Alt + Shift + Tab
+								update_keyboard(sink, shiftKeys, keyCodes);
+								shiftKeys = KBD_LALT_BIT;
+								keyCodes[0] = 0x0;
+								update_keyboard(sink, shiftKeys, keyCodes);
+								sc->multitaskingx = 0;
+								sc->multitaskingy = 0;
+								sc->multitaskingdone = true;
+								sc->alttabswitchershowing = true;
+							}
+							else {
+								BYTE shiftKeys = KBD_LALT_BIT;
+								BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+								keyCodes[0] = 0x50; //Alt + Left
+								update_keyboard(sink, shiftKeys, keyCodes);
+								keyCodes[0] = 0x0;
+								update_keyboard(sink, shiftKeys, keyCodes);
+								sc->multitaskingx = 0;
+								sc->multitaskingy = 0;
+								sc->multitaskingdone = true;
+							}
+						}
+					}
+				}
+			}
+		}
+		else if (multitaskingelapsed >= 250) {
+			sc->multitaskingx = 0;
+			sc->multitaskingy = 0;
+			sc->multitaskinggesturestarted = false;
+			sc->multitaskingdone = false;
+		}
+		return true;
+	}
+	else {
+		if (sc->alttabswitchershowing) {
+			bool foundTouch = false;
+			for (int i = 0; i < MAX_FINGERS; i++) {
+				if (foundTouch)
+					break;
+				if (sc->contacts[i].x == -1)
+					continue;
+				for (int j = 0; j < 3; j++) {
+					if (i = sc->idsforalttab[j]) {
+						foundTouch = true;
+						break;
+					}
+				}
+			}
+			if (!foundTouch) {
+				BYTE shiftKeys = 0;
+				BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+				keyCodes[0] = 0x0;
+				update_keyboard(sink, shiftKeys, keyCodes);
+				sc->alttabswitchershowing = false;
+				for (int i = 0; i < 3; i++) {
+					sc->idsforalttab[i] = -1;
+				}
+			}
+		}
+		sc->multitaskingx = 0;
+		sc->multitaskingy = 0;
+		sc->multitaskinggesturestarted = false;
+		sc->multitaskingdone = false;
+		return false;
+	}
+}
+
+void TapToClickOrDrag(struct csgesture_sink *sink, csgesture_softc *sc, int button) {
+	if (!sc->settings.tapToClickEnabled)
+		return;
+	if (sc->mouseDownDueToTap && sc->idForMouseDown == -1) {
+		if (sc->frametime - sc->lastclicktime > 100) {
+			sc->mouseDownDueToTap = false;
+			sc->mousedown = false;
+			sc->buttonmask = 0;
+			//Tap Drag Timed out
+		}
+		return;
+	}
+	if (sc->mousedown) {
+		sc->lastclicktime = sc->frametime;
+		return;
+	}
+
+	int i;
+	FOR_EACH_CONTACT(i, sc->activemask) {
+		if (contactage(sc, i) < 100)
+			button++;
+	}
+
+	if (button == 0)
+		return;
+
+	int buttonmask = 0;
+
+	if (sc->scrollInertiaActive) {
+		stop_scroll(sink);
+		return;
+	}
+
+	switch (button) {
+	case 1:
+		if (!sc->settings.swapLeftRightFingers)
+			buttonmask = MOUSE_BUTTON_1;
+		else
+			buttonmask = MOUSE_BUTTON_2;
+		break;
+	case 2:
+		if (sc->settings.multiFingerTap) {
+			if (!sc->settings.swapLeftRightFingers)
+				buttonmask = MOUSE_BUTTON_2;
+			else
+				buttonmask = MOUSE_BUTTON_1;
+		}
+		break;
+	case 3:
+		if (sc->settings.multiFingerTap) {
+			if (sc->settings.threeFingerTapAction == ThreeFingerTapActionWheelClick)
+				buttonmask = MOUSE_BUTTON_3;
+			else if (sc->settings.threeFingerTapAction == ThreeFingerTapActionCortana) {
+				buttonmask = 0;
+
+				BYTE shiftKeys = KBD_LGUI_BIT;
+				BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+				keyCodes[0] = 0x06; //Windows Key + C for Cortana
+				update_keyboard(sink, shiftKeys, keyCodes);
+				shiftKeys = 0;
+				keyCodes[0] = 0x0;
+				update_keyboard(sink, shiftKeys, keyCodes);
+			}
+		}
+		break;
+	case 4:
+		if (sc->settings.fourFingerTapEnabled) {
+			buttonmask = 0;
+
+			BYTE shiftKeys = KBD_LGUI_BIT;
+			BYTE keyCodes[KBD_KEY_CODES] = { 0, 0, 0, 0, 0, 0 };
+			keyCodes[0] = 0x04; //Windows Key + A for Action Center
+			update_keyboard(sink, shiftKeys, keyCodes);
+			shiftKeys = 0;
+			keyCodes[0] = 0x0;
+			update_keyboard(sink, shiftKeys, keyCodes);
+		}
+		break;
+	}
+	if (buttonmask != 0 && sc->frametime - sc->lastclicktime > 100 && sc->releasedthisframe) {
+		sc->idForMouseDown = -1;
+		sc->mouseDownDueToTap = true;
+		sc->buttonmask = buttonmask;
+		sc->mousebutton = button;
+		sc->mousedown = true;
+		sc->lastclicktime = sc->frametime;
+	}
+}
+
+//
+// Per-frame values the engine needs for every slot, worked out up front
+// by contactkernel
+//
+struct contactframe {
+	//
+	// Slots whose average motion over the window is above the gesture
+	// threshold, before the blacklist is applied
+	//
+	uint32_t moving;
+
+	//
+	// abs(x - lastx), abs(y - lasty), only meaningful for slots down on
+	// both frames
+	//
+	int16_t absdelta[16][2];
+};
+
+#if CSGESTURE_SIMD
+
+//
+// The kernel reads four records at a time as two 16 byte halves each
+//
+static_assert(sizeof(struct csgesture_contact) == 32, "contact record layout");
+static_assert(offsetof(struct csgesture_contact, lastx) == 6, "contact record layout");
+static_assert(offsetof(struct csgesture_contact, tick) == 12, "contact record layout");
+static_assert(offsetof(struct csgesture_contact, flextotalx) == 20, "contact record layout");
+static_assert(offsetof(struct csgesture_contact, flextotaly) == 24, "contact record layout");
+
+static void contactkernel(csgesture_softc *sc, struct contactframe *frame) {
+	const __m128i *records = (const __m128i *)sc->contacts;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i tickmask = _mm_set1_epi32(0xFF);
+
+	uint32_t slots = sc->activemask | sc->lastactivemask;
+
+	frame->moving = 0;
+
+	for (int group = 0; group < 4; group++, records += 8) {
+		if (((slots >> (group * 4)) & 0xF) == 0)
+			continue;
+
+		__m128i lo0 = _mm_loadu_si128(records + 0);
+		__m128i hi0 = _mm_loadu_si128(records + 1);
+		__m128i lo1 = _mm_loadu_si128(records + 2);
+		__m128i hi1 = _mm_loadu_si128(records + 3);
+		__m128i lo2 = _mm_loadu_si128(records + 4);
+		__m128i hi2 = _mm_loadu_si128(records + 5);
+		__m128i lo3 = _mm_loadu_si128(records + 6);
+		__m128i hi3 = _mm_loadu_si128(records + 7);
+
+		//
+		// Words 0-1 of each low half are x, y and words 3-4 lastx, lasty;
+		// subtract the shifted half and gather the four (dx, dy) pairs
+		//
+		__m128i d0 = _mm_sub_epi16(lo0, _mm_srli_si128(lo0, 6));
+		__m128i d1 = _mm_sub_epi16(lo1, _mm_srli_si128(lo1, 6));
+		__m128i d2 = _mm_sub_epi16(lo2, _mm_srli_si128(lo2, 6));
+		__m128i d3 = _mm_sub_epi16(lo3, _mm_srli_si128(lo3, 6));
+		__m128i d = _mm_unpacklo_epi64(_mm_unpacklo_epi32(d0, d1), _mm_unpacklo_epi32(d2, d3));
+		d = _mm_max_epi16(d, _mm_sub_epi16(zero, d));
+
+		_mm_storeu_si128((__m128i *)frame->absdelta[group * 4], d);
+
+		//
+		// Transpose the high halves to get flextotalx and flextotaly per
+		// slot, and dword 3 of the low halves for tick
+		//
+		__m128i t0 = _mm_unpacklo_epi32(hi0, hi1);
+		__m128i t1 = _mm_unpacklo_epi32(hi2, hi3);
+		__m128i t2 = _mm_unpackhi_epi32(hi0, hi1);
+		__m128i t3 = _mm_unpackhi_epi32(hi2, hi3);
+		__m128i totalx = _mm_unpackhi_epi64(t0, t1);
+		__m128i totaly = _mm_unpacklo_epi64(t2, t3);
+
+		__m128i tick = _mm_unpackhi_epi64(_mm_unpackhi_epi32(lo0, lo1), _mm_unpackhi_epi32(lo2, lo3));
+		tick = _mm_and_si128(tick, tickmask);
+		__m128i twotick = _mm_add_epi32(tick, tick);
+
+		//
+		// Averages are whole counts, so distancesq(avgx, avgy) > 2 comes
+		// down to either total reaching twice tick, no division needed.
+		// Still: no history yet, or both averages below 2
+		//
+		__m128i still = _mm_or_si128(_mm_cmpeq_epi32(tick, zero),
+			_mm_and_si128(_mm_cmplt_epi32(totalx, twotick), _mm_cmplt_epi32(totaly, twotick)));
+
+		uint32_t moving = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(still)) ^ 0xF;
+		frame->moving |= moving << (group * 4);
+	}
+
+	//
+	// Slot 15 only pads the records out to the last group
+	//
+	frame->moving &= (1u << MAX_FINGERS) - 1;
+}
+
+#else
+
+static void contactkernel(csgesture_softc *sc, struct contactframe *frame) {
+	int i;
+
+	FOR_EACH_CONTACT(i, sc->activemask & sc->lastactivemask) {
+		frame->absdelta[i][0] = (int16_t)abs(sc->contacts[i].x - sc->contacts[i].lastx);
+		frame->absdelta[i][1] = (int16_t)abs(sc->contacts[i].y - sc->contacts[i].lasty);
+	}
+
+	//
+	// Only contacts that were down on the last frame have a history
+	//
+	frame->moving = 0;
+	FOR_EACH_CONTACT(i, sc->lastactivemask) {
+		if (sc->contacts[i].tick == 0)
+			continue;
+
+		int avgx = sc->contacts[i].flextotalx / sc->contacts[i].tick;
+		int avgy = sc->contacts[i].flextotaly / sc->contacts[i].tick;
+		if (distancesq(avgx, avgy) > 2)
+			frame->moving |= CONTACT_BIT(i);
+	}
+}
+
+#endif
+
+//
+// Adds one frame of motion to the contact's window, dropping the oldest
+// frame once the window is full. flextotalx/flextotaly are kept as the
+// window sums, so the cost does not grow with the window length.
+//
+static void pushhistory(csgesture_softc *sc, int i, int speedx, int speedy) {
+	int j = sc->contacts[i].historyhead;
+
+	if (sc->contacts[i].historycount == CSGESTURE_HISTORY_FRAMES) {
+		sc->contacts[i].flextotalx -= sc->history[i].x[j];
+		sc->contacts[i].flextotaly -= sc->history[i].y[j];
+	}
+	else
+		sc->contacts[i].historycount++;
+
+	sc->history[i].x[j] = (uint16_t)speedx;
+	sc->history[i].y[j] = (uint16_t)speedy;
+	sc->contacts[i].flextotalx += speedx;
+	sc->contacts[i].flextotaly += speedy;
+
+	if (++j == CSGESTURE_HISTORY_FRAMES)
+		j = 0;
+	sc->contacts[i].historyhead = (uint8_t)j;
+}
+
+void ClearTapDrag(struct csgesture_sink *sink, csgesture_softc *sc, int i) {
+	if (i == sc->idForMouseDown && sc->mouseDownDueToTap == true) {
+		if (contactage(sc, i) < 100) {
+			//Double Tap
+			update_relative_mouse(sink, sc, 0, 0, 0, 0, 0);
+			update_relative_mouse(sink, sc, sc->buttonmask, 0, 0, 0, 0);
+		}
+		sc->mouseDownDueToTap = false;
+		sc->mousedown = false;
+		sc->buttonmask = 0;
+		sc->idForMouseDown = -1;
+		//Clear Tap Drag
+	}
+}
+
+void ProcessGesture(struct csgesture_sink *sink, csgesture_softc *sc) {
+#pragma mark reset inputs
+	sc->releasedthisframe = false;
+	sc->dx = 0;
+	sc->dy = 0;
+	sc->scrollx = 0;
+	sc->scrolly = 0;
+
+#pragma mark process touch thresholds
+	struct contactframe frame;
+	contactkernel(sc, &frame);
+
+	int abovethreshold = 0;
+	int recentlyadded = contactcount(sc->recentmask);
+	int lastrecentlyadded = sc->recentmask ? highestcontact(sc->recentmask) : -1;
+	int iToUse[3] = { -1,-1,-1 };
+	int a = 0;
+
+	int nfingers = contactcount(sc->activemask);
+
+	int i;
+	FOR_EACH_CONTACT(i, frame.moving & sc->lastactivemask & ~sc->blacklistmask) {
+		abovethreshold++;
+		//
+		// Gestures only follow the first three fingers, a fourth one
+		// still counts towards abovethreshold
+		//
+		if (a < 3) {
+			iToUse[a] = i;
+			a++;
+		}
+	}
+
+#pragma mark process different gestures
+	bool handled = false;
+	bool handledByScroll = false;
+
+	int decision = TRACE_GESTURE_NONE;
+
+	if (!handled && (handled = ProcessThreeFingerSwipe(sink, sc, abovethreshold, iToUse)))
+		decision = TRACE_GESTURE_SWIPE;
+	if (!handled && (handledByScroll = handled = ProcessScroll(sink, sc, abovethreshold, iToUse)))
+		decision = TRACE_GESTURE_SCROLL;
+	if (!handled && (handled = ProcessMove(sink, sc, abovethreshold, iToUse)))
+		decision = TRACE_GESTURE_MOVE;
+
+	if (decision != sc->lastdecision) {
+		TraceEvent(sc->trace, TRACE_EVENT_GESTURE, decision, abovethreshold);
+		sc->lastdecision = decision;
+	}
+
+#pragma mark kinetic scrolling
+	ProcessFling(sc);
+
+#pragma mark process clickpad press state
+	int buttonmask = 0;
+
+	sc->mousebutton = recentlyadded;
+
+	if (sc->settings.rightClickBottomRight) {
+		if (sc->mousebutton == 1 && lastrecentlyadded != -1) {
+			if (sc->contacts[lastrecentlyadded].x > sc->resx / 2 && sc->contacts[lastrecentlyadded].y > (sc->resy - 60))
+				sc->mousebutton = 2;
+		}
+	}
+
+	if (sc->mousebutton == 0)
+		sc->mousebutton = abovethreshold;
+
+	if (sc->mousebutton == 0) {
+		if (sc->panningActive)
+			sc->mousebutton = 1;
+		else
+			sc->mousebutton = nfingers;
+		if (sc->mousebutton == 0 && sc->settings.clickWithNoFingers)
+			sc->mousebutton = 1;
+	}
+	if (sc->mousebutton > 3)
+		sc->mousebutton = 3;
+
+	if (!sc->mouseDownDueToTap) {
+		if (sc->buttondown && !sc->mousedown) {
+			sc->mousedown = true;
+			sc->lastclicktime = sc->frametime;
+
+			switch (sc->mousebutton) {
+			case 1:
+				if (!sc->settings.swapLeftRightFingers)
+					buttonmask = MOUSE_BUTTON_1;
+				else
+					buttonmask = MOUSE_BUTTON_2;
+				break;
+			case 2:
+				if (sc->settings.multiFingerClick) {
+					if (!sc->settings.swapLeftRightFingers)
+						buttonmask = MOUSE_BUTTON_2;
+					else
+						buttonmask = MOUSE_BUTTON_1;
+				}
+				break;
+			case 3:
+				if (sc->settings.multiFingerClick) {
+					buttonmask = MOUSE_BUTTON_3;
+				}
+				break;
+			}
+			sc->buttonmask = buttonmask;
+		}
+		else if (sc->mousedown && !sc->buttondown) {
+			sc->mousedown = false;
+			sc->mousebutton = 0;
+			sc->buttonmask = 0;
+		}
+	}
+
+#pragma mark shift to last
+	int releasedfingers = 0;
+
+	int interval = frameinterval(sc);
+
+	//
+	// Slots that are neither down nor just released have nothing to update
+	//
+	FOR_EACH_CONTACT(i, sc->activemask | sc->lastactivemask) {
+		if (sc->contacts[i].x != -1) {
+			if (sc->contacts[i].lastx == -1) {
+				sc->contacts[i].downtime = sc->frametime;
+				if (sc->frametime - sc->lastreleasetime < 100 && sc->mouseDownDueToTap && sc->idForMouseDown == -1) {
+					if (sc->settings.tapDragEnabled)
+						sc->idForMouseDown = i; //Associate Tap Drag
+				}
+			}
+			if (sc->contacts[i].tick < CSGESTURE_HISTORY_FRAMES) {
+				if (sc->contacts[i].lastx != -1) {
+					sc->contacts[i].totalp += (uint16_t)sc->contacts[i].p;
+
+					pushhistory(sc, i, normalizespeed(frame.absdelta[i][0], interval),
+						normalizespeed(frame.absdelta[i][1], interval));
+				}
+				sc->contacts[i].tick++;
+			}
+			else if (sc->contacts[i].lastx != -1) {
+				pushhistory(sc, i, normalizespeed(frame.absdelta[i][0], interval),
+					normalizespeed(frame.absdelta[i][1], interval));
+			}
+		}
+		if (sc->contacts[i].x == -1) {
+			ClearTapDrag(sink, sc, i);
+			if (sc->contacts[i].lastx != -1) {
+				sc->lastreleasetime = sc->frametime;
+				sc->releasedthisframe = true;
+			}
+			sc->contacts[i].historyhead = 0;
+			sc->contacts[i].historycount = 0;
+			if (sc->contacts[i].tick != 0 && contactage(sc, i) < 100) {
+				int avgp = sc->contacts[i].totalp / sc->contacts[i].tick;
+				if (avgp > 7)
+					releasedfingers++;
+			}
+			sc->contacts[i].totalp = 0;
+			sc->contacts[i].flextotalx = 0;
+			sc->contacts[i].flextotaly = 0;
+			sc->contacts[i].tick = 0;
+
+			sc->blacklistmask &= ~CONTACT_BIT(i);
+
+			if (sc->idForPanning == i) {
+				sc->panningActive = false;
+				sc->idForPanning = -1;
+			}
+		}
+		sc->contacts[i].lastx = sc->contacts[i].x;
+		sc->contacts[i].lasty = sc->contacts[i].y;
+		sc->contacts[i].lastp = sc->contacts[i].p;
+	}
+
+#pragma mark process tap to click
+	if (!handledByScroll)
+		TapToClickOrDrag(sink, sc, releasedfingers);
+
+#pragma mark send to system
+	//
+	// Pointer motion too big for one report is split, wheel counts are
+	// kept within one by the scroll code and only saturated here
+	//
+	update_relative_mouse(sink, sc, (BYTE)sc->buttonmask, sc->dx, sc->dy,
+		clamp_relative(sc->scrolly), clamp_relative(sc->scrollx));
+}
+
+void TrackpadRawInput(struct csgesture_sink *sink, struct csgesture_softc *sc, struct cyapa_regs *regs, uint32_t timems){
+	int nfingers;
+	int afingers;	/* actual fingers after culling */
+	int i;
+
+	if ((regs->stat & CYAPA_STAT_RUNNING) == 0) {
+		regs->fngr = 0;
+	}
+
+	nfingers = CYAPA_FNGR_NUMFINGERS(regs->fngr);
+
+	//
+	// The timer's replays are stamped when they run, so a frame read just
+	// before one can reach the engine just after it. Time never runs
+	// backwards here, or contact ages and intervals would go negative.
+	//
+	if (sc->slotsready && (int32_t)(timems - sc->frametime) < 0)
+		timems = sc->frametime;
+
+	sc->lastframetime = sc->frametime;
+	sc->frametime = timems;
+
+	//
+	// A zeroed softc has every slot at 0 rather than -1, line them all up
+	// once so the masks can be trusted from then on
+	//
+	if (!sc->slotsready) {
+		for (i = 0; i < MAX_FINGERS; i++) {
+			sc->contacts[i].x = sc->contacts[i].lastx = -1;
+			sc->contacts[i].y = sc->contacts[i].lasty = -1;
+			sc->contacts[i].p = sc->contacts[i].lastp = -1;
+		}
+		sc->activemask = 0;
+		sc->blacklistmask = 0;
+		sc->slotsready = true;
+	}
+
+	FOR_EACH_CONTACT(i, sc->activemask) {
+		sc->contacts[i].x = -1;
+		sc->contacts[i].y = -1;
+		sc->contacts[i].p = -1;
+	}
+	sc->lastactivemask = sc->activemask;
+	sc->activemask = 0;
+
+	for (int i = 0;i < nfingers;i++) {
+		//
+		// Ids run 1-15 and the pad never uses 0, so 15 goes in slot 0
+		// rather than one past the end of the arrays
+		//
+		int a = regs->touch[i].id % MAX_FINGERS;
+		int x = CYAPA_TOUCH_X(regs, i);
+		int y = CYAPA_TOUCH_Y(regs, i);
+		int p = CYAPA_TOUCH_P(regs, i);
+		sc->contacts[a].x = (int16_t)x;
+		sc->contacts[a].y = (int16_t)y;
+		sc->contacts[a].p = (int16_t)p;
+		sc->activemask |= CONTACT_BIT(a);
+	}
+
+	sc->recentmask = 0;
+	FOR_EACH_CONTACT(i, sc->lastactivemask) {
+		if (contactage(sc, i) < 300)
+			sc->recentmask |= CONTACT_BIT(i);
+	}
+
+	sc->buttondown = (regs->fngr & CYAPA_FNGR_LEFT);
+
+	ProcessGesture(sink, sc);
+}
+
+void SetDefaultSettings(struct csgesture_settings *settings) {
+	settings->pointerMultiplier = 10; //done
+
+	//click settings
+	settings->swapLeftRightFingers = false;
+	settings->clickWithNoFingers = true;
+	settings->multiFingerClick = true;
+	settings->rightClickBottomRight = false;
+
+	//tap settings
+	settings->tapToClickEnabled = true;
+	settings->multiFingerTap = true;
+	settings->tapDragEnabled = true;
+
+	settings->threeFingerTapAction = ThreeFingerTapActionCortana;
+
+	settings->fourFingerTapEnabled = true;
+
+	//scroll settings
+	settings->scrollEnabled = true;
+	settings->scrollMode = ScrollModeHelper;
+	settings->scrollFriction = 950;
+
+	//three finger gestures
+	settings->threeFingerSwipeUpGesture = SwipeUpGestureTaskView;
+	settings->threeFingerSwipeDownGesture = SwipeDownGestureShowDesktop;
+	settings->threeFingerSwipeLeftRightGesture = SwipeGestureAltTabSwitcher;
+
+	//four finger gestures
+	settings->fourFingerSwipeUpGesture = SwipeUpGestureTaskView;
+	settings->fourFingerSwipeDownGesture = SwipeDownGestureShowDesktop;
+	settings->fourFingerSwipeLeftRightGesture = SwipeGestureSwitchWorkspace;
+}
+
+bool ApplySetting(struct csgesture_settings *settings, int settingRegister, int settingValue) {
+	switch (settingRegister) {
+	case 0:
+		settings->pointerMultiplier = settingValue;
+		break;
+	case 1:
+		settings->swapLeftRightFingers = settingValue;
+		break;
+	case 2:
+		settings->clickWithNoFingers = settingValue;
+		break;
+	case 3:
+		settings->multiFingerClick = settingValue;
+		break;
+	case 4:
+		settings->rightClickBottomRight = settingValue;
+		break;
+	case 5:
+		settings->tapToClickEnabled = settingValue;
+		break;
+	case 6:
+		settings->multiFingerTap = settingValue;
+		break;
+	case 7:
+		settings->tapDragEnabled = settingValue;
+		break;
+	case 8:
+		settings->threeFingerTapAction = (ThreeFingerTapAction)settingValue;
+		break;
+	case 9:
+		settings->fourFingerTapEnabled = settingValue;
+		break;
+	case 10:
+		settings->scrollEnabled = settingValue;
+		break;
+	case 11:
+		settings->threeFingerSwipeUpGesture = (SwipeUpGesture)settingValue;
+		break;
+	case 12:
+		settings->threeFingerSwipeDownGesture = (SwipeDownGesture)settingValue;
+		break;
+	case 13:
+		settings->threeFingerSwipeLeftRightGesture = (SwipeGesture)settingValue;
+		break;
+	case 14:
+		settings->fourFingerSwipeUpGesture = (SwipeUpGesture)settingValue;
+		break;
+	case 15:
+		settings->fourFingerSwipeDownGesture = (SwipeDownGesture)settingValue;
+		break;
+	case 16:
+		settings->fourFingerSwipeLeftRightGesture = (SwipeGesture)settingValue;
+		break;
+	case 21:
+		settings->scrollMode = (ScrollMode)settingValue;
+		break;
+	case 22:
+		settings->scrollFriction = settingValue;
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+bool GestureIdle(csgesture_softc *sc) {
+	if (sc->activemask || sc->lastactivemask)
+		return false;
+	return !sc->mousedown && !sc->mouseDownDueToTap &&
+		!sc->panningActive && !sc->scrollingActive && !sc->flinging &&
+		!sc->multitaskinggesturestarted && !sc->alttabswitchershowing;
+}
+
+//
+// A softc as OnDeviceAdd finds it, before the first frame
+//
+static const struct csgesture_softc emptysoftc = {};
+
+void GestureReset(struct csgesture_sink *sink, csgesture_softc *sc) {
+	BYTE keyCodes[KBD_KEY_CODES] = { 0 };
+
+	//
+	// Let go of whatever the engine was holding: LALT for the alt-tab
+	// switcher, a tapped or clicked button, the scroll helper's touches
+	//
+	update_keyboard(sink, 0, keyCodes);
+	sink->mouse(sink->context, 0, 0, 0, 0, 0);
+	if (sc->scrollingActive && sc->settings.scrollMode == ScrollModeHelper)
+		stop_scroll(sink);
+
+	//
+	// Then forget the touches and gestures behind them. What the host
+	// configured and what the pad reported about itself stays.
+	//
+	struct csgesture_settings settings = sc->settings;
+	long settingsSequence = sc->settingsSequence;
+	uint32_t frametime = sc->frametime;
+	uint8_t wheelmultipliers = sc->wheelmultipliers;
+	struct trace_sink *trace = sc->trace;
+	int resx = sc->resx, resy = sc->resy, phyx = sc->phyx, phyy = sc->phyy;
+	bool infoSetup = sc->infoSetup;
+	char product_id[sizeof(sc->product_id)];
+	char firmware_version[sizeof(sc->firmware_version)];
+	for (int i = 0; i < (int)sizeof(product_id); i++)
+		product_id[i] = sc->product_id[i];
+	for (int i = 0; i < (int)sizeof(firmware_version); i++)
+		firmware_version[i] = sc->firmware_version[i];
+
+	*sc = emptysoftc;
+
+	sc->settings = settings;
+	sc->settingsSequence = settingsSequence;
+	sc->frametime = sc->lastframetime = frametime;
+	sc->wheelmultipliers = wheelmultipliers;
+	sc->trace = trace;
+	sc->resx = resx;
+	sc->resy = resy;
+	sc->phyx = phyx;
+	sc->phyy = phyy;
+	sc->infoSetup = infoSetup;
+	for (int i = 0; i < (int)sizeof(product_id); i++)
+		sc->product_id[i] = product_id[i];
+	for (int i = 0; i < (int)sizeof(firmware_version); i++)
+		sc->firmware_version[i] = firmware_version[i];
+}
@@ -0,0 +1,58 @@
+#ifndef _GESTURE_H_
+#define _GESTURE_H_
+
+#include "stdint.h"
+
+#include "cyapa.h"
+#include "gesturerec.h"
+
+//
+// Gesture engine. Takes cyapa_regs frames stamped in milliseconds and
+// hands its output to a csgesture_sink, so it builds and runs without the
+// WDK (frame replay, tests) as well as in the driver.
+//
+
+struct csgesture_sink {
+	void *context;
+
+	//
+	// Relative mouse report, x/y/wheels are signed counts in -127..127
+	//
+	void(*mouse)(void *context, uint8_t buttons, uint8_t x, uint8_t y,
+		uint8_t wheel, uint8_t hwheel);
+
+	//
+	// Keyboard report, keyCodes holds 6 HID usages
+	//
+	void(*keyboard)(void *context, uint8_t shiftKeys, uint8_t *keyCodes);
+
+	//
+	// Scroll report, flag 1 stops scrolling, 65535 marks a missing touch
+	//
+	void(*scroll)(void *context, uint8_t flag, uint16_t x1, uint16_t y1,
+		uint16_t x2, uint16_t y2);
+};
+
+void TrackpadRawInput(struct csgesture_sink *sink, struct csgesture_softc *sc, struct cyapa_regs *regs, uint32_t timems);
+
+void SetDefaultSettings(struct csgesture_settings *settings);
+
+//
+// Sets the engine setting behind a settings report register, false if the
+// register is not an engine setting
+//
+bool ApplySetting(struct csgesture_settings *settings, int settingRegister, int settingValue);
+
+//
+// Nothing on the pad and no tap, drag, scroll or swipe pending
+//
+bool GestureIdle(struct csgesture_softc *sc);
+
+//
+// Releases every key and button the engine holds through sink and drops
+// all touch and gesture state, for when frames stop reaching the engine
+// (the host switching to touchpad mode). Settings and pad info are kept.
+//
+void GestureReset(struct csgesture_sink *sink, struct csgesture_softc *sc);
+
+#endif
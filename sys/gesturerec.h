@@ -1,5 +1,26 @@
+#pragma once
+
 #include "stdint.h"
 
+//
+// The engine was tuned against a fixed 10 ms tick. Gesture timing is now
+// taken from frame timestamps in milliseconds, and per-frame motion is
+// normalized to this interval before it goes into the history window.
+//
+#define CSGESTURE_FRAME_MS 10
+
+//
+// Frames of motion each contact's threshold average is taken over. Frames
+// go into a ring, so a longer window costs memory but no time per frame.
+//
+#ifndef CSGESTURE_HISTORY_FRAMES
+#define CSGESTURE_HISTORY_FRAMES 10
+#endif
+
+#if CSGESTURE_HISTORY_FRAMES > 255
+#error CSGESTURE_HISTORY_FRAMES must fit the 8 bit contact counters
+#endif
+
 typedef enum {
 	ThreeFingerTapActionCortana,
 	ThreeFingerTapActionWheelClick,
@@ -22,6 +43,11 @@ typedef enum {
 	SwipeGestureNone
 } SwipeGesture;
 
+typedef enum {
+	ScrollModeHelper,	//touch points to the scroll helper (REPORTID_SCROLL)
+	ScrollModeWheel		//wheel and pan counts in the mouse report
+} ScrollMode;
+
 struct csgesture_settings {
 	int pointerMultiplier; //done
 
@@ -42,6 +68,8 @@ struct csgesture_settings {
 
 	//scroll settings
 	int scrollEnabled; //done
+	ScrollMode scrollMode;
+	int scrollFriction; //per mille of fling speed kept per frame, 0 for no inertia
 
 	//three finger gestures
 	SwipeUpGesture threeFingerSwipeUpGesture;
@@ -54,35 +82,114 @@ struct csgesture_settings {
 	SwipeGesture fourFingerSwipeLeftRightGesture;
 };
 
-struct csgesture_softc {
+//
+// Settings published by the settings report. The writer makes sequence
+// odd while it updates the block and even again once done, the engine
+// refreshes its own copy only from a stable, changed block.
+//
+struct csgesture_settings_block {
+	volatile long sequence;
 	struct csgesture_settings settings;
+};
 
-	//hardware input
-	int x[15];
-	int y[15];
-	int p[15];
+//
+// One touch slot. Coordinates are 12 bit and pressure 8 bit, -1 when the
+// slot is up; sized to pack two records to a 64 byte cache line.
+//
+struct csgesture_contact {
+	int16_t x;
+	int16_t y;
+	int16_t p;
+	int16_t lastx;
+	int16_t lasty;
+	int16_t lastp;
+
+	uint8_t tick;
+	uint8_t historyhead;
+	uint8_t historycount;
+	uint8_t reserved;
+
+	uint32_t downtime;
+
+	//sums over the motion window
+	int32_t flextotalx;
+	int32_t flextotaly;
+
+	//pressure summed over the first CSGESTURE_HISTORY_FRAMES frames
+	uint16_t totalp;
+};
 
-	bool buttondown;
+//
+// Per-frame motion, normalized to CSGESTURE_FRAME_MS, for the last
+// CSGESTURE_HISTORY_FRAMES frames of a contact
+//
+struct csgesture_history {
+	uint16_t x[CSGESTURE_HISTORY_FRAMES];
+	uint16_t y[CSGESTURE_HISTORY_FRAMES];
+};
 
-	//hardware info
-	bool infoSetup;
+struct csgesture_softc {
+	//
+	// Hot per-frame contact state, touched on every frame. The contact
+	// records lead the softc so the engine's per-frame working set is a
+	// run of whole lines.
+	//
 
-	char product_id[16];
-	char firmware_version[4];
+	//
+	// 15 slots, plus one spare so the contact kernel can take them in
+	// groups of four
+	//
+	struct csgesture_contact contacts[16];
 
-	int resx;
-	int resy;
-	int phyx;
-	int phyy;
+	uint32_t frametime;
+	uint32_t lastframetime;
+
+	bool buttondown;
+
+	//
+	// Slot masks, bit i for slot i: down on this frame, down on the last
+	// one, down for less than 300 ms as of the last frame, and ignored for
+	// pointer motion. Kept in step with x/lastx by TrackpadRawInput.
+	//
+	uint32_t activemask;
+	uint32_t lastactivemask;
+	uint32_t recentmask;
+	uint32_t blacklistmask;
+	bool slotsready;
 
 	//system output
 	int dx;
 	int dy;
 
+	//pointer motion below one count, in tenths, carried to the next frame
+	int dxremainder;
+	int dyremainder;
+
 	int scrollx;
 	int scrolly;
 
+	//wheel motion below one count, in pad units, carried to the next frame
+	int wheelremainder;
+	int hwheelremainder;
+
+	//
+	// Kinetic scrolling in ScrollModeWheel. Velocity is tracked in wheel
+	// direction while two fingers scroll, in 1/256 pad units per
+	// CSGESTURE_FRAME_MS, and keeps scrolling after they lift.
+	//
+	bool flinging;
+	int flingvelx;
+	int flingvely;
+	int flingtravelx;
+	int flingtravely;
+
 	int buttonmask;
+	int lastreportbuttons;
+
+	//
+	// Motion windows, only touched when a contact moves
+	//
+	struct csgesture_history history[15];
 
 	//used internally in driver
 	int panningActive;
@@ -90,42 +197,58 @@ struct csgesture_softc {
 
 	int scrollingActive;
 	int idsForScrolling[2];
-	int ticksSinceScrolling;
+	uint32_t lastScrollTime;
 
 	int scrollInertiaActive;
 
-	int blacklistedids[15];
+	//resolution multipliers the host turned on, MOUSE_WHEEL_MULTIPLIER_xxx
+	uint8_t wheelmultipliers;
 
 	bool mouseDownDueToTap;
 	int idForMouseDown;
 	bool mousedown;
 	int mousebutton;
 
-	int lastx[15];
-	int lasty[15];
-	int lastp[15];
-
-	int xhistory[15][10];
-	int yhistory[15][10];
-
-	int flextotalx[15];
-	int flextotaly[15];
-
-	int totalx[15];
-	int totaly[15];
-	int totalp[15];
-
 	int multitaskingx;
 	int multitaskingy;
-	int multitaskinggesturetick;
+	int multitaskingremx;	//finger travel the average dropped, in thirds
+	int multitaskingremy;
+	bool multitaskinggesturestarted;
+	uint32_t multitaskinggesturestart;
 	bool multitaskingdone;
 
 	bool alttabswitchershowing;
 
 	int idsforalttab[3];
 
-	int tick[15];
-	int truetick[15];
-	int ticksincelastrelease;
-	int tickssinceclick;
+	uint32_t lastreleasetime;
+	bool releasedthisframe;	//a contact lifted on the current frame
+	uint32_t lastclicktime;
+
+	//
+	// Engine copy of the published settings and the sequence it came from
+	//
+
+	struct csgesture_settings settings;
+	long settingsSequence;
+
+	//where this engine's trace events go, NULL drops them
+	struct trace_sink *trace;
+
+	//last TRACE_GESTURE_xxx decision, traced only when it changes
+	int lastdecision;
+
+	//
+	// Cold hardware info, written once when the trackpad boots
+	//
+
+	int resx;
+	int resy;
+	int phyx;
+	int phyy;
+
+	bool infoSetup;
+
+	char product_id[16];
+	char firmware_version[4];
 };
\ No newline at end of file
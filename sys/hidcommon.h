@@ -21,6 +21,7 @@
 #define REPORTID_KEYBOARD       0x07
 #define REPORTID_SCROLLCTRL		0x08
 #define REPORTID_SETTINGS		0x09
+#define REPORTID_CAPTURE		0x0A
 
 //
 // Keyboard specific report infomation
@@ -90,6 +91,28 @@ typedef struct _CYAPA_RELATIVE_MOUSE_REPORT
 } CyapaRelativeMouseReport;
 #pragma pack()
 
+//
+// Wheel and AC Pan each sit under a Resolution Multiplier. Once the host
+// sets one, a count on that axis is 1/MOUSE_WHEEL_MULTIPLIER of a notch.
+//
+
+#define MOUSE_WHEEL_MULTIPLIER             8
+
+#define MOUSE_WHEEL_MULTIPLIER_VERTICAL    0x01
+#define MOUSE_WHEEL_MULTIPLIER_HORIZONTAL  0x04
+#define MOUSE_WHEEL_MULTIPLIER_MASK        0x0F
+
+#pragma pack(1)
+typedef struct _CYAPA_WHEEL_FEATURE_REPORT
+{
+
+	BYTE        ReportID;
+
+	BYTE        Multipliers;
+
+} CyapaWheelFeatureReport;
+#pragma pack()
+
 //
 // Scroll specific report information
 //
@@ -147,11 +170,84 @@ typedef struct _CYAPA_INFO_REPORT
 } CyapaInfoReport;
 #pragma pack()
 
+//
+// Touch trace capture bytes, see capture.h
+//
+
+#define CAPTURE_REPORT_DATA_SIZE 62
+
+#pragma pack(1)
+typedef struct _CYAPA_CAPTURE_REPORT
+{
+
+	BYTE        ReportID;
+
+	BYTE		Length;
+
+	BYTE		Data[CAPTURE_REPORT_DATA_SIZE];
+
+} CyapaCaptureReport;
+#pragma pack()
+
+//
+// Touchpad specific report information. Contacts are reported in
+// precision touchpad layout with X/Y in 0.1 mm, scan time in 100 us.
+//
+
+#define TOUCHPAD_CONTACTS               5
+
+#define TOUCHPAD_CONTACT_CONFIDENCE     0x01
+#define TOUCHPAD_CONTACT_TIP            0x02
+
+#define TOUCHPAD_PAD_TYPE_CLICKPAD      0x00
+
+#pragma pack(1)
+typedef struct _CYAPA_TOUCHPAD_CONTACT
+{
+
+	BYTE        Status;
+
+	BYTE        ContactID;
+
+	USHORT      XValue;
+
+	USHORT      YValue;
+
+} CyapaTouchpadContact;
+
+typedef struct _CYAPA_TOUCHPAD_REPORT
+{
+
+	BYTE        ReportID;
+
+	CyapaTouchpadContact Contacts[TOUCHPAD_CONTACTS];
+
+	USHORT      ScanTime;
+
+	BYTE        ContactCount;
+
+	BYTE        Button;
+
+} CyapaTouchpadReport;
+
+typedef struct _CYAPA_TOUCHPAD_CAPS_REPORT
+{
+
+	BYTE        ReportID;
+
+	BYTE        ContactCountMaximum;
+
+	BYTE        PadType;
+
+} CyapaTouchpadCapsReport;
+#pragma pack()
+
 //
 // Feature report infomation
 //
 
 #define DEVICE_MODE_MOUSE        0x00
+#define DEVICE_MODE_TOUCHPAD     0x03
 
 #pragma pack(1)
 typedef struct _CYAPA_FEATURE_REPORT
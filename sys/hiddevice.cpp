@@ -89,8 +89,8 @@ IN WDFREQUEST Request
 	NTSTATUS            status = STATUS_SUCCESS;
 	ULONG_PTR           bytesToCopy;
 	WDFMEMORY           memory;
-
-	UNREFERENCED_PARAMETER(Device);
+	PDEVICE_CONTEXT     pDevice = GetDeviceContext(Device);
+	uint16_t            maxx, maxy;
 
 	CyapaPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL,
 		"CyapaGetReportDescriptor Entry\n");
@@ -140,6 +140,12 @@ IN WDFREQUEST Request
 		return status;
 	}
 
+	//
+	// Touchpad contacts are in 0.1 mm, fill in the real sensor size
+	//
+	touchpad_extent(&pDevice->sc, &maxx, &maxy);
+	touchpad_patch_descriptor((uint8_t *)WdfMemoryGetBuffer(memory, NULL), (uint32_t)bytesToCopy, maxx, maxy);
+
 	//
 	// Report how many bytes were copied
 	//
@@ -278,26 +284,256 @@ IN WDFREQUEST Request
 	return status;
 }
 
-NTSTATUS
-CyapaProcessVendorReport(
-IN PDEVICE_CONTEXT DevContext,
+static BOOLEAN
+CyapaReportIsTransition(
+IN PCYAPA_REPORT_RING Ring,
+IN PVOID ReportBuffer
+)
+{
+	CyapaRelativeMouseReport *mouse;
+
+	switch (((BYTE *)ReportBuffer)[0])
+	{
+	case REPORTID_RELATIVE_MOUSE:
+		mouse = (CyapaRelativeMouseReport *)ReportBuffer;
+		if (mouse->Button == Ring->LastButton)
+			return FALSE;
+		Ring->LastButton = mouse->Button;
+		return TRUE;
+	case REPORTID_SCROLL:
+		return ((CyapaScrollReport *)ReportBuffer)->Flag != 0;
+	}
+
+	//
+	// Key presses/releases, settings replies etc. are never merged
+	//
+	return TRUE;
+}
+
+static BOOLEAN
+CyapaCoalesceReport(
+IN PCYAPA_PENDING_REPORT Pending,
+IN PVOID ReportBuffer,
+IN ULONG ReportBufferLen
+)
+{
+	if (Pending->Transition ||
+		Pending->Length != ReportBufferLen ||
+		Pending->Data[0] != ((BYTE *)ReportBuffer)[0])
+	{
+		return FALSE;
+	}
+
+	switch (Pending->Data[0])
+	{
+	case REPORTID_RELATIVE_MOUSE:
+	{
+		CyapaRelativeMouseReport *queued = (CyapaRelativeMouseReport *)Pending->Data;
+		CyapaRelativeMouseReport *report = (CyapaRelativeMouseReport *)ReportBuffer;
+		int x = (CHAR)queued->XValue + (CHAR)report->XValue;
+		int y = (CHAR)queued->YValue + (CHAR)report->YValue;
+		int wheel = (CHAR)queued->WheelPosition + (CHAR)report->WheelPosition;
+		int hwheel = (CHAR)queued->HWheelPosition + (CHAR)report->HWheelPosition;
+
+		if (x < RELATIVE_MOUSE_MIN_COORDINATE || x > RELATIVE_MOUSE_MAX_COORDINATE ||
+			y < RELATIVE_MOUSE_MIN_COORDINATE || y > RELATIVE_MOUSE_MAX_COORDINATE ||
+			wheel < MIN_WHEEL_POS || wheel > MAX_WHEEL_POS ||
+			hwheel < MIN_WHEEL_POS || hwheel > MAX_WHEEL_POS)
+		{
+			return FALSE;
+		}
+
+		queued->XValue = (BYTE)x;
+		queued->YValue = (BYTE)y;
+		queued->WheelPosition = (BYTE)wheel;
+		queued->HWheelPosition = (BYTE)hwheel;
+		return TRUE;
+	}
+	case REPORTID_SCROLL:
+		//
+		// Scroll reports carry absolute finger positions, the newest wins
+		//
+		RtlCopyMemory(Pending->Data, ReportBuffer, ReportBufferLen);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static int
+CyapaReportStream(
+IN PVOID ReportBuffer
+)
+{
+	switch (((BYTE *)ReportBuffer)[0])
+	{
+	case REPORTID_RELATIVE_MOUSE:
+		return CYAPA_REPORT_STREAM_MOUSE;
+	case REPORTID_SCROLL:
+		return CYAPA_REPORT_STREAM_SCROLL;
+	}
+
+	return -1;
+}
+
+static BOOLEAN
+CyapaReportsPending(
+IN PCYAPA_REPORT_RING Ring
+)
+{
+	if (Ring->Count != 0)
+		return TRUE;
+
+	for (int i = 0; i < CYAPA_REPORT_STREAMS; i++)
+	{
+		if (Ring->Latest[i].Length != 0)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static BOOLEAN
+CyapaAppendReport(
+IN PCYAPA_REPORT_RING Ring,
 IN PVOID ReportBuffer,
 IN ULONG ReportBufferLen,
-OUT size_t* BytesWritten
+IN LONGLONG Ticks,
+IN BOOLEAN Transition
 )
 {
-	NTSTATUS status = STATUS_SUCCESS;
+	PCYAPA_PENDING_REPORT pending;
+
+	if (Ring->Count == CYAPA_REPORT_RING_SIZE)
+		return FALSE;
+
+	//
+	// A report built by CyapaBeginReport may already be sitting in the slot
+	//
+
+	pending = &Ring->Reports[(Ring->Head + Ring->Count) % CYAPA_REPORT_RING_SIZE];
+	if (pending->Data != ReportBuffer)
+		RtlCopyMemory(pending->Data, ReportBuffer, ReportBufferLen);
+	pending->Length = ReportBufferLen;
+	pending->Ticks = Ticks;
+	pending->Transition = Transition;
+
+	Ring->Count++;
+	return TRUE;
+}
+
+//
+// Moves a stream's waiting value to the back of the ordered queue. The
+// report being committed is moved out of that slot first.
+//
+
+static BOOLEAN
+CyapaFlushStream(
+IN PCYAPA_REPORT_RING Ring,
+IN PCYAPA_REPORT_WRITER Writer,
+IN int Stream
+)
+{
+	PCYAPA_PENDING_REPORT latest = &Ring->Latest[Stream];
+
+	if (latest->Length == 0)
+		return TRUE;
+
+	if (Writer->Slot != NULL && Writer->Buffer == Writer->Slot->Data)
+	{
+		RtlCopyMemory(Writer->Scratch, Writer->Buffer, Writer->Length);
+		Writer->Buffer = Writer->Scratch;
+	}
+
+	if (!CyapaAppendReport(Ring, latest->Data, latest->Length, latest->Ticks, FALSE))
+		return FALSE;
+
+	latest->Length = 0;
+	return TRUE;
+}
+
+//
+// The report the next read gets: the oldest queued transition, otherwise
+// the stream value that has waited longest. It stays pending until
+// CyapaRemoveReport.
+//
+
+static PCYAPA_PENDING_REPORT
+CyapaNextReport(
+IN PCYAPA_REPORT_RING Ring
+)
+{
+	PCYAPA_PENDING_REPORT oldest = NULL;
+
+	if (Ring->Count != 0)
+		return &Ring->Reports[Ring->Head];
+
+	for (int i = 0; i < CYAPA_REPORT_STREAMS; i++)
+	{
+		if (Ring->Latest[i].Length != 0 &&
+			(oldest == NULL || Ring->Latest[i].Ticks < oldest->Ticks))
+		{
+			oldest = &Ring->Latest[i];
+		}
+	}
+
+	return oldest;
+}
+
+static VOID
+CyapaRemoveReport(
+IN PCYAPA_REPORT_RING Ring,
+IN PCYAPA_PENDING_REPORT Report
+)
+{
+	if (Ring->Count != 0 && Report == &Ring->Reports[Ring->Head])
+	{
+		Ring->Head = (Ring->Head + 1) % CYAPA_REPORT_RING_SIZE;
+		Ring->Count--;
+		return;
+	}
+
+	Report->Length = 0;
+}
+
+PVOID
+CyapaBeginReport(
+IN PDEVICE_CONTEXT DevContext,
+IN ULONG ReportBufferLen,
+OUT PCYAPA_REPORT_WRITER Writer
+)
+{
+	NTSTATUS status;
 	WDFREQUEST reqRead;
 	PVOID pReadReport = NULL;
 	size_t bytesReturned = 0;
+	PCYAPA_REPORT_RING ring = &DevContext->ReportRing;
 
-	CyapaPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL,
-		"CyapaProcessVendorReport Entry\n");
+	if (ReportBufferLen > CYAPA_REPORT_MAX_SIZE)
+	{
+		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+			"CyapaBeginReport report too large (%d)\n", ReportBufferLen);
+
+		return NULL;
+	}
 
-	status = WdfIoQueueRetrieveNextRequest(DevContext->ReportQueue,
-		&reqRead);
+	Writer->Request = NULL;
+	Writer->Slot = NULL;
+	Writer->Length = ReportBufferLen;
+	Writer->Ticks = CyapaTicks();
 
-	if (NT_SUCCESS(status))
+	//
+	// Held until CyapaCommitReport, filling in a report is only a few stores
+	//
+
+	WdfSpinLockAcquire(DevContext->ReportLock);
+
+	//
+	// Only build the report straight into a pending read when nothing is
+	// queued ahead of it
+	//
+
+	while (!CyapaReportsPending(ring) &&
+		NT_SUCCESS(WdfIoQueueRetrieveNextRequest(DevContext->ReportQueue, &reqRead)))
 	{
 		status = WdfRequestRetrieveOutputBuffer(reqRead,
 			ReportBufferLen,
@@ -306,54 +542,199 @@ OUT size_t* BytesWritten
 
 		if (NT_SUCCESS(status))
 		{
-			//
-			// Copy ReportBuffer into read request
-			//
+			Writer->Request = reqRead;
+			Writer->Buffer = pReadReport;
+			return pReadReport;
+		}
 
-			if (bytesReturned > ReportBufferLen)
-			{
-				bytesReturned = ReportBufferLen;
-			}
+		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+			"WdfRequestRetrieveOutputBuffer failed Status 0x%x\n", status);
+
+		//
+		// Completion may send the next read straight back in here
+		//
+		WdfSpinLockRelease(DevContext->ReportLock);
+		WdfRequestComplete(reqRead, status);
+		WdfSpinLockAcquire(DevContext->ReportLock);
+	}
 
-			RtlCopyMemory(pReadReport,
-				ReportBuffer,
-				bytesReturned);
+	//
+	// No read pending, build it in the free slot after the newest queued
+	// transition. It only becomes part of the ring on commit, when it turns
+	// out to be a transition itself.
+	//
 
-			//
-			// Complete read with the number of bytes returned as info
-			//
+	if (ring->Count < CYAPA_REPORT_RING_SIZE)
+	{
+		Writer->Slot = &ring->Reports[(ring->Head + ring->Count) % CYAPA_REPORT_RING_SIZE];
+		Writer->Buffer = Writer->Slot->Data;
+	}
+	else
+	{
+		Writer->Buffer = Writer->Scratch;
+	}
+
+	return Writer->Buffer;
+}
+
+NTSTATUS
+CyapaCommitReport(
+IN PDEVICE_CONTEXT DevContext,
+IN PCYAPA_REPORT_WRITER Writer,
+OUT size_t* BytesWritten
+)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	PCYAPA_REPORT_RING ring = &DevContext->ReportRing;
+	BYTE reportId = ((BYTE *)Writer->Buffer)[0];
+	BOOLEAN transition;
+	int stream;
+	PCYAPA_PENDING_REPORT latest;
+	ULONG traceResult;
+
+	transition = CyapaReportIsTransition(ring, Writer->Buffer);
+
+	if (Writer->Request != NULL)
+	{
+		WdfSpinLockRelease(DevContext->ReportLock);
 
-			WdfRequestCompleteWithInformation(reqRead,
-				status,
-				bytesReturned);
+		//
+		// Complete read with the number of bytes returned as info
+		//
 
-			CyapaPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
-				"CyapaProcessVendorReport %d bytes returned\n", bytesReturned);
+		WdfRequestCompleteWithInformation(Writer->Request,
+			STATUS_SUCCESS,
+			Writer->Length);
 
+		InterlockedIncrement(&DevContext->ReportsDelivered);
+
+		//
+		// No queueing, but the lock wait and the time spent filling the
+		// report in still count
+		//
+		LONGLONG waited = CyapaTicks() - Writer->Ticks;
+
+		CyapaRecordLatency(&DevContext->ReportLatency,
+			waited, DevContext->TicksPerSecond);
+		CyapaRecordLatency(transition ? &DevContext->TransitionLatency : &DevContext->ContinuousLatency,
+			waited, DevContext->TicksPerSecond);
+
+		TraceEvent(&DevContext->TraceSink, TRACE_EVENT_REPORT, reportId, TRACE_REPORT_SENT);
+
+		*BytesWritten = Writer->Length;
+
+		CyapaPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+			"%s completed, Queue:0x%p, Request:0x%p\n",
+			DbgHidInternalIoctlString(IOCTL_HID_READ_REPORT),
+			DevContext->ReportQueue,
+			Writer->Request);
+
+		return status;
+	}
+
+	stream = CyapaReportStream(Writer->Buffer);
+	traceResult = TRACE_REPORT_QUEUED;
+
+	if (stream >= 0 && !transition)
+	{
+		//
+		// Continuous report, merged into the stream's waiting value
+		//
+
+		latest = &ring->Latest[stream];
+
+		if (latest->Length != 0 &&
+			CyapaCoalesceReport(latest, Writer->Buffer, Writer->Length))
+		{
+			ring->Coalesced++;
+		}
+		else
+		{
+			if (latest->Length != 0 && !CyapaFlushStream(ring, Writer, stream))
+			{
+				//
+				// Too much to merge and no room to keep both
+				//
+				ring->Dropped++;
+			}
+
+			RtlCopyMemory(latest->Data, Writer->Buffer, Writer->Length);
+			latest->Length = Writer->Length;
+			latest->Ticks = Writer->Ticks;
+			latest->Transition = FALSE;
+			ring->Queued++;
+		}
+	}
+	else
+	{
+		//
+		// Transition, after whatever its stream still has waiting so the
+		// two stay in order
+		//
+
+		if (stream >= 0 && !CyapaFlushStream(ring, Writer, stream))
+		{
 			//
-			// Return the number of bytes written for the write request completion
+			// No room for both, the stale stream value goes
 			//
+			ring->Latest[stream].Length = 0;
+			ring->Dropped++;
+		}
 
-			*BytesWritten = bytesReturned;
-
-			CyapaPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
-				"%s completed, Queue:0x%p, Request:0x%p\n",
-				DbgHidInternalIoctlString(IOCTL_HID_READ_REPORT),
-				DevContext->ReportQueue,
-				reqRead);
+		if (CyapaAppendReport(ring, Writer->Buffer, Writer->Length, Writer->Ticks, TRUE))
+		{
+			ring->Queued++;
 		}
 		else
 		{
-			CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
-				"WdfRequestRetrieveOutputBuffer failed Status 0x%x\n", status);
+			ring->Dropped++;
+			traceResult = TRACE_REPORT_DROPPED;
+			status = STATUS_INSUFFICIENT_RESOURCES;
 		}
 	}
+
+	WdfSpinLockRelease(DevContext->ReportLock);
+
+	TraceEvent(&DevContext->TraceSink, TRACE_EVENT_REPORT, reportId, traceResult);
+
+	if (NT_SUCCESS(status))
+	{
+		*BytesWritten = Writer->Length;
+	}
 	else
 	{
 		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
-			"WdfIoQueueRetrieveNextRequest failed Status 0x%x\n", status);
+			"Report queue full, dropping report %d\n", reportId);
 	}
 
+	return status;
+}
+
+NTSTATUS
+CyapaProcessVendorReport(
+IN PDEVICE_CONTEXT DevContext,
+IN PVOID ReportBuffer,
+IN ULONG ReportBufferLen,
+OUT size_t* BytesWritten
+)
+{
+	NTSTATUS status;
+	CYAPA_REPORT_WRITER writer;
+	PVOID report;
+
+	CyapaPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL,
+		"CyapaProcessVendorReport Entry\n");
+
+	report = CyapaBeginReport(DevContext, ReportBufferLen, &writer);
+	if (report == NULL)
+	{
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	RtlCopyMemory(report, ReportBuffer, ReportBufferLen);
+
+	status = CyapaCommitReport(DevContext, &writer, BytesWritten);
+
 	CyapaPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL,
 		"CyapaProcessVendorReport Exit = 0x%x\n", status);
 
@@ -368,20 +749,99 @@ OUT BOOLEAN* CompleteRequest
 )
 {
 	NTSTATUS status = STATUS_SUCCESS;
+	PCYAPA_PENDING_REPORT next;
+	PVOID pReadReport = NULL;
+	size_t bufferLength = 0;
+	ULONG length = 0;
+	LONGLONG ticks = 0;
+	BOOLEAN transition = FALSE;
 
 	CyapaPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL,
 		"CyapaReadReport Entry\n");
 
 	//
-	// Forward this read request to our manual queue
-	// (in other words, we are going to defer this request
-	// until we have a corresponding write request to
-	// match it with)
+	// Get hold of the buffer first, a report is only taken off the ring
+	// once there is somewhere to put it
 	//
 
-	status = WdfRequestForwardToIoQueue(Request, DevContext->ReportQueue);
+	status = WdfRequestRetrieveOutputBuffer(Request,
+		1,
+		&pReadReport,
+		&bufferLength);
 
 	if (!NT_SUCCESS(status))
+	{
+		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+			"WdfRequestRetrieveOutputBuffer failed Status 0x%x\n", status);
+
+		*CompleteRequest = TRUE;
+		return status;
+	}
+
+	WdfSpinLockAcquire(DevContext->ReportLock);
+
+	next = CyapaNextReport(&DevContext->ReportRing);
+
+	if (next == NULL)
+	{
+		//
+		// Forward this read request to our manual queue
+		// (in other words, we are going to defer this request
+		// until we have a corresponding write request to
+		// match it with)
+		//
+
+		status = WdfRequestForwardToIoQueue(Request, DevContext->ReportQueue);
+	}
+	else if (next->Length > bufferLength)
+	{
+		//
+		// Fail this read and leave the report for the next one
+		//
+
+		length = next->Length;
+		status = STATUS_BUFFER_TOO_SMALL;
+	}
+	else
+	{
+		length = next->Length;
+		ticks = next->Ticks;
+		transition = next->Transition;
+
+		RtlCopyMemory(pReadReport, next->Data, length);
+		CyapaRemoveReport(&DevContext->ReportRing, next);
+	}
+
+	WdfSpinLockRelease(DevContext->ReportLock);
+
+	if (next != NULL)
+	{
+		if (NT_SUCCESS(status))
+		{
+			//
+			// A report was already waiting, complete the read with it
+			//
+
+			WdfRequestSetInformation(Request, length);
+
+			LONGLONG waited = CyapaTicks() - ticks;
+
+			CyapaRecordLatency(&DevContext->ReportLatency,
+				waited, DevContext->TicksPerSecond);
+			CyapaRecordLatency(transition ? &DevContext->TransitionLatency : &DevContext->ContinuousLatency,
+				waited, DevContext->TicksPerSecond);
+			InterlockedIncrement(&DevContext->ReportsDelivered);
+		}
+		else
+		{
+			CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+				"CyapaReadReport buffer too small (%d) for report of %d bytes\n",
+				(ULONG)bufferLength, length);
+		}
+
+		*CompleteRequest = TRUE;
+	}
+	else if (!NT_SUCCESS(status))
 	{
 		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
 			"WdfRequestForwardToIoQueue failed Status 0x%x\n", status);
@@ -447,18 +907,25 @@ CyapaWriteReport(
 
 				pScrollCtrlReport = (CyapaScrollControlReport *)transferPacket->reportBuffer;
 
+				WdfSpinLockAcquire(DevContext->GestureLock);
 				if (pScrollCtrlReport->Flag == 1) {
 					DevContext->sc.scrollInertiaActive = 1;
 				}
 				else {
 					DevContext->sc.scrollInertiaActive = 0;
 				}
+				WdfSpinLockRelease(DevContext->GestureLock);
 
 				break;
 
 			case REPORTID_SETTINGS:
 				pSettingsReport = (CyapaSettingsReport *)transferPacket->reportBuffer;
-				ProcessSetting(DevContext, &DevContext->sc, pSettingsReport->SettingsRegister, pSettingsReport->SettingsValue);
+				status = ProcessSetting(DevContext, &DevContext->sc, pSettingsReport->SettingsRegister, pSettingsReport->SettingsValue);
+				if (!NT_SUCCESS(status))
+				{
+					CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"CyapaWriteReport Unknown settings register %d\n", pSettingsReport->SettingsRegister);
+				}
 				break;
 			default:
 
@@ -553,6 +1020,56 @@ OUT BOOLEAN* CompleteRequest
 				break;
 			}
 
+			case REPORTID_RELATIVE_MOUSE:
+			{
+
+				CyapaWheelFeatureReport* pReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(CyapaWheelFeatureReport))
+				{
+					pReport = (CyapaWheelFeatureReport*)transferPacket->reportBuffer;
+
+					pReport->Multipliers = DevContext->sc.wheelmultipliers;
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"CyapaGetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(CyapaWheelFeatureReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(CyapaWheelFeatureReport));
+				}
+
+				break;
+			}
+
+			case REPORTID_TOUCHPAD:
+			{
+
+				CyapaTouchpadCapsReport* pReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(CyapaTouchpadCapsReport))
+				{
+					pReport = (CyapaTouchpadCapsReport*)transferPacket->reportBuffer;
+
+					pReport->ContactCountMaximum = TOUCHPAD_CONTACTS;
+
+					pReport->PadType = TOUCHPAD_PAD_TYPE_CLICKPAD;
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"CyapaGetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(CyapaTouchpadCapsReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(CyapaTouchpadCapsReport));
+				}
+
+				break;
+			}
+
 			default:
 
 				CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
@@ -571,6 +1088,148 @@ OUT BOOLEAN* CompleteRequest
 	return status;
 }
 
+NTSTATUS
+CyapaSetFeature(
+IN PDEVICE_CONTEXT DevContext,
+IN WDFREQUEST Request
+)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	WDF_REQUEST_PARAMETERS params;
+	PHID_XFER_PACKET transferPacket = NULL;
+
+	CyapaPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL,
+		"CyapaSetFeature Entry\n");
+
+	WDF_REQUEST_PARAMETERS_INIT(&params);
+	WdfRequestGetParameters(Request, &params);
+
+	if (params.Parameters.DeviceIoControl.InputBufferLength < sizeof(HID_XFER_PACKET))
+	{
+		CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+			"CyapaSetFeature Xfer packet too small\n");
+
+		status = STATUS_BUFFER_TOO_SMALL;
+	}
+	else
+	{
+
+		transferPacket = (PHID_XFER_PACKET)WdfRequestWdmGetIrp(Request)->UserBuffer;
+
+		if (transferPacket == NULL)
+		{
+			CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+				"CyapaSetFeature No xfer packet\n");
+
+			status = STATUS_INVALID_DEVICE_REQUEST;
+		}
+		else
+		{
+			//
+			// switch on the report id
+			//
+
+			switch (transferPacket->reportId)
+			{
+			case REPORTID_FEATURE:
+			{
+
+				CyapaFeatureReport* pReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(CyapaFeatureReport))
+				{
+					pReport = (CyapaFeatureReport*)transferPacket->reportBuffer;
+
+					if (pReport->DeviceMode == DEVICE_MODE_MOUSE ||
+						pReport->DeviceMode == DEVICE_MODE_TOUCHPAD)
+					{
+						//
+						// Frames are handled under GestureLock, so the switch
+						// lands between two of them. The engine lets go of
+						// any key or button it holds (LALT for alt-tab, a
+						// drag) and starts over, so nothing from before the
+						// switch carries into the next mouse mode frames.
+						//
+						WdfSpinLockAcquire(DevContext->GestureLock);
+						if (DevContext->DeviceMode != pReport->DeviceMode)
+						{
+							GestureReset(&DevContext->Sink, &DevContext->sc);
+							DevContext->DeviceMode = pReport->DeviceMode;
+							RtlZeroMemory(&DevContext->Touchpad, sizeof(DevContext->Touchpad));
+						}
+						WdfSpinLockRelease(DevContext->GestureLock);
+
+						CyapaPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+							"CyapaSetFeature DeviceMode = 0x%x\n", DevContext->DeviceMode);
+					}
+					else
+					{
+						status = STATUS_INVALID_PARAMETER;
+
+						CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+							"CyapaSetFeature Unsupported DeviceMode 0x%x\n", pReport->DeviceMode);
+					}
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"CyapaSetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(CyapaFeatureReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(CyapaFeatureReport));
+				}
+
+				break;
+			}
+
+			case REPORTID_RELATIVE_MOUSE:
+			{
+
+				CyapaWheelFeatureReport* pReport = NULL;
+
+				if (transferPacket->reportBufferLen == sizeof(CyapaWheelFeatureReport))
+				{
+					pReport = (CyapaWheelFeatureReport*)transferPacket->reportBuffer;
+
+					WdfSpinLockAcquire(DevContext->GestureLock);
+					DevContext->sc.wheelmultipliers = pReport->Multipliers & MOUSE_WHEEL_MULTIPLIER_MASK;
+					WdfSpinLockRelease(DevContext->GestureLock);
+
+					CyapaPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+						"CyapaSetFeature Wheel multipliers = 0x%x\n", pReport->Multipliers);
+				}
+				else
+				{
+					status = STATUS_INVALID_PARAMETER;
+
+					CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+						"CyapaSetFeature Error transferPacket->reportBufferLen (%d) is different from sizeof(CyapaWheelFeatureReport) (%d)\n",
+						transferPacket->reportBufferLen,
+						sizeof(CyapaWheelFeatureReport));
+				}
+
+				break;
+			}
+
+			default:
+
+				CyapaPrint(DEBUG_LEVEL_ERROR, DBG_IOCTL,
+					"CyapaSetFeature Unhandled report type %d\n", transferPacket->reportId);
+
+				status = STATUS_INVALID_PARAMETER;
+
+				break;
+			}
+		}
+	}
+
+	CyapaPrint(DEBUG_LEVEL_VERBOSE, DBG_IOCTL,
+		"CyapaSetFeature Exit = 0x%x\n", status);
+
+	return status;
+}
+
 PCHAR
 DbgHidInternalIoctlString(
 IN ULONG IoControlCode
@@ -38,6 +38,44 @@
 
 typedef UCHAR HID_REPORT_DESCRIPTOR, *PHID_REPORT_DESCRIPTOR;
 
+//
+// One contact of the touchpad report. X/Y extents are placeholders, they
+// get patched with the sensor size (in 0.1 mm) once it is known.
+//
+#define TOUCHPAD_FINGER_COLLECTION \
+	0x05, 0x0d,                         /*   USAGE_PAGE (Digitizers)            */ \
+	0x09, 0x22,                         /*   USAGE (Finger)                     */ \
+	0xa1, 0x02,                         /*   COLLECTION (Logical)               */ \
+	0x15, 0x00,                         /*     LOGICAL_MINIMUM (0)              */ \
+	0x25, 0x01,                         /*     LOGICAL_MAXIMUM (1)              */ \
+	0x75, 0x01,                         /*     REPORT_SIZE (1)                  */ \
+	0x95, 0x01,                         /*     REPORT_COUNT (1)                 */ \
+	0x09, 0x47,                         /*     USAGE (Confidence)               */ \
+	0x81, 0x02,                         /*     INPUT (Data,Var,Abs)             */ \
+	0x09, 0x42,                         /*     USAGE (Tip Switch)               */ \
+	0x81, 0x02,                         /*     INPUT (Data,Var,Abs)             */ \
+	0x95, 0x06,                         /*     REPORT_COUNT (6)                 */ \
+	0x81, 0x03,                         /*     INPUT (Cnst,Var,Abs)             */ \
+	0x25, 0x0f,                         /*     LOGICAL_MAXIMUM (15)             */ \
+	0x75, 0x08,                         /*     REPORT_SIZE (8)                  */ \
+	0x95, 0x01,                         /*     REPORT_COUNT (1)                 */ \
+	0x09, 0x51,                         /*     USAGE (Contact Identifier)       */ \
+	0x81, 0x02,                         /*     INPUT (Data,Var,Abs)             */ \
+	0x05, 0x01,                         /*     USAGE_PAGE (Generic Desktop)     */ \
+	0x55, 0x0e,                         /*     UNIT_EXPONENT (-2)               */ \
+	0x65, 0x11,                         /*     UNIT (SI Lin: cm)                */ \
+	0x35, 0x00,                         /*     PHYSICAL_MINIMUM (0)             */ \
+	0x75, 0x10,                         /*     REPORT_SIZE (16)                 */ \
+	0x26, 0xe8, 0x03,                   /*     LOGICAL_MAXIMUM (1000)           */ \
+	0x46, 0xe8, 0x03,                   /*     PHYSICAL_MAXIMUM (1000)          */ \
+	0x09, 0x30,                         /*     USAGE (X)                        */ \
+	0x81, 0x02,                         /*     INPUT (Data,Var,Abs)             */ \
+	0x26, 0xbc, 0x02,                   /*     LOGICAL_MAXIMUM (700)            */ \
+	0x46, 0xbc, 0x02,                   /*     PHYSICAL_MAXIMUM (700)           */ \
+	0x09, 0x31,                         /*     USAGE (Y)                        */ \
+	0x81, 0x02,                         /*     INPUT (Data,Var,Abs)             */ \
+	0xc0                                /*   END_COLLECTION                     */
+
 #ifdef DEFINEDESCRIPTOR
 HID_REPORT_DESCRIPTOR DefaultReportDescriptor[] = {
 	//
@@ -67,21 +105,48 @@ HID_REPORT_DESCRIPTOR DefaultReportDescriptor[] = {
 	0x75, 0x08,                         //     REPORT_SIZE (8)
 	0x95, 0x02,                         //     REPORT_COUNT (2)
 	0x81, 0x06,                         //     INPUT (Data,Var,Rel)
-	0x05, 0x01,                         //     Usage Page (Generic Desktop)
-	0x09, 0x38,                         //     Usage (Wheel)
-	0x15, 0x81,                         //     Logical Minimum (-127)
-	0x25, 0x7F,                         //     Logical Maximum (127)
-	0x75, 0x08,                         //     Report Size (8)
-	0x95, 0x01,                         //     Report Count (1)
-	0x81, 0x06,                         //     Input (Data, Variable, Relative)
+	0xa1, 0x02,                         //     COLLECTION (Logical)
+	0x09, 0x48,                         //       USAGE (Resolution Multiplier)
+	0x15, 0x00,                         //       LOGICAL_MINIMUM (0)
+	0x25, 0x01,                         //       LOGICAL_MAXIMUM (1)
+	0x35, 0x01,                         //       PHYSICAL_MINIMUM (1)
+	0x45, MOUSE_WHEEL_MULTIPLIER,       //       PHYSICAL_MAXIMUM (8)
+	0x75, 0x02,                         //       REPORT_SIZE (2)
+	0x95, 0x01,                         //       REPORT_COUNT (1)
+	0xb1, 0x02,                         //       FEATURE (Data,Var,Abs)
+	0x35, 0x00,                         //       PHYSICAL_MINIMUM (0)
+	0x45, 0x00,                         //       PHYSICAL_MAXIMUM (0)
+	0x05, 0x01,                         //       Usage Page (Generic Desktop)
+	0x09, 0x38,                         //       Usage (Wheel)
+	0x15, 0x81,                         //       Logical Minimum (-127)
+	0x25, 0x7F,                         //       Logical Maximum (127)
+	0x75, 0x08,                         //       Report Size (8)
+	0x95, 0x01,                         //       Report Count (1)
+	0x81, 0x06,                         //       Input (Data, Variable, Relative)
+	0xc0,                               //     END_COLLECTION
 	// ------------------------------  Horizontal wheel
-	0x05, 0x0c,                         //     USAGE_PAGE (Consumer Devices)
-	0x0a, 0x38, 0x02,                   //     USAGE (AC Pan)
-	0x15, 0x81,                         //     LOGICAL_MINIMUM (-127)
-	0x25, 0x7f,                         //     LOGICAL_MAXIMUM (127)
-	0x75, 0x08,                         //     REPORT_SIZE (8)
-	0x95, 0x01,                         //     Report Count (1)
-	0x81, 0x06,                         //     Input (Data, Variable, Relative)
+	0xa1, 0x02,                         //     COLLECTION (Logical)
+	0x05, 0x01,                         //       USAGE_PAGE (Generic Desktop)
+	0x09, 0x48,                         //       USAGE (Resolution Multiplier)
+	0x15, 0x00,                         //       LOGICAL_MINIMUM (0)
+	0x25, 0x01,                         //       LOGICAL_MAXIMUM (1)
+	0x35, 0x01,                         //       PHYSICAL_MINIMUM (1)
+	0x45, MOUSE_WHEEL_MULTIPLIER,       //       PHYSICAL_MAXIMUM (8)
+	0x75, 0x02,                         //       REPORT_SIZE (2)
+	0x95, 0x01,                         //       REPORT_COUNT (1)
+	0xb1, 0x02,                         //       FEATURE (Data,Var,Abs)
+	0x35, 0x00,                         //       PHYSICAL_MINIMUM (0)
+	0x45, 0x00,                         //       PHYSICAL_MAXIMUM (0)
+	0x75, 0x04,                         //       REPORT_SIZE (4)
+	0xb1, 0x03,                         //       FEATURE (Cnst,Var,Abs)
+	0x05, 0x0c,                         //       USAGE_PAGE (Consumer Devices)
+	0x0a, 0x38, 0x02,                   //       USAGE (AC Pan)
+	0x15, 0x81,                         //       LOGICAL_MINIMUM (-127)
+	0x25, 0x7f,                         //       LOGICAL_MAXIMUM (127)
+	0x75, 0x08,                         //       REPORT_SIZE (8)
+	0x95, 0x01,                         //       Report Count (1)
+	0x81, 0x06,                         //       Input (Data, Variable, Relative)
+	0xc0,                               //     END_COLLECTION
 	0xc0,                               //   END_COLLECTION
 	0xc0,                               // END_COLLECTION
 
@@ -130,6 +195,10 @@ HID_REPORT_DESCRIPTOR DefaultReportDescriptor[] = {
 	0x95, 0x40,                          //   REPORT_COUNT (64)  - Bytes
 	0x09, 0x02,                          //   USAGE (Vendor Usage 1)
 	0x81, 0x02,                          //   INPUT (Data,Var,Abs)
+	0x85, REPORTID_CAPTURE,              //   REPORT_ID (Capture)
+	0x95, 0x3f,                          //   REPORT_COUNT (63)  - Bytes
+	0x09, 0x04,                          //   USAGE (Vendor Usage 4)
+	0x81, 0x02,                          //   INPUT (Data,Var,Abs)
 	0xc0,                                // END_COLLECTION
 
 	//
@@ -168,6 +237,70 @@ HID_REPORT_DESCRIPTOR DefaultReportDescriptor[] = {
 	0x29, 0x65,                         //   USAGE_MAXIMUM (Keyboard Application)
 	0x81, 0x00,                         //   INPUT (Data,Ary,Abs)
 	0xc0,                               // END_COLLECTION
+
+	//
+	// Touchpad report starts here, only sent in DEVICE_MODE_TOUCHPAD
+	//
+	0x05, 0x0d,                         // USAGE_PAGE (Digitizers)
+	0x09, 0x05,                         // USAGE (Touch Pad)
+	0xa1, 0x01,                         // COLLECTION (Application)
+	0x85, REPORTID_TOUCHPAD,            //   REPORT_ID (Touch pad)
+	TOUCHPAD_FINGER_COLLECTION,
+	TOUCHPAD_FINGER_COLLECTION,
+	TOUCHPAD_FINGER_COLLECTION,
+	TOUCHPAD_FINGER_COLLECTION,
+	TOUCHPAD_FINGER_COLLECTION,
+	0x05, 0x0d,                         //   USAGE_PAGE (Digitizers)
+	0x55, 0x0c,                         //   UNIT_EXPONENT (-4)
+	0x66, 0x01, 0x10,                   //   UNIT (SI Lin: s)
+	0x47, 0xff, 0xff, 0x00, 0x00,       //   PHYSICAL_MAXIMUM (65535)
+	0x27, 0xff, 0xff, 0x00, 0x00,       //   LOGICAL_MAXIMUM (65535)
+	0x75, 0x10,                         //   REPORT_SIZE (16)
+	0x95, 0x01,                         //   REPORT_COUNT (1)
+	0x09, 0x56,                         //   USAGE (Scan Time)
+	0x81, 0x02,                         //   INPUT (Data,Var,Abs)
+	0x55, 0x00,                         //   UNIT_EXPONENT (0)
+	0x65, 0x00,                         //   UNIT (None)
+	0x45, 0x00,                         //   PHYSICAL_MAXIMUM (0)
+	0x25, TOUCHPAD_CONTACTS,            //   LOGICAL_MAXIMUM (5)
+	0x75, 0x08,                         //   REPORT_SIZE (8)
+	0x09, 0x54,                         //   USAGE (Contact Count)
+	0x81, 0x02,                         //   INPUT (Data,Var,Abs)
+	0x05, 0x09,                         //   USAGE_PAGE (Button)
+	0x09, 0x01,                         //   USAGE (Button 1)
+	0x25, 0x01,                         //   LOGICAL_MAXIMUM (1)
+	0x75, 0x01,                         //   REPORT_SIZE (1)
+	0x81, 0x02,                         //   INPUT (Data,Var,Abs)
+	0x95, 0x07,                         //   REPORT_COUNT (7)
+	0x81, 0x03,                         //   INPUT (Cnst,Var,Abs)
+	0x05, 0x0d,                         //   USAGE_PAGE (Digitizers)
+	0x25, 0x0f,                         //   LOGICAL_MAXIMUM (15)
+	0x75, 0x08,                         //   REPORT_SIZE (8)
+	0x95, 0x01,                         //   REPORT_COUNT (1)
+	0x09, 0x55,                         //   USAGE (Contact Count Maximum)
+	0xb1, 0x02,                         //   FEATURE (Data,Var,Abs)
+	0x09, 0x59,                         //   USAGE (Pad Type)
+	0xb1, 0x02,                         //   FEATURE (Data,Var,Abs)
+	0xc0,                               // END_COLLECTION
+
+	//
+	// Device mode feature report, the host picks mouse or touchpad here
+	//
+	0x05, 0x0d,                         // USAGE_PAGE (Digitizers)
+	0x09, 0x0e,                         // USAGE (Device Configuration)
+	0xa1, 0x01,                         // COLLECTION (Application)
+	0x85, REPORTID_FEATURE,             //   REPORT_ID (Feature)
+	0x09, 0x22,                         //   USAGE (Finger)
+	0xa1, 0x02,                         //   COLLECTION (Logical)
+	0x09, 0x52,                         //     USAGE (Input Mode)
+	0x09, 0x53,                         //     USAGE (Device Index)
+	0x15, 0x00,                         //     LOGICAL_MINIMUM (0)
+	0x25, 0x0a,                         //     LOGICAL_MAXIMUM (10)
+	0x75, 0x08,                         //     REPORT_SIZE (8)
+	0x95, 0x02,                         //     REPORT_COUNT (2)
+	0xb1, 0x02,                         //     FEATURE (Data,Var,Abs)
+	0xc0,                               //   END_COLLECTION
+	0xc0,                               // END_COLLECTION
 };
 
 
@@ -214,6 +347,27 @@ CyapaGetString(
 IN WDFREQUEST Request
 );
 
+//
+// Builds a report in place. CyapaBeginReport returns where to write it
+// (a pending read's buffer or a report ring slot) with ReportLock held,
+// CyapaCommitReport sends or queues it and drops the lock. Returns NULL
+// for a report larger than CYAPA_REPORT_MAX_SIZE, with nothing to commit.
+//
+
+PVOID
+CyapaBeginReport(
+IN PDEVICE_CONTEXT DevContext,
+IN ULONG ReportBufferLen,
+OUT PCYAPA_REPORT_WRITER Writer
+);
+
+NTSTATUS
+CyapaCommitReport(
+IN PDEVICE_CONTEXT DevContext,
+IN PCYAPA_REPORT_WRITER Writer,
+OUT size_t* BytesWritten
+);
+
 NTSTATUS
 CyapaProcessVendorReport(
 IN PDEVICE_CONTEXT DevContext,
@@ -242,6 +396,12 @@ IN WDFREQUEST Request,
 OUT BOOLEAN* CompleteRequest
 );
 
+NTSTATUS
+CyapaSetFeature(
+IN PDEVICE_CONTEXT DevContext,
+IN WDFREQUEST Request
+);
+
 PCHAR
 DbgHidInternalIoctlString(
 IN ULONG        IoControlCode
@@ -27,6 +27,156 @@
 
 #include "cyapa.h"
 #include "gesturerec.h"
+#include "gesture.h"
+#include "capture.h"
+#include "touchpad.h"
+
+//
+// Ring of touch frames handed from the frame read to the gesture engine.
+// The read's completion (CyapaFrameRead, from the SPB completion or the
+// blocking fallback) is the only producer: it runs while ReadInFlight is
+// held and CyapaStartRead lets one read in flight at a time, so pushes
+// never overlap, and Head and HighWater are written without interlocks.
+// The consumer side is serialized by GestureLock. Size must be a power
+// of two.
+//
+
+#define CYAPA_FRAME_RING_SIZE 16
+
+#define CYAPA_TIMER_PERIOD_MS 10
+
+typedef struct _CYAPA_FRAME
+{
+	ULONGLONG Timestamp;
+	LONGLONG ReadTicks;
+	struct cyapa_regs Regs;
+} CYAPA_FRAME, *PCYAPA_FRAME;
+
+typedef struct _CYAPA_FRAME_RING
+{
+	volatile ULONG Head;
+	volatile ULONG Tail;
+
+	CYAPA_FRAME Frames[CYAPA_FRAME_RING_SIZE];
+
+	//
+	// Frames dropped because the ring was full, and the deepest the
+	// ring has been since the device was started
+	//
+
+	volatile LONG Overflows;
+	volatile LONG HighWater;
+} CYAPA_FRAME_RING, *PCYAPA_FRAME_RING;
+
+//
+// Reports waiting for the next IOCTL_HID_READ_REPORT, guarded by
+// ReportLock. Transitions (button, key and scroll stop reports, and any
+// report not known to be a stream) wait in Reports in the order they were
+// made and go out first. Continuous streams (relative motion, scroll
+// positions) only keep their latest value in Latest, merged as it comes
+// in, and go out once no transition is waiting. A transition on a stream's
+// report id first moves that stream's value into Reports ahead of it.
+//
+
+#define CYAPA_REPORT_RING_SIZE 32
+
+#define CYAPA_REPORT_STREAM_MOUSE	0
+#define CYAPA_REPORT_STREAM_SCROLL	1
+#define CYAPA_REPORT_STREAMS		2
+
+#define CYAPA_REPORT_MAX_SIZE 72
+
+typedef struct _CYAPA_PENDING_REPORT
+{
+	ULONG Length;
+	LONGLONG Ticks;
+	BOOLEAN Transition;
+	BYTE Data[CYAPA_REPORT_MAX_SIZE];
+} CYAPA_PENDING_REPORT, *PCYAPA_PENDING_REPORT;
+
+typedef struct _CYAPA_REPORT_RING
+{
+	ULONG Head;
+	ULONG Count;
+
+	CYAPA_PENDING_REPORT Reports[CYAPA_REPORT_RING_SIZE];
+
+	//
+	// Length 0 when the stream has nothing waiting
+	//
+
+	CYAPA_PENDING_REPORT Latest[CYAPA_REPORT_STREAMS];
+
+	//
+	// Buttons in the last relative mouse report, sent or queued
+	//
+
+	BYTE LastButton;
+
+	ULONG Queued;
+	ULONG Coalesced;
+	ULONG Dropped;
+} CYAPA_REPORT_RING, *PCYAPA_REPORT_RING;
+
+//
+// A report being built in place, see CyapaBeginReport. Scratch only
+// takes it when the ring is full, so it can still be merged.
+//
+
+typedef struct _CYAPA_REPORT_WRITER
+{
+	WDFREQUEST Request;
+	PCYAPA_PENDING_REPORT Slot;
+	PVOID Buffer;
+	ULONG Length;
+
+	//
+	// When the report was begun, before waiting for ReportLock, where its
+	// report latency is measured from
+	//
+	LONGLONG Ticks;
+
+	BYTE Scratch[CYAPA_REPORT_MAX_SIZE];
+} CYAPA_REPORT_WRITER, *PCYAPA_REPORT_WRITER;
+
+//
+// Latency histograms. Bucket i counts latencies of 2^i up to 2^(i+1) us,
+// bucket 0 also takes anything shorter and the last one anything longer.
+//
+
+#define CYAPA_LATENCY_BUCKETS 16
+
+typedef struct _CYAPA_LATENCY_HISTOGRAM
+{
+	volatile LONG Buckets[CYAPA_LATENCY_BUCKETS];
+} CYAPA_LATENCY_HISTOGRAM, *PCYAPA_LATENCY_HISTOGRAM;
+
+FORCEINLINE
+LONGLONG
+CyapaTicks(
+	VOID
+	)
+{
+	return KeQueryPerformanceCounter(NULL).QuadPart;
+}
+
+FORCEINLINE
+VOID
+CyapaRecordLatency(
+	PCYAPA_LATENCY_HISTOGRAM Histogram,
+	LONGLONG Ticks,
+	LONGLONG TicksPerSecond
+	)
+{
+	ULONGLONG us = Ticks > 0 ? (ULONGLONG)Ticks * 1000000 / TicksPerSecond : 0;
+	int bucket = 0;
+
+	while (us > 1 && bucket < CYAPA_LATENCY_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+	InterlockedIncrement(&Histogram->Buckets[bucket]);
+}
 
 //
 // Forward Declarations
@@ -70,6 +220,55 @@ struct _DEVICE_CONTEXT
 
 	BOOLEAN RegsSet;
 
+	//
+	// Set by OnInterruptIsr when a frame needs reading; cleared by whoever
+	// gets the asynchronous read onto the bus
+	//
+
+	volatile LONG ReadPending;
+
+	//
+	// Frame being assembled by the read in flight. With AdaptiveReads set
+	// only the slots the previous frame used are fetched, followed by a
+	// second read when more fingers came down
+	//
+
+	volatile LONG ReadInFlight;
+	ULONGLONG ReadTimestamp;
+	struct cyapa_regs ReadRegs;
+	UCHAR ReadSlots;
+	UCHAR LastFingers;
+	BOOLEAN AdaptiveReads;
+
+	//
+	// Retries at passive level a read that could not go out asynchronously
+	// from a completion, where the blocking fallback is not allowed
+	//
+
+	WDFWORKITEM ReadWorkItem;
+
+	ULONG FramesRead;
+	ULONG FollowUpReads;
+	ULONG ReadErrors;
+
+	//
+	// Per stage latency: interrupt to read completion, read completion to
+	// the end of gesture processing, report made to HID read completion
+	// (also split by transition and continuous reports)
+	//
+
+	LONGLONG TicksPerSecond;
+	LONGLONG InterruptTicks;
+	LONGLONG ReadStartTicks;
+
+	CYAPA_LATENCY_HISTOGRAM ReadLatency;
+	CYAPA_LATENCY_HISTOGRAM GestureLatency;
+	CYAPA_LATENCY_HISTOGRAM ReportLatency;
+	CYAPA_LATENCY_HISTOGRAM TransitionLatency;
+	CYAPA_LATENCY_HISTOGRAM ContinuousLatency;
+
+	volatile LONG ReportsDelivered;
+
     //
     // Client request object
     //
@@ -84,14 +283,87 @@ struct _DEVICE_CONTEXT
 
 	WDFTIMER Timer;
 
+	//
+	// The timer is parked while nothing is on the pad and no tap, drag or
+	// swipe is pending, and re-armed by OnInterruptIsr on the next frame
+	//
+
+	volatile LONG TimerParked;
+	ULONGLONG TimerParkTime;
+
+	volatile LONG TimerFires;
+	volatile LONG TimerFiresAvoided;
+
+	//
+	// Serializes the gesture engine between the interrupt and timer paths
+	//
+
+	WDFSPINLOCK GestureLock;
+
+	//
+	// Run the gesture engine from the interrupt as soon as a frame is read,
+	// leaving the timer to handle time based work (tap timeouts etc.)
+	//
+
+	BOOLEAN ProcessOnInterrupt;
+
+	BOOLEAN FrameProcessedSinceTick;
+
 	WDFQUEUE ReportQueue;
 
+	WDFSPINLOCK ReportLock;
+
+	CYAPA_REPORT_RING ReportRing;
+
 	BYTE DeviceMode;
 
 	ULONGLONG LastInterruptTime;
 
 	csgesture_softc sc;
 
+	//
+	// Where the gesture engine sends its reports
+	//
+
+	struct csgesture_sink Sink;
+
+	//
+	// Contacts in the last touchpad report, only used in
+	// DEVICE_MODE_TOUCHPAD where the engine is bypassed
+	//
+
+	struct touchpad_state Touchpad;
+
+	//
+	// Optional trace of raw frames and the reports made from them,
+	// pulled out through REPORTID_CAPTURE
+	//
+
+	WDFSPINLOCK CaptureLock;
+
+	struct capture_ring Capture;
+
+	//
+	// Puts the compiled-in trace events into the capture
+	//
+
+	struct trace_sink TraceSink;
+
+	//
+	// Settings as last written through REPORTID_SETTINGS, picked up by
+	// the gesture engine at the start of the next frame
+	//
+
+	csgesture_settings_block Settings;
+
+	//
+	// Serializes writers of Settings, the engine reads it without a lock
+	//
+
+	WDFSPINLOCK SettingsLock;
+
+	CYAPA_FRAME_RING FrameRing;
+
 	cyapa_regs lastregs;
 };
 
@@ -22,6 +22,21 @@ Revision History:
 #include "hiddevice.h"
 #include "spb.h"
 
+#include <spb.h>
+
+//
+// Layout of SPB_CONTEXT::AsyncMemory
+//
+
+typedef struct _SPB_ASYNC_READ
+{
+	SPB_TRANSFER_LIST_AND_ENTRIES(2) Sequence;
+	UCHAR Address;
+	UCHAR Buffer[DEFAULT_SPB_BUFFER_SIZE];
+} SPB_ASYNC_READ, *PSPB_ASYNC_READ;
+
+EVT_WDF_REQUEST_COMPLETION_ROUTINE SpbAsyncReadCompletion;
+
 NTSTATUS
 SpbDoWriteDataSynchronously(
 IN SPB_CONTEXT *SpbContext,
@@ -107,6 +122,9 @@ NTSTATUS Status indicating success or failure
 	//
 	RtlCopyMemory((buffer + sizeof(Address)), Data, length - sizeof(Address));
 
+	InterlockedIncrement(&SpbContext->Transfers);
+	InterlockedExchangeAdd64(&SpbContext->BytesTransferred, length);
+
 	status = WdfIoTargetSendWriteSynchronously(
 		SpbContext->SpbIoTarget,
 		NULL,
@@ -175,11 +193,16 @@ NTSTATUS Status indicating success or failure
 
 	WdfWaitLockRelease(SpbContext->SpbLock);
 
+	if (!NT_SUCCESS(status))
+	{
+		TraceEvent(SpbContext->TraceSink, TRACE_EVENT_SPB_ERROR, status, Address);
+	}
+
 	return status;
 }
 
 NTSTATUS
-SpbReadDataSynchronously(
+SpbDoReadDataSynchronously(
 _In_ SPB_CONTEXT *SpbContext,
 _In_ UCHAR Address,
 _In_reads_bytes_(Length) PVOID Data,
@@ -190,7 +213,8 @@ _In_ ULONG Length
 Routine Description:
 
 This helper routine abstracts creating and sending an I/O
-request (I2C Read) to the Spb I/O target.
+request (I2C Read) to the Spb I/O target as two separate
+transfers, one setting the address pointer and one reading.
 
 Arguments:
 
@@ -211,8 +235,6 @@ NTSTATUS Status indicating success or failure
 	NTSTATUS status;
 	ULONG_PTR bytesRead;
 
-	WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
-
 	memory = NULL;
 	status = STATUS_INVALID_PARAMETER;
 	bytesRead = 0;
@@ -272,6 +294,9 @@ NTSTATUS Status indicating success or failure
 	}
 
 
+	InterlockedIncrement(&SpbContext->Transfers);
+	InterlockedExchangeAdd64(&SpbContext->BytesTransferred, Length);
+
 	status = WdfIoTargetSendReadSynchronously(
 		SpbContext->SpbIoTarget,
 		NULL,
@@ -302,11 +327,421 @@ exit:
 		WdfObjectDelete(memory);
 	}
 
+	return status;
+}
+
+NTSTATUS
+SpbDoReadSequenceSynchronously(
+_In_ SPB_CONTEXT *SpbContext,
+_In_ UCHAR Address,
+_In_reads_bytes_(Length) PVOID Data,
+_In_ ULONG Length
+)
+/*++
+
+Routine Description:
+
+This helper routine reads from the Spb I/O target with a single
+write-restart-read sequence (IOCTL_SPB_EXECUTE_SEQUENCE), so the
+address pointer and the data go out in one bus transaction.
+
+Arguments:
+
+SpbContext - Pointer to the current device context
+Address    - The I2C register address to read from
+Data       - A buffer to receive the data at at the above address
+Length     - The amount of data to be read from the above address,
+			 at most DEFAULT_SPB_BUFFER_SIZE
+
+Return Value:
+
+NTSTATUS Status indicating success or failure
+
+--*/
+{
+	PUCHAR buffer;
+	PUCHAR addressBuffer;
+	WDF_MEMORY_DESCRIPTOR memoryDescriptor;
+	NTSTATUS status;
+	ULONG_PTR bytesTransferred;
+
+	SPB_TRANSFER_LIST_AND_ENTRIES(2) sequence;
+
+	addressBuffer = (PUCHAR)WdfMemoryGetBuffer(SpbContext->WriteMemory, NULL);
+	buffer = (PUCHAR)WdfMemoryGetBuffer(SpbContext->ReadMemory, NULL);
+
+	*addressBuffer = Address;
+	bytesTransferred = 0;
+
+	SPB_TRANSFER_LIST_INIT(&(sequence.List), 2);
+	sequence.List.Transfers[0] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+		SpbTransferDirectionToDevice,
+		0,
+		addressBuffer,
+		sizeof(Address));
+	sequence.List.Transfers[1] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+		SpbTransferDirectionFromDevice,
+		0,
+		buffer,
+		Length);
+
+	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
+		&memoryDescriptor,
+		(PVOID)&sequence,
+		sizeof(sequence));
+
+	InterlockedIncrement(&SpbContext->Transfers);
+	InterlockedExchangeAdd64(&SpbContext->BytesTransferred, sizeof(Address) + Length);
+
+	status = WdfIoTargetSendIoctlSynchronously(
+		SpbContext->SpbIoTarget,
+		NULL,
+		IOCTL_SPB_EXECUTE_SEQUENCE,
+		&memoryDescriptor,
+		NULL,
+		NULL,
+		&bytesTransferred);
+
+	if (!NT_SUCCESS(status))
+	{
+		CyapaPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_IOCTL,
+			"Error executing Spb read sequence - %!STATUS!",
+			status);
+		return status;
+	}
+
+	if (bytesTransferred != sizeof(Address) + Length)
+	{
+		status = STATUS_DEVICE_PROTOCOL_ERROR;
+
+		CyapaPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_IOCTL,
+			"Short Spb read sequence (%Iu bytes) - %!STATUS!",
+			bytesTransferred,
+			status);
+		return status;
+	}
+
+	//
+	// Copy back to the caller's buffer
+	//
+	RtlCopyMemory(Data, buffer, Length);
+
+	return status;
+}
+
+NTSTATUS
+SpbReadDataSynchronously(
+_In_ SPB_CONTEXT *SpbContext,
+_In_ UCHAR Address,
+_In_reads_bytes_(Length) PVOID Data,
+_In_ ULONG Length
+)
+/*++
+
+Routine Description:
+
+This routine abstracts creating and sending an I/O
+request (I2C Read) to the Spb I/O target. It uses a single
+write-restart-read sequence when the controller supports it
+and falls back to separate write and read transfers otherwise.
+
+Arguments:
+
+SpbContext - Pointer to the current device context
+Address    - The I2C register address to read from
+Data       - A buffer to receive the data at at the above address
+Length     - The amount of data to be read from the above address
+
+Return Value:
+
+NTSTATUS Status indicating success or failure
+
+--*/
+{
+	NTSTATUS status;
+
+	WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
+
+	if (!SpbContext->SequenceUnsupported &&
+		Length <= DEFAULT_SPB_BUFFER_SIZE)
+	{
+		status = SpbDoReadSequenceSynchronously(
+			SpbContext,
+			Address,
+			Data,
+			Length);
+
+		if (status != STATUS_NOT_SUPPORTED &&
+			status != STATUS_INVALID_DEVICE_REQUEST)
+		{
+			goto exit;
+		}
+
+		//
+		// The controller does not do sequences, stick to two transfers
+		//
+		SpbContext->SequenceUnsupported = TRUE;
+	}
+
+	status = SpbDoReadDataSynchronously(
+		SpbContext,
+		Address,
+		Data,
+		Length);
+
+exit:
+
 	WdfWaitLockRelease(SpbContext->SpbLock);
 
+	if (!NT_SUCCESS(status))
+	{
+		TraceEvent(SpbContext->TraceSink, TRACE_EVENT_SPB_ERROR, status, Address);
+	}
+
 	return status;
 }
 
+VOID
+SpbAsyncReadCompletion(
+_In_ WDFREQUEST Request,
+_In_ WDFIOTARGET Target,
+_In_ PWDF_REQUEST_COMPLETION_PARAMS Params,
+_In_ WDFCONTEXT Context
+)
+/*++
+
+Routine Description:
+
+Completion routine for SpbReadDataAsynchronously. The data is copied out
+of the preallocated buffer and the request released before the caller's
+completion runs, so the next read can be started while this one is still
+being handled.
+
+Arguments:
+
+Request - The preallocated read request
+Target  - The Spb I/O target
+Params  - Completion parameters
+Context - Pointer to the SPB_CONTEXT
+
+Return Value:
+
+None
+
+--*/
+{
+	SPB_CONTEXT *SpbContext = (SPB_CONTEXT *)Context;
+	PSPB_ASYNC_READ asyncRead;
+	PSPB_READ_COMPLETION completion;
+	PVOID completionContext;
+	UCHAR data[DEFAULT_SPB_BUFFER_SIZE];
+	ULONG length;
+	NTSTATUS status;
+
+	UNREFERENCED_PARAMETER(Request);
+	UNREFERENCED_PARAMETER(Target);
+
+	asyncRead = (PSPB_ASYNC_READ)WdfMemoryGetBuffer(SpbContext->AsyncMemory, NULL);
+
+	completion = SpbContext->AsyncCompletion;
+	completionContext = SpbContext->AsyncCompletionContext;
+	length = SpbContext->AsyncLength;
+	status = Params->IoStatus.Status;
+
+	if (NT_SUCCESS(status) &&
+		Params->IoStatus.Information != sizeof(asyncRead->Address) + length)
+	{
+		status = STATUS_DEVICE_PROTOCOL_ERROR;
+	}
+
+	if (status == STATUS_NOT_SUPPORTED ||
+		status == STATUS_INVALID_DEVICE_REQUEST)
+	{
+		SpbContext->SequenceUnsupported = TRUE;
+	}
+
+	if (!NT_SUCCESS(status))
+	{
+		CyapaPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_IOCTL,
+			"Error in asynchronous Spb read - %!STATUS!",
+			status);
+
+		TraceEvent(SpbContext->TraceSink, TRACE_EVENT_SPB_ERROR, status, asyncRead->Address);
+	}
+	else
+	{
+		RtlCopyMemory(data, asyncRead->Buffer, length);
+	}
+
+	InterlockedExchange(&SpbContext->AsyncBusy, 0);
+
+	completion(completionContext, status, data, NT_SUCCESS(status) ? length : 0);
+}
+
+NTSTATUS
+SpbReadDataAsynchronously(
+_In_ SPB_CONTEXT *SpbContext,
+_In_ UCHAR Address,
+_In_ ULONG Length,
+_In_ PSPB_READ_COMPLETION Completion,
+_In_ PVOID Context
+)
+/*++
+
+Routine Description:
+
+This routine starts a read from the Spb I/O target with a single
+write-restart-read sequence on the preallocated request, without
+waiting for it. Completion is called once the read finishes.
+
+Arguments:
+
+SpbContext - Pointer to the current device context
+Address    - The I2C register address to read from
+Length     - The amount of data to be read from the above address,
+			 at most DEFAULT_SPB_BUFFER_SIZE
+Completion - Routine called with the data once the read completes
+Context    - Context passed to Completion
+
+Return Value:
+
+STATUS_PENDING if the read was started, STATUS_DEVICE_BUSY if a read
+is already in flight, or an error if the caller should fall back to
+SpbReadDataSynchronously
+
+--*/
+{
+	PSPB_ASYNC_READ asyncRead;
+	WDF_REQUEST_REUSE_PARAMS reuseParams;
+	WDFMEMORY_OFFSET sequenceOffset;
+	NTSTATUS status;
+
+	if (SpbContext->AsyncRequest == NULL ||
+		SpbContext->SequenceUnsupported ||
+		Length > DEFAULT_SPB_BUFFER_SIZE)
+	{
+		return STATUS_NOT_SUPPORTED;
+	}
+
+	if (InterlockedCompareExchange(&SpbContext->AsyncBusy, 1, 0) != 0)
+	{
+		return STATUS_DEVICE_BUSY;
+	}
+
+	WDF_REQUEST_REUSE_PARAMS_INIT(
+		&reuseParams,
+		WDF_REQUEST_REUSE_NO_FLAGS,
+		STATUS_SUCCESS);
+
+	status = WdfRequestReuse(SpbContext->AsyncRequest, &reuseParams);
+
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
+	asyncRead = (PSPB_ASYNC_READ)WdfMemoryGetBuffer(SpbContext->AsyncMemory, NULL);
+	asyncRead->Address = Address;
+
+	SPB_TRANSFER_LIST_INIT(&(asyncRead->Sequence.List), 2);
+	asyncRead->Sequence.List.Transfers[0] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+		SpbTransferDirectionToDevice,
+		0,
+		&asyncRead->Address,
+		sizeof(asyncRead->Address));
+	asyncRead->Sequence.List.Transfers[1] = SPB_TRANSFER_LIST_ENTRY_INIT_SIMPLE(
+		SpbTransferDirectionFromDevice,
+		0,
+		asyncRead->Buffer,
+		Length);
+
+	sequenceOffset.BufferOffset = FIELD_OFFSET(SPB_ASYNC_READ, Sequence);
+	sequenceOffset.BufferLength = sizeof(asyncRead->Sequence);
+
+	status = WdfIoTargetFormatRequestForIoctl(
+		SpbContext->SpbIoTarget,
+		SpbContext->AsyncRequest,
+		IOCTL_SPB_EXECUTE_SEQUENCE,
+		SpbContext->AsyncMemory,
+		&sequenceOffset,
+		NULL,
+		NULL);
+
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
+	SpbContext->AsyncCompletion = Completion;
+	SpbContext->AsyncCompletionContext = Context;
+	SpbContext->AsyncLength = Length;
+
+	WdfRequestSetCompletionRoutine(
+		SpbContext->AsyncRequest,
+		SpbAsyncReadCompletion,
+		SpbContext);
+
+	InterlockedIncrement(&SpbContext->Transfers);
+	InterlockedExchangeAdd64(&SpbContext->BytesTransferred, sizeof(asyncRead->Address) + Length);
+
+	if (WdfRequestSend(
+		SpbContext->AsyncRequest,
+		SpbContext->SpbIoTarget,
+		WDF_NO_SEND_OPTIONS) == FALSE)
+	{
+		status = WdfRequestGetStatus(SpbContext->AsyncRequest);
+		goto exit;
+	}
+
+	return STATUS_PENDING;
+
+exit:
+
+	CyapaPrint(
+		DEBUG_LEVEL_ERROR,
+		DBG_IOCTL,
+		"Error starting asynchronous Spb read - %!STATUS!",
+		status);
+
+	InterlockedExchange(&SpbContext->AsyncBusy, 0);
+
+	return status;
+}
+
+VOID
+SpbCancelAsynchronousRead(
+_In_ SPB_CONTEXT *SpbContext
+)
+/*++
+
+Routine Description:
+
+This routine asks the Spb I/O target to cancel the asynchronous read in
+flight, if there is one. The read's completion still runs, with
+STATUS_CANCELLED unless the read had already finished.
+
+Arguments:
+
+SpbContext - Pointer to the current device context
+
+Return Value:
+
+None
+
+--*/
+{
+	if (SpbContext->AsyncRequest != NULL && SpbContext->AsyncBusy)
+	{
+		WdfRequestCancelSentRequest(SpbContext->AsyncRequest);
+	}
+}
+
 VOID
 SpbTargetDeinitialize(
 IN WDFDEVICE FxDevice,
@@ -334,9 +769,29 @@ NTSTATUS Status indicating success or failure
 	UNREFERENCED_PARAMETER(FxDevice);
 	UNREFERENCED_PARAMETER(SpbContext);
 
+	//
+	// Make sure no asynchronous read is still using the buffers
+	//
+	if (SpbContext->SpbIoTarget != NULL)
+	{
+		WdfIoTargetStop(SpbContext->SpbIoTarget, WdfIoTargetCancelSentIo);
+	}
+
 	//
 	// Free any SPB_CONTEXT allocations here
 	//
+	if (SpbContext->AsyncRequest != NULL)
+	{
+		WdfObjectDelete(SpbContext->AsyncRequest);
+		SpbContext->AsyncRequest = NULL;
+	}
+
+	if (SpbContext->AsyncMemory != NULL)
+	{
+		WdfObjectDelete(SpbContext->AsyncMemory);
+		SpbContext->AsyncMemory = NULL;
+	}
+
 	if (SpbContext->SpbLock != NULL)
 	{
 		WdfObjectDelete(SpbContext->SpbLock);
@@ -501,6 +956,41 @@ NTSTATUS Status indicating success or failure
 		goto exit;
 	}
 
+	//
+	// Preallocate the request and buffers used for asynchronous reads.
+	// Failing here is not fatal, reads then stay synchronous.
+	//
+	{
+		NTSTATUS asyncStatus;
+
+		asyncStatus = WdfMemoryCreate(
+			WDF_NO_OBJECT_ATTRIBUTES,
+			NonPagedPool,
+			CYAPA_POOL_TAG,
+			sizeof(SPB_ASYNC_READ),
+			&SpbContext->AsyncMemory,
+			NULL);
+
+		if (NT_SUCCESS(asyncStatus))
+		{
+			asyncStatus = WdfRequestCreate(
+				&objectAttributes,
+				SpbContext->SpbIoTarget,
+				&SpbContext->AsyncRequest);
+		}
+
+		if (!NT_SUCCESS(asyncStatus))
+		{
+			CyapaPrint(
+				DEBUG_LEVEL_ERROR,
+				DBG_IOCTL,
+				"Error preallocating asynchronous Spb read - %!STATUS!",
+				asyncStatus);
+
+			SpbContext->AsyncRequest = NULL;
+		}
+	}
+
 exit:
 
 	if (!NT_SUCCESS(status))
@@ -25,6 +25,21 @@ Revision History:
 
 #define DEFAULT_SPB_BUFFER_SIZE 64
 
+//
+// Completion callback for asynchronous reads. Data is only valid for the
+// duration of the callback.
+//
+
+typedef VOID
+SPB_READ_COMPLETION(
+	_In_ PVOID Context,
+	_In_ NTSTATUS Status,
+	_In_reads_bytes_(Length) PVOID Data,
+	_In_ ULONG Length
+	);
+
+typedef SPB_READ_COMPLETION *PSPB_READ_COMPLETION;
+
 //
 // SPB (I2C) context
 //
@@ -36,6 +51,40 @@ typedef struct _SPB_CONTEXT
 	WDFMEMORY WriteMemory;
 	WDFMEMORY ReadMemory;
 	WDFWAITLOCK SpbLock;
+
+	//
+	// Set once the controller rejects IOCTL_SPB_EXECUTE_SEQUENCE
+	//
+	BOOLEAN SequenceUnsupported;
+
+	//
+	// Number of transfers sent to the Spb I/O target. The synchronous
+	// paths run next to the asynchronous read, so both counters only
+	// change through interlocked adds
+	//
+	volatile LONG Transfers;
+
+	//
+	// Bytes moved over the bus by those transfers, register
+	// address bytes included
+	//
+	volatile LONG64 BytesTransferred;
+
+	//
+	// Where failed transfers are traced, NULL drops them
+	//
+	struct trace_sink *TraceSink;
+
+	//
+	// Preallocated request and buffers reused for every asynchronous
+	// read, only one of which can be in flight at a time
+	//
+	WDFREQUEST AsyncRequest;
+	WDFMEMORY AsyncMemory;
+	volatile LONG AsyncBusy;
+	PSPB_READ_COMPLETION AsyncCompletion;
+	PVOID AsyncCompletionContext;
+	ULONG AsyncLength;
 } SPB_CONTEXT;
 
 NTSTATUS
@@ -46,6 +95,20 @@ _In_reads_bytes_(Length) PVOID Data,
 _In_ ULONG Length
 );
 
+NTSTATUS
+SpbReadDataAsynchronously(
+_In_ SPB_CONTEXT *SpbContext,
+_In_ UCHAR Address,
+_In_ ULONG Length,
+_In_ PSPB_READ_COMPLETION Completion,
+_In_ PVOID Context
+);
+
+VOID
+SpbCancelAsynchronousRead(
+_In_ SPB_CONTEXT *SpbContext
+);
+
 VOID
 SpbTargetDeinitialize(
 IN WDFDEVICE FxDevice,
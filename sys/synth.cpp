@@ -0,0 +1,190 @@
+#include "synth.h"
+
+static uint32_t synth_random(struct synth_state *state) {
+	uint32_t x = state->rng;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	state->rng = x;
+	return x;
+}
+
+//
+// Uniform in -range..range
+//
+static int synth_noise(struct synth_state *state, int range) {
+	if (range <= 0)
+		return 0;
+	return (int)(synth_random(state) % (uint32_t)(2 * range + 1)) - range;
+}
+
+static int synth_clamp(int value, int max) {
+	if (value < 0)
+		return 0;
+	if (max > 0 && value > max)
+		return max;
+	if (value > 0x0FFF)
+		return 0x0FFF;
+	return value;
+}
+
+void synth_init(struct synth_state *state, const struct synth_script *script) {
+	state->script = script;
+	state->frame = 0;
+	state->rng = script->seed ? script->seed : 1;
+	state->nextid = 1;
+	for (int i = 0; i < CYAPA_MAX_MT; i++) {
+		state->id[i] = 0;
+		state->touch[i] = 0;
+		state->present[i] = false;
+	}
+}
+
+bool synth_next(struct synth_state *state, struct cyapa_regs *regs, uint32_t *timems) {
+	const struct synth_script *script = state->script;
+	uint32_t rate = script->rate ? script->rate : 100;
+	uint32_t now = (uint32_t)(state->frame * 1000 / rate);
+	int nfingers = script->nfingers > CYAPA_MAX_MT ? CYAPA_MAX_MT : script->nfingers;
+	int count = 0;
+
+	if (now >= script->duration)
+		return false;
+
+	state->frame++;
+	*timems = now;
+
+	regs->stat = CYAPA_STAT_RUNNING | CYAPA_PWR_ACTIVE | CYAPA_DEV_NORMAL;
+	regs->fngr = 0;
+	for (int i = 0; i < CYAPA_MAX_MT; i++) {
+		regs->touch[i].xy_high = 0;
+		regs->touch[i].x_low = 0;
+		regs->touch[i].y_low = 0;
+		regs->touch[i].pressure = 0;
+		regs->touch[i].id = 0;
+	}
+
+	for (int i = 0; i < nfingers; i++) {
+		const struct synth_finger *finger = &script->fingers[i];
+		bool down = now >= finger->down && (finger->up == 0 || now < finger->up);
+		uint32_t since = now - finger->down;
+		uint32_t touch = 0;
+
+		if (down && finger->repeat) {
+			//
+			// Down for the first half of every repeat period
+			//
+			touch = since / finger->repeat;
+			since %= finger->repeat;
+			down = since < finger->repeat / 2;
+		}
+
+		if (!down) {
+			state->present[i] = false;
+			continue;
+		}
+
+		//
+		// Ids run 1-15 and are handed out round robin, like the pad does
+		//
+		if (!state->present[i] || touch != state->touch[i]) {
+			state->id[i] = state->nextid;
+			state->nextid = state->nextid == 15 ? 1 : state->nextid + 1;
+			state->touch[i] = touch;
+			state->present[i] = true;
+		}
+
+		int x = finger->startx + (int)((long long)finger->vx * since / 1000);
+		int y = finger->starty + (int)((long long)finger->vy * since / 1000);
+		x = synth_clamp(x + synth_noise(state, script->jitter), script->resx);
+		y = synth_clamp(y + synth_noise(state, script->jitter), script->resy);
+
+		int p = finger->pressure;
+		if (finger->ramp && since < finger->ramp)
+			p = p * (int)since / (int)finger->ramp;
+		p = synth_clamp(p + synth_noise(state, finger->pressurevar), 255);
+
+		regs->touch[count].xy_high = (uint8_t)(((x >> 4) & 0xF0) | ((y >> 8) & 0x0F));
+		regs->touch[count].x_low = (uint8_t)x;
+		regs->touch[count].y_low = (uint8_t)y;
+		regs->touch[count].pressure = (uint8_t)p;
+		regs->touch[count].id = state->id[i];
+		count++;
+	}
+
+	regs->fngr = (uint8_t)(count << 4);
+	if (now >= script->buttondown && now < script->buttonup)
+		regs->fngr |= CYAPA_FNGR_LEFT;
+	return true;
+}
+
+static void synth_finger_at(struct synth_finger *finger, int x, int y, int vx, int vy) {
+	finger->startx = x;
+	finger->starty = y;
+	finger->vx = vx;
+	finger->vy = vy;
+	finger->pressure = 40;
+	finger->pressurevar = 0;
+	finger->ramp = 0;
+	finger->down = 0;
+	finger->up = 0;
+	finger->repeat = 0;
+}
+
+bool synth_preset(struct synth_script *script, int preset, uint32_t duration) {
+	script->rate = 100;
+	script->duration = duration;
+	script->jitter = 0;
+	script->buttondown = 0;
+	script->buttonup = 0;
+	script->resx = 1280;
+	script->resy = 720;
+	script->seed = 1;
+
+	switch (preset) {
+	case SYNTH_POINTING:
+		script->nfingers = 1;
+		synth_finger_at(&script->fingers[0], 100, 100, 300, 200);
+		break;
+	case SYNTH_TAPS:
+		script->nfingers = 1;
+		synth_finger_at(&script->fingers[0], 600, 300, 0, 0);
+		script->fingers[0].repeat = 150;
+		script->fingers[0].ramp = 20;
+		break;
+	case SYNTH_SCROLL:
+		script->nfingers = 2;
+		synth_finger_at(&script->fingers[0], 500, 600, 0, -800);
+		synth_finger_at(&script->fingers[1], 650, 600, 0, -800);
+		break;
+	case SYNTH_SWIPE:
+		script->nfingers = 3;
+		synth_finger_at(&script->fingers[0], 1000, 300, -800, 0);
+		synth_finger_at(&script->fingers[1], 1100, 320, -800, 0);
+		synth_finger_at(&script->fingers[2], 1200, 340, -800, 0);
+		break;
+	case SYNTH_CHURN:
+		script->nfingers = CYAPA_MAX_MT;
+		script->rate = 1000;
+		script->jitter = 3;
+		for (int i = 0; i < CYAPA_MAX_MT; i++) {
+			synth_finger_at(&script->fingers[i], 200 + i * 200, 300, 50 * (i - 2), 20 * i);
+			script->fingers[i].pressurevar = 10;
+			script->fingers[i].repeat = 20 + i * 7;
+		}
+		break;
+	case SYNTH_FLING:
+		script->nfingers = 3;
+		synth_finger_at(&script->fingers[0], 500, 680, 0, -3000);
+		synth_finger_at(&script->fingers[1], 650, 680, 0, -3000);
+		script->fingers[0].up = 200;
+		script->fingers[1].up = 200;
+		synth_finger_at(&script->fingers[2], 600, 400, 0, 0);
+		script->fingers[2].down = 600;
+		script->fingers[2].up = 700;
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,92 @@
+#ifndef _SYNTH_H_
+#define _SYNTH_H_
+
+#include "stdint.h"
+
+#include "cyapa.h"
+
+//
+// Synthetic touch frames. A script describes what each finger does and
+// synth_next turns it into a stream of cyapa_regs frames at the given
+// report rate, for loading the gesture engine with traces nobody
+// recorded (5 contacts churning ids, 1 kHz rates, noisy sensors...).
+//
+// Times are in ms from the start of the script, positions in pad units,
+// velocities in pad units per second.
+//
+
+struct synth_finger {
+	int startx;
+	int starty;
+	int vx;
+	int vy;
+
+	//
+	// Pressure reached ramp ms after touch down, wobbling by
+	// pressurevar either way while the finger is down
+	//
+	int pressure;
+	int pressurevar;
+	uint32_t ramp;
+
+	//
+	// On the pad from down until up (0 = until the end). With repeat set
+	// the finger lifts and touches down again every repeat ms while in
+	// that window, picking a new id each time, and restarts its path.
+	//
+	uint32_t down;
+	uint32_t up;
+	uint32_t repeat;
+};
+
+struct synth_script {
+	int nfingers;
+	struct synth_finger fingers[CYAPA_MAX_MT];
+
+	uint32_t rate;		/* frames per second */
+	uint32_t duration;	/* ms */
+
+	int jitter;		/* +/- noise added to every position */
+
+	//
+	// Clickpad button held from buttondown until buttonup (both 0 = never)
+	//
+	uint32_t buttondown;
+	uint32_t buttonup;
+
+	int resx;
+	int resy;
+
+	uint32_t seed;
+};
+
+struct synth_state {
+	const struct synth_script *script;
+	unsigned long long frame;
+	uint32_t rng;
+	uint8_t nextid;
+	uint8_t id[CYAPA_MAX_MT];
+	uint32_t touch[CYAPA_MAX_MT];	/* index of the current touch down */
+	bool present[CYAPA_MAX_MT];
+};
+
+void synth_init(struct synth_state *state, const struct synth_script *script);
+
+//
+// Fills in the next frame and its timestamp, false once the script is done
+//
+bool synth_next(struct synth_state *state, struct cyapa_regs *regs, uint32_t *timems);
+
+//
+// Ready made scripts
+//
+#define SYNTH_POINTING		1	/* one finger moving diagonally */
+#define SYNTH_TAPS		2	/* one finger tapping every 150 ms */
+#define SYNTH_SCROLL		3	/* two fingers moving up together */
+#define SYNTH_SWIPE		4	/* three fingers moving left */
+#define SYNTH_CHURN		5	/* five fingers lifting and landing at 1 kHz */
+#define SYNTH_FLING		6	/* two fingers flicking up, a finger landing later */
+
+bool synth_preset(struct synth_script *script, int preset, uint32_t duration);
+
+#endif
@@ -0,0 +1,174 @@
+#include "touchpad.h"
+
+//
+// hidcommon.h only needs these two from the Windows headers
+//
+typedef uint8_t BYTE;
+typedef uint16_t USHORT;
+
+#include "hidcommon.h"
+
+//
+// Defaults baked into TOUCHPAD_FINGER_COLLECTION
+//
+#define TOUCHPAD_DEFAULT_MAX_X 1000
+#define TOUCHPAD_DEFAULT_MAX_Y 700
+
+//
+// Short item prefixes (tag, type and a 2 byte size) and usages the
+// descriptor patch looks for
+//
+#define HID_ITEM_LOGICAL_MAX_2		0x26
+#define HID_ITEM_PHYSICAL_MAX_2		0x46
+#define HID_ITEM_USAGE_PAGE		0x04
+#define HID_ITEM_USAGE			0x08
+#define HID_ITEM_LONG			0xfe
+
+#define HID_PAGE_GENERIC_DESKTOP	0x01
+#define HID_USAGE_X			0x30
+#define HID_USAGE_Y			0x31
+
+void touchpad_extent(struct csgesture_softc *sc, uint16_t *maxx, uint16_t *maxy) {
+	if (!sc->infoSetup || sc->phyx <= 0 || sc->phyy <= 0 || sc->resx <= 0 || sc->resy <= 0) {
+		*maxx = TOUCHPAD_DEFAULT_MAX_X;
+		*maxy = TOUCHPAD_DEFAULT_MAX_Y;
+		return;
+	}
+	*maxx = (uint16_t)(sc->phyx * 10);
+	*maxy = (uint16_t)(sc->phyy * 10);
+}
+
+static void setitem(uint8_t *value, uint16_t max) {
+	value[0] = (uint8_t)(max & 0xFF);
+	value[1] = (uint8_t)(max >> 8);
+}
+
+void touchpad_patch_descriptor(uint8_t *descriptor, uint32_t length, uint16_t maxx, uint16_t maxy) {
+	//
+	// Offsets of the last 2 byte logical/physical maximum seen since the
+	// previous main item, those are the ones the next usage picks up
+	//
+	int32_t logicalmax = -1;
+	int32_t physicalmax = -1;
+	uint32_t usagepage = 0;
+	uint32_t offset = 0;
+
+	while (offset < length) {
+		uint8_t prefix = descriptor[offset];
+		uint32_t size;
+
+		if (prefix == HID_ITEM_LONG) {
+			if (offset + 1 >= length)
+				break;
+			offset += 3 + descriptor[offset + 1];
+			continue;
+		}
+
+		size = prefix & 0x03;
+		if (size == 3)
+			size = 4;
+		if (offset + 1 + size > length)
+			break;
+
+		uint32_t value = 0;
+		for (uint32_t b = 0; b < size; b++)
+			value |= (uint32_t)descriptor[offset + 1 + b] << (8 * b);
+
+		if (prefix == HID_ITEM_LOGICAL_MAX_2)
+			logicalmax = (int32_t)offset + 1;
+		else if (prefix == HID_ITEM_PHYSICAL_MAX_2)
+			physicalmax = (int32_t)offset + 1;
+		else if ((prefix & 0xFC) == HID_ITEM_USAGE_PAGE)
+			usagepage = value;
+		else if ((prefix & 0xFC) == HID_ITEM_USAGE && size < 4 && usagepage == HID_PAGE_GENERIC_DESKTOP &&
+			(value == HID_USAGE_X || value == HID_USAGE_Y) && logicalmax >= 0 && physicalmax >= 0) {
+			uint16_t max = (value == HID_USAGE_X) ? maxx : maxy;
+			setitem(descriptor + logicalmax, max);
+			setitem(descriptor + physicalmax, max);
+		}
+		else if ((prefix & 0x0C) == 0) {
+			//
+			// Main item, the maximums seen so far belong to it
+			//
+			logicalmax = -1;
+			physicalmax = -1;
+		}
+
+		offset += 1 + size;
+	}
+}
+
+bool touchpad_report(struct touchpad_state *state, struct csgesture_softc *sc, struct cyapa_regs *regs,
+	uint16_t scantime, struct _CYAPA_TOUCHPAD_REPORT *report) {
+	uint16_t maxx, maxy;
+	uint16_t downmask = 0;
+	bool buttondown = false;
+	int nfingers = 0;
+
+	*report = CyapaTouchpadReport();
+	report->ReportID = REPORTID_TOUCHPAD;
+	report->ScanTime = scantime;
+
+	touchpad_extent(sc, &maxx, &maxy);
+
+	if (regs->stat & CYAPA_STAT_RUNNING) {
+		int count = CYAPA_FNGR_NUMFINGERS(regs->fngr);
+		if (count > TOUCHPAD_CONTACTS)
+			count = TOUCHPAD_CONTACTS;
+
+		for (int i = 0; i < count; i++) {
+			CyapaTouchpadContact *contact = &report->Contacts[nfingers];
+			int id = regs->touch[i].id & 0x0F;
+			int x = CYAPA_TOUCH_X(regs, i);
+			int y = CYAPA_TOUCH_Y(regs, i);
+
+			if (sc->infoSetup && sc->resx > 0 && sc->resy > 0) {
+				x = x * maxx / sc->resx;
+				y = y * maxy / sc->resy;
+			}
+			if (x > maxx)
+				x = maxx;
+			if (y > maxy)
+				y = maxy;
+
+			contact->Status = TOUCHPAD_CONTACT_CONFIDENCE | TOUCHPAD_CONTACT_TIP;
+			contact->ContactID = (BYTE)id;
+			contact->XValue = (USHORT)x;
+			contact->YValue = (USHORT)y;
+			nfingers++;
+
+			downmask |= 1 << id;
+			state->x[id] = (uint16_t)x;
+			state->y[id] = (uint16_t)y;
+		}
+
+		buttondown = (regs->fngr & CYAPA_FNGR_LEFT) != 0;
+	}
+
+	//
+	// Lifted contacts go out once more at their last position, tip up.
+	// An id that is down again has nothing left to report.
+	//
+	uint16_t lifted = (state->downmask | state->liftmask) & ~downmask;
+	for (int id = 0; lifted && nfingers < TOUCHPAD_CONTACTS; id++) {
+		if (!(lifted & (1 << id)))
+			continue;
+		lifted &= ~(1 << id);
+
+		CyapaTouchpadContact *contact = &report->Contacts[nfingers];
+		contact->Status = TOUCHPAD_CONTACT_CONFIDENCE;
+		contact->ContactID = (BYTE)id;
+		contact->XValue = state->x[id];
+		contact->YValue = state->y[id];
+		nfingers++;
+	}
+
+	report->ContactCount = (BYTE)nfingers;
+	report->Button = buttondown ? 1 : 0;
+
+	bool send = nfingers > 0 || buttondown != state->buttondown;
+	state->downmask = downmask;
+	state->liftmask = lifted;
+	state->buttondown = buttondown;
+	return send;
+}
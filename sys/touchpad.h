@@ -0,0 +1,52 @@
+#ifndef _TOUCHPAD_H_
+#define _TOUCHPAD_H_
+
+#include "stdint.h"
+
+#include "cyapa.h"
+#include "gesture.h"
+
+//
+// Touchpad output mode. Instead of running the gesture engine the raw
+// contacts are reported as they are, in precision touchpad layout, and
+// the host does the gestures. Builds without the WDK like the engine.
+//
+
+struct _CYAPA_TOUCHPAD_REPORT;
+
+//
+// Sensor size in the report's X/Y units (0.1 mm). Falls back to the
+// descriptor defaults until the trackpad info has been read.
+//
+void touchpad_extent(struct csgesture_softc *sc, uint16_t *maxx, uint16_t *maxy);
+
+//
+// Rewrites the X/Y logical and physical maximums of every finger in a
+// report descriptor. Only 2 byte items are touched, anything else is
+// left as it is.
+//
+void touchpad_patch_descriptor(uint8_t *descriptor, uint32_t length, uint16_t maxx, uint16_t maxy);
+
+//
+// What went out in the last report, so contacts that left the pad get
+// reported once more with the tip cleared. A report only has room for
+// TOUCHPAD_CONTACTS, lifts that did not fit wait in liftmask for the
+// next one.
+//
+struct touchpad_state {
+	uint16_t downmask;	/* bit per contact id */
+	uint16_t liftmask;	/* lifted, not reported yet */
+	bool buttondown;
+	uint16_t x[16];
+	uint16_t y[16];
+};
+
+//
+// Fills a REPORTID_TOUCHPAD report from a frame, scantime in 100 us.
+// Returns false when there is nothing to send (no contacts now, no lift
+// to report and the button did not change).
+//
+bool touchpad_report(struct touchpad_state *state, struct csgesture_softc *sc, struct cyapa_regs *regs,
+	uint16_t scantime, struct _CYAPA_TOUCHPAD_REPORT *report);
+
+#endif
@@ -3,6 +3,8 @@
 #ifndef _TRACE_H_
 #define _TRACE_H_
 
+#include "tracesink.h"
+
 extern "C" 
 {
 //
@@ -0,0 +1,71 @@
+#ifndef _TRACESINK_H_
+#define _TRACESINK_H_
+
+#include "stdint.h"
+
+//
+// Structured trace events for the hot paths. Each event is an id and two
+// 32 bit arguments handed to the installed trace_sink, which decides where
+// they go (ETW and the capture ring in the driver, an in-memory buffer in
+// a host build). Nothing here depends on the WDK.
+//
+
+#define TRACE_EVENT_READ	0	/* frame read done: 1 if it succeeded, fingers */
+#define TRACE_EVENT_GESTURE	1	/* gesture decision changed: TRACE_GESTURE_xxx, fingers moving */
+#define TRACE_EVENT_REPORT	2	/* report emitted: report id, TRACE_REPORT_xxx */
+#define TRACE_EVENT_SPB_ERROR	3	/* bus transfer failed: status, register address */
+
+#define TRACE_GESTURE_NONE	0
+#define TRACE_GESTURE_SWIPE	1
+#define TRACE_GESTURE_SCROLL	2
+#define TRACE_GESTURE_MOVE	3
+
+#define TRACE_REPORT_SENT	0
+#define TRACE_REPORT_QUEUED	1
+#define TRACE_REPORT_DROPPED	2
+
+//
+// Events that mark a change of state rather than a frame or a report go
+// by, so they are rare enough to leave in every build
+//
+#define TRACE_EVENTS_TRANSITIONS ((1 << TRACE_EVENT_GESTURE) | (1 << TRACE_EVENT_SPB_ERROR))
+
+//
+// Bit (1 << TRACE_EVENT_xxx) set for every event that gets compiled in.
+// Events left out cost nothing, not even the sink check. Checked builds
+// get all of them, free builds the transitions, unless the build says
+// otherwise.
+//
+#ifndef CYAPA_TRACE_EVENTS
+#if DBG
+#define CYAPA_TRACE_EVENTS 0xF
+#else
+#define CYAPA_TRACE_EVENTS TRACE_EVENTS_TRANSITIONS
+#endif
+#endif
+
+struct trace_sink {
+	void *context;
+	void(*event)(void *context, uint8_t id, uint32_t arg0, uint32_t arg1);
+
+	//
+	// Bit (1 << TRACE_EVENT_xxx) for each compiled in event the sink
+	// takes, switched at run time. The rest stop at this test.
+	//
+	volatile uint32_t enabled;
+};
+
+//
+// Raises an event on sink, a NULL sink drops it. Each device owns its
+// sink, so events never reach a device other than the one they are about.
+//
+#define TraceEvent(sink, id, arg0, arg1)								\
+	do {																\
+		struct trace_sink *_sink = (sink);								\
+		if ((CYAPA_TRACE_EVENTS & (1 << (id))) && _sink &&				\
+			(_sink->enabled & (1u << (id))))							\
+			_sink->event(_sink->context,								\
+				(uint8_t)(id), (uint32_t)(arg0), (uint32_t)(arg1));		\
+	} while (0)
+
+#endif